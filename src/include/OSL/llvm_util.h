@@ -31,6 +31,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OSL/export.h>
 #include <OSL/oslversion.h>
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #ifdef LLVM_NAMESPACE
@@ -40,6 +42,9 @@ namespace llvm = LLVM_NAMESPACE;
 namespace llvm {
   class BasicBlock;
   class ConstantFolder;
+  class DIBuilder;
+  class DICompileUnit;
+  class DIScope;
   class ExecutionEngine;
   class Function;
   class FunctionType;
@@ -146,8 +151,13 @@ public:
 
     /// Create a new JITing ExecutionEngine and make it the current one.
     /// Return a pointer to the new engine.  If err is not NULL, put any
-    /// errors there.
-    llvm::ExecutionEngine *make_jit_execengine (std::string *err=NULL);
+    /// errors there.  If profiling_events is true, the addresses of the
+    /// code it generates will be published for sampling profilers: in
+    /// the perf map file /tmp/perf-<pid>.map (one entry per source line,
+    /// if the module has debugging symbols, otherwise per function), and
+    /// to LLVM's own perf jitdump writer, if LLVM was built with it.
+    llvm::ExecutionEngine *make_jit_execengine (std::string *err=NULL,
+                                                bool profiling_events=false);
 
     /// Return a pointer to the current ExecutionEngine.  Create a JITing
     /// ExecutionEngine if one isn't already set up.
@@ -161,6 +171,32 @@ public:
     /// current one).
     void execengine (llvm::ExecutionEngine *exec);
 
+    /// Return a hex string that uniquely identifies the IR of the given
+    /// functions as it would be compiled for this host (the LLVM version,
+    /// target triple, host CPU and its features are folded in), along
+    /// with any caller-supplied extra
+    /// text describing other things that affect code generation.
+    std::string func_hash (const std::vector<llvm::Function*> &funcs,
+                           const std::string &extra=std::string());
+
+    /// Make the current ExecutionEngine use a persistent on-disk cache
+    /// of compiled machine code, kept in directory dir, and retrieve or
+    /// store the object for the current module under the given key.
+    /// Return true if the object was found in the cache, in which case
+    /// it will be used instead of generating code for the module (so the
+    /// caller need not bother optimizing the IR), and store its size in
+    /// *bytes_read (if not NULL). Return false if it was not found, in
+    /// which case the object will be saved to the cache once compiled.
+    bool use_object_cache (const std::string &dir, const std::string &key,
+                           size_t *bytes_read=NULL);
+
+    /// Make subsequent constant pointers (and ustring constants) refer to
+    /// external symbols that are resolved when the code is linked, rather
+    /// than embedding this process's addresses in the IR. Must be called
+    /// before make_jit_execengine. The IR then describes only the code,
+    /// and func_hash of it can identify a cache entry in any process.
+    void relocatable_constants ();
+
     /// Change symbols in the module that are marked as having external
     /// linkage to an alternate linkage that allows them to be discarded if
     /// not used within the module. Only do this for functions that start
@@ -170,11 +206,40 @@ public:
                                        const std::vector<std::string> &exceptions,
                                        const std::vector<std::string> &moreexceptions);
 
+    /// Start emitting debugging symbols (source line tables) for the
+    /// current module, which will be known by the given name.
+    void debug_setup_compile_unit (const std::string &name);
+
+    /// Are we emitting debugging symbols?
+    bool debug_is_enabled () const { return m_llvm_debug_builder != nullptr; }
+
+    /// Make the current function (which must also have a builder) a
+    /// debugging symbol, defined at the given source file and line.
+    void debug_push_function (const std::string &function_name,
+                              OIIO::ustring sourcefile, int sourceline);
+
+    /// Done with the debugging symbol of the current function.
+    void debug_pop_function ();
+
+    /// Attribute the instructions generated from here on to the given
+    /// source file and line (of the current function).
+    void debug_set_location (OIIO::ustring sourcefile, int sourceline);
+
+    /// Finish the debugging symbols of the module; must be called before
+    /// it is optimized or compiled.
+    void debug_finalize ();
+
     /// Setup LLVM optimization passes.
     void setup_optimization_passes (int optlevel);
 
-    /// Run the optimization passes.
-    void do_optimize (std::string *err = NULL);
+    /// Run the optimization passes. If funcs is given, the per-function
+    /// passes are run on each of those functions separately (and on the
+    /// rest of the module together), and if func_times is also given, it
+    /// receives the seconds spent on each of funcs.  The module-wide
+    /// (interprocedural) passes can't be split up by function.
+    void do_optimize (std::string *err = NULL,
+                      const std::vector<llvm::Function*> *funcs = NULL,
+                      std::vector<double> *func_times = NULL);
 
     /// Retrieve a callable pointer to the JITed version of a function.
     /// This will JIT the function if it hasn't already done so. Be sure
@@ -390,6 +455,10 @@ public:
     /// call_function()) as using the 'fast' calling convention.
     void mark_fast_func_call (llvm::Value *funccall);
 
+    /// Mark the function as rarely run: it is optimized for size and
+    /// never inlined into its callers.
+    void mark_cold_function (llvm::Function *func);
+
     /// Set the code insertion point for subsequent ops to block.
     void set_insert_point (llvm::BasicBlock *block);
 
@@ -407,6 +476,12 @@ public:
     void op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
                     llvm::BasicBlock *falseblock);
 
+    /// Like op_branch, but also tell LLVM how often each way is expected
+    /// to be taken (only the ratio of the weights matters).
+    void op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
+                    llvm::BasicBlock *falseblock,
+                    uint32_t trueweight, uint32_t falseweight);
+
     /// Generate code for a memset.
     void op_memset (llvm::Value *ptr, int val, int len, int align=1);
 
@@ -502,13 +577,22 @@ public:
     /// Is the function empty, except for simply a ret statement?
     bool func_is_empty (llvm::Function *func);
 
+    /// Return the number of IR instructions in the function body.
+    size_t func_instruction_count (llvm::Function *func);
+
     std::string func_name (llvm::Function *f);
 
+    /// Rename the function (references to it follow along).
+    void func_name (llvm::Function *f, const std::string &name);
+
     static size_t total_jit_memory_held ();
 
 private:
     class MemoryManager;
     class IRBuilder;
+    class ObjectCache;
+    class PerfMapListener;
+    class RelocTable;
 
     void SetupLLVM ();
     IRBuilder& builder();
@@ -522,7 +606,15 @@ private:
     llvm::Function *m_current_function;
     llvm::legacy::PassManager *m_llvm_module_passes;
     llvm::legacy::FunctionPassManager *m_llvm_func_passes;
+    bool m_func_passes_first;   // Run func passes before module passes?
     llvm::ExecutionEngine *m_llvm_exec;
+    std::unique_ptr<ObjectCache> m_object_cache;
+    std::shared_ptr<RelocTable> m_relocs;   // non-NULL if relocatable
+    llvm::DIBuilder *m_llvm_debug_builder;
+    llvm::DICompileUnit *m_debug_cu;
+    llvm::DIScope *m_debug_function;         // current function
+    llvm::DIScope *m_debug_scope;            // ... and file within it
+    const char *m_debug_scope_file;          // (a ustring's chars)
     std::vector<llvm::BasicBlock *> m_return_block;     // stack for func call
     std::vector<llvm::BasicBlock *> m_loop_after_block; // stack for break
     std::vector<llvm::BasicBlock *> m_loop_step_block;  // stack for continue
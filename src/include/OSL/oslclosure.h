@@ -29,6 +29,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include <cstring>
+#include <vector>
 #include <OpenImageIO/ustring.h>
 #include <OSL/oslconfig.h>
 
@@ -154,4 +155,32 @@ struct OSLEXECPUBLIC ClosureAdd : public ClosureColor
     const ClosureColor *closureB;
 };
 
+
+/// FlatClosure is one primitive component of a closure that has been
+/// flattened into a plain list: the component (for its id and parameter
+/// data) along with its total weight, which already includes both the
+/// component's own weight and those of all the ClosureMul nodes above it.
+/// A closure color is simply the sum of the components of its flat list.
+struct OSLEXECPUBLIC FlatClosure
+{
+    int id;                          ///< ID of the closure primitive
+    Color3 weight;                   ///< Total (premultiplied) weight
+    const ClosureComponent *comp;    ///< The component itself
+
+    /// Handy method for getting the parameter memory as a void*.
+    const void *data () const { return comp->data(); }
+
+    /// Handy method for extracting the underlying parameters as a struct
+    template <typename T>
+    const T* as() const { return comp->as<T>(); }
+};
+
+
+/// Append the components of the closure tree to the flat list, with
+/// their total weights, skipping any whose weight is zero.  This is for
+/// renderers that would rather not walk the ClosureAdd/ClosureMul tree
+/// themselves.
+OSLEXECPUBLIC void flatten_closure (const ClosureColor *closure,
+                                    std::vector<FlatClosure> &flat);
+
 OSL_NAMESPACE_EXIT
@@ -46,6 +46,7 @@ class RendererServices;
 class ShaderGroup;
 typedef std::shared_ptr<ShaderGroup> ShaderGroupRef;
 struct ClosureParam;
+struct FlatClosure;
 struct PerThreadInfo;
 class ShadingContext;
 class ShaderSymbol;
@@ -106,6 +107,13 @@ public:
     ///                              output atomically, to prevent threads
     ///                              from interleaving lines. (1)
     ///    int profile            Perform some rudimentary profiling (0)
+    ///    int profile_layers     Instrument the JIT-compiled code to time
+    ///                              each layer (1), and also each texture,
+    ///                              noise, getattribute, trace, closure,
+    ///                              pointcloud and dict op (2), reporting
+    ///                              the most expensive ones, by group,
+    ///                              layer and source line, in the stats.
+    ///                              Set before groups are compiled. (0)
     ///    int no_noise           Replace noise with constant value. (0)
     ///    int no_pointcloud      Skip pointcloud lookups. (0)
     ///    int exec_repeat        How many times to run each group (1).
@@ -150,6 +158,47 @@ public:
     ///                              once, replacing former definition.
     ///    string archive_groupname  Name of a group to pickle and archive.
     ///    string archive_filename   Name of file to save the group archive.
+    ///    int async_jit          If nonzero, the number of background
+    ///                              threads used to optimize and JIT groups.
+    ///                              A thread that executes a group that is
+    ///                              not yet compiled will queue it and
+    ///                              execute_init will return false (and
+    ///                              execution_deferred will return true,
+    ///                              to tell this apart from an empty group)
+    ///                              rather than blocking on the compile. (0)
+    ///    string llvm_jit_cache  If set, the name of a directory where the
+    ///                              JIT-compiled machine code of each group
+    ///                              is cached, and reused (skipping the
+    ///                              LLVM optimization and code generation)
+    ///                              whenever a group yields identical IR.
+    ///    int interactive_respecialize  Milliseconds that a group with
+    ///                              "interactive_params" must go without
+    ///                              ReParameter edits before a fully
+    ///                              optimized copy (with the params'
+    ///                              current values folded in) is built in
+    ///                              the background and run in its place
+    ///                              until the next edit; 0 disables. (500)
+    ///    int llvm_debugging_symbols  If nonzero, attach OSL source file and
+    ///                              line info to the JIT-compiled code of
+    ///                              each layer, so that debuggers and
+    ///                              profilers can map it to the .osl. (0)
+    ///    int llvm_profiling_events  If nonzero, announce JIT-compiled
+    ///                              functions to external profilers: write
+    ///                              /tmp/perf-<pid>.map for Linux perf
+    ///                              (per source line when
+    ///                              llvm_debugging_symbols is also set) and
+    ///                              register LLVM's perf/VTune listeners
+    ///                              when available. (0)
+    ///    int pgo_samples        If nonzero, JIT each group with counters
+    ///                              of its layer runs and if/loop branch
+    ///                              outcomes, and after this many shades
+    ///                              rebuild it (in the background if there
+    ///                              are async_jit threads, otherwise on
+    ///                              the shading thread) with
+    ///                              the branches weighted, never-run layers
+    ///                              kept cold, and always-run lazy layers
+    ///                              run up front, then run the rebuilt
+    ///                              copy in its place. (0)
     /// 3. Attributes that that are intended for developers debugging
     /// liboslexec itself:
     /// These attributes may be helpful for liboslexec developers or
@@ -163,8 +212,16 @@ public:
     ///         opt_elide_useless_ops, opt_elide_unconnected_outputs,
     ///         opt_peephole, opt_coalesce_temps, opt_assign, opt_mix
     ///         opt_merge_instances, opt_merge_instance_with_userdata,
-    ///         opt_fold_getattribute, opt_middleman, opt_texture_handle
-    ///         opt_seed_bblock_aliases
+    ///         opt_fold_getattribute, opt_fold_dict, opt_middleman,
+    ///         opt_texture_handle
+    ///         opt_seed_bblock_aliases, opt_groupdata
+    ///    int opt_fold_ocio_matrix  If 1, a transformc between OCIO color
+    ///                              spaces whose results match a 3x3 matrix
+    ///                              on a handful of probe colors is turned
+    ///                              into a matrix multiply. The probes can't
+    ///                              prove the transform linear, so only
+    ///                              enable this for configs known to use
+    ///                              matrix-only transforms (0).
     ///    int opt_passes         Number of optimization passes per layer (10)
     ///    int llvm_optimize      Which of several LLVM optimize strategies (0)
     ///    int llvm_debug         Set LLVM extra debug level (0)
@@ -218,6 +275,21 @@ public:
     ///                                 be elided, but nor will they be
     ///                                 called unconditionally.
     ///    int exec_repeat            How many times to run the group (1).
+    ///    string[] interactive_params  Array of names ("param" or
+    ///                                 "layer.param") of parameters that
+    ///                                 should be kept live rather than
+    ///                                 optimized into constants, so that
+    ///                                 ReParameter may change them after the
+    ///                                 group is optimized. Each must be given
+    ///                                 an instance value with Parameter().
+    ///                                 Must be set before optimization.
+    ///    int flat_closures          If nonzero, the closure result of
+    ///                                 each execution can be retrieved as
+    ///                                 a list of weighted components (see
+    ///                                 flat_closures()). This is for the
+    ///                                 convenience of renderers, not an
+    ///                                 optimization: the shaders still
+    ///                                 build the tree. (0)
     ///
     bool attribute (ShaderGroup *group, string_view name,
                     TypeDesc type, const void *val);
@@ -282,6 +354,11 @@ public:
     ///   int unknown_textures_needed  Nonzero if additional textures may be
     ///                                needed, whose names can't be known
     ///                                without actually running the shader.
+    ///   int num_dictionaries_needed  The number of constant dictionary
+    ///                                names (files or inline XML) used by
+    ///                                dict_find in the group.
+    ///   ptr dictionaries_needed    Retrieves a pointer to the ustring array
+    ///                                containing those dictionary names.
     ///   int num_closures_needed    The number of named closures needed.
     ///   ptr closures_needed        Retrieves a pointer to the ustring array
     ///                                containing all closures known to be
@@ -326,10 +403,20 @@ public:
     ///   int num_renderer_outputs   Number of named renderer outputs.
     ///   string renderer_outputs[]  List of renderer outputs.
     ///   int raytype_queries        Bit field of all possible rayquery
+    ///   int num_interactive_params Number of named interactive params.
+    ///   string interactive_params[] List of interactive params.
     ///   int num_entry_layers       Number of named entry point layers.
     ///   string entry_layers[]      List of entry point layers.
     ///   string pickle              Retrieves a serialized representation
     ///                                 of the shader group declaration.
+    ///   int optimized              Nonzero if the group has already been
+    ///                                 optimized and JITed. (Querying this
+    ///                                 does not itself trigger the
+    ///                                 optimization, unlike the attributes
+    ///                                 that depend on it.)
+    ///   int llvm_groupdata_size    Bytes of per-context heap the group
+    ///                                 needs to run (0 until it has been
+    ///                                 JITed; querying it doesn't JIT).
     /// Note: the attributes referred to as "string" are actually on the app
     /// side as ustring or const char* (they have the same data layout), NOT
     /// std::string!
@@ -449,8 +536,18 @@ public:
     /// fail if the shader has already been irrevocably optimized/compiled,
     /// unless the paraticular parameter is marked as lockgeom=0 (which
     /// indicates that it's a parameter that may be overridden by the
-    /// geometric primitive).  This call gives you a way of changing the
-    /// instance value, even if it's not a geometric override.
+    /// geometric primitive) or is one of the group's "interactive_params".
+    /// This call gives you a way of changing the instance value, even if
+    /// it's not a geometric override.
+    ///
+    /// When a group with interactive params has a background-specialized
+    /// copy run in its place (see the "interactive_respecialize" option),
+    /// ShaderSymbol pointers found on the original group still work with
+    /// symbol_address(); symbol_address() returns NULL for any symbol that
+    /// the copy optimized away. A superseded copy is freed once no context
+    /// is using it any more (a context keeps the copy it last ran until
+    /// its next execution, or until it is released, so that get_symbol
+    /// still works after execute).
     bool ReParameter (ShaderGroup &group,
                       string_view layername, string_view paramname,
                       TypeDesc type, const void *val);
@@ -509,6 +606,30 @@ public:
     bool execute (ShadingContext *ctx, ShaderGroup &group,
                   ShaderGlobals &globals, bool run=true);
 
+    /// Execute the shader group over a batch of npoints shading points,
+    /// whose globals are given by the array globals[0..npoints-1]. If
+    /// mask is non-NULL, only the points for which mask[i] is true are
+    /// shaded. This is equivalent to calling execute() on each point,
+    /// but the group binding, optimization check, heap setup, error
+    /// processing and stats are done once for the whole batch, so it is
+    /// cheaper for renderers that already sort their points by material.
+    /// The closure results (globals[i].Ci) of every point in the batch
+    /// remain valid until the next execution in this context, but the
+    /// values of output symbols (as retrieved by get_symbol) will only
+    /// reflect the last point shaded. Each point runs the same layer
+    /// entry as execute() (so layer profiling and profile-guided
+    /// sampling see every point), but the group's "exec_repeat" is not
+    /// honored for batches. Return true if the group did anything.
+    ///
+    /// EXPERIMENTAL: this entry point is not part of the stable API. It
+    /// takes an array of per-point ShaderGlobals (AoS) for now, and is
+    /// expected to change to take structure-of-arrays batched globals,
+    /// without a deprecation period, once the shaders themselves run
+    /// over whole batches.
+    bool execute_batch (ShadingContext &ctx, ShaderGroup &group,
+                        int npoints, ShaderGlobals *globals,
+                        const bool *mask=nullptr);
+
     /// Bind a shader group and globals to the context, in preparation to
     /// execute, including optimization and JIT of the group (if it has not
     /// already been done).  If 'run' is true, also run any initialization
@@ -520,6 +641,13 @@ public:
     bool execute_init (ShadingContext &ctx, ShaderGroup &group,
                        ShaderGlobals &globals, bool run=true);
 
+    /// Return true if the last execute, execute_batch or execute_init in
+    /// this context returned false only because the group has not been
+    /// compiled yet and was queued for the "async_jit" threads, so the
+    /// caller should shade those points again later. Return false if the
+    /// group ran, or if it was empty or did nothing.
+    bool execution_deferred (const ShadingContext &ctx) const;
+
     /// Execute the layer whose index is specified, in this context. It is
     /// presumed that execute_init() has already been called, with
     /// run==true, and that the call to execute_init() returned true. (One
@@ -544,6 +672,24 @@ public:
     /// if no such named layer exists.
     int find_layer (const ShaderGroup &group, ustring layername) const;
 
+    /// Discard every attribute value that contexts have cached because
+    /// RendererServices::attribute_is_constant said it would not change.
+    /// Call this when those values do change after all (for example,
+    /// between frames, or when objects are edited or objdata pointers are
+    /// reused). It is cheap, and safe to call while other threads shade;
+    /// each context drops its cache at its next getattribute.
+    void invalidate_attribute_cache ();
+
+    /// XML files read by dict_find() are parsed once and then cached for
+    /// the life of the ShadingSystem, even if they change on disk. This
+    /// call checks the modification time of each of them, and any that
+    /// changed will be read again by the next dict_find that names it.
+    /// Node IDs that shaders already hold keep referring to the old
+    /// contents, and groups that were already optimized keep any lookups
+    /// that the optimizer constant-folded. It is safe to call while other
+    /// threads shade.
+    void invalidate_dictionaries ();
+
     /// Get a raw pointer to a named symbol (such as you'd need to pull
     /// out the value of an output parameter).  ctx is the shading
     /// context (presumably already run), name is the name of the
@@ -593,6 +739,29 @@ public:
     const void* symbol_address (const ShadingContext &ctx,
                                 const ShaderSymbol *sym) const;
 
+    /// For a group whose "flat_closures" attribute is set, retrieve the
+    /// closure result (Ci) of the execution immediately prior in this
+    /// context as a flat list of components whose weights already
+    /// include those of every ClosureMul above them, so the renderer
+    /// needn't walk the closure tree. For execute_batch, point is the
+    /// index of the shading point within the batch (masked-off points
+    /// have empty lists); otherwise it should be 0. Set closures to the
+    /// start of the list (valid until the next call, or the next
+    /// execution in the context), and return its length. The shaders
+    /// still build the tree in globals.Ci, and this just walks it for
+    /// you, much as the renderer would itself, so it is a convenience
+    /// rather than a speedup.
+    int flat_closures (const ShadingContext &ctx,
+                       const FlatClosure* &closures, int point=0) const;
+
+    /// Turn a flat list of n closure components (such as one returned by
+    /// flat_closures()) back into a ClosureAdd/ClosureMul tree, for code
+    /// that wants a tree. The new nodes are allocated in the context, and
+    /// are valid until its next execution. Return NULL if n is 0.
+    const ClosureColor* closure_tree (ShadingContext &ctx,
+                                      const FlatClosure *closures,
+                                      int n) const;
+
     /// Return the statistics output as a huge string.
     ///
     std::string getstats (int level=1) const;
@@ -691,6 +860,17 @@ private:
 
 
 
+/// Convert the point cloud infile to the native ".oslpc" format (which
+/// needs no Partio to read, and is memory-mapped when searched) and
+/// write it to outfile. infile may be anything Partio reads (in builds
+/// with Partio) or another ".oslpc" file. Return true on success, or
+/// false with an explanation in errmessage.
+OSLEXECPUBLIC
+bool convert_pointcloud (string_view infile, string_view outfile,
+                         std::string &errmessage);
+
+
+
 #ifdef OPENIMAGEIO_IMAGEBUFALGO_H
 // To keep from polluting all OSL clients with ImageBuf & ROI, only expose
 // the following declarations if they have included OpenImageIO/imagebufalgo.h.
@@ -67,7 +67,8 @@ public:
 
     /// Given the name of a 'feature', return whether this RendererServices
     /// supports it. Feature names include:
-    ///    <none>
+    ///    texture_batch    Send the 2D texture lookups of execute_batch
+    ///                       to texture_batch() rather than texture().
     ///
     /// This allows some customization of JIT generated code based on the
     /// facilities and features of a particular renderer. It also allows
@@ -139,6 +140,16 @@ public:
     virtual bool get_inverse_matrix (ShaderGlobals *sg, Matrix44 &result,
                                      ustring to);
 
+    /// Return true if the named coordinate system's transformation (as
+    /// retrieved by get_matrix and get_inverse_matrix) is the same for
+    /// every shade and every time, so that a ShadingContext may cache it
+    /// and reuse it without calling the renderer again. Otherwise, named
+    /// matrices are only reused within a single shade. The default
+    /// implementation returns false.
+    virtual bool matrix_is_constant (ShaderGlobals *sg, ustring name) {
+        return false;
+    }
+
     /// Transform points Pin[0..npoints-1] in named coordinate system
     /// 'from' into 'to' coordinates, storing the result in Pout[] using
     /// the specified vector semantic (POINT, VECTOR, NORMAL).  The
@@ -191,6 +202,18 @@ public:
                                       ustring object, TypeDesc type,
                                       ustring name, int index, void *val) { return false; }
 
+    /// Return true if the named attribute, as just successfully retrieved
+    /// by get_attribute or get_array_attribute, will have the same value
+    /// for every shade of that object -- the named object, or if object is
+    /// empty, the object identified by sg->objdata. The shading system
+    /// may then cache the value and reuse it without calling the renderer
+    /// again for that object. (This requires that sg->objdata uniquely
+    /// identify an object until ShadingSystem::invalidate_attribute_cache
+    /// is called.) The default implementation returns false, so that
+    /// nothing is cached.
+    virtual bool attribute_is_constant (ShaderGlobals *sg, ustring object,
+                                        ustring name) { return false; }
+
     /// Get the named user-data from the current object and write it into
     /// 'val'. If derivatives is true, the derivatives should be written into val
     /// as well. Return false if no user-data with the given name and type was
@@ -245,6 +268,41 @@ public:
                           float *result, float *dresultds, float *dresultdt,
                           ustring *errormessage);
 
+    /// Filtered 2D texture lookups of the same texture, with the same
+    /// options, for a batch of npoints points.
+    ///
+    /// The coordinate and derivative arrays each have npoints entries,
+    /// and result (and dresultds/dresultdt, if non-NULL) hold nchannels
+    /// floats per point, one point after another. If mask is non-NULL,
+    /// only the points whose mask entry is true are looked up. sg is the
+    /// ShaderGlobals of the first point (or NULL), used only for its
+    /// context and for reporting errors.
+    ///
+    /// This is meant for batched or deferred shading, so that a renderer
+    /// can share the file resolution, tile locking and MIP level
+    /// selection across the whole batch. The default implementation
+    /// resolves the texture handle and per-thread info once and then
+    /// calls texture() for each active point (with the same sg), so
+    /// renderers that only override texture() see every lookup. If the
+    /// renderer's supports("texture_batch") returns true, the 2D texture
+    /// lookups of shaders run by ShadingSystem::execute_batch come here
+    /// rather than to texture(), one point per call (since the points of
+    /// a batch are shaded one after another); otherwise they always go
+    /// to texture().
+    ///
+    /// Return true if every active point's lookup succeeded. Errors are
+    /// handled by texture(), once per failed point.
+    virtual bool texture_batch (ustring filename, TextureHandle *texture_handle,
+                                TexturePerthread *texture_thread_info,
+                                TextureOpt &options, ShaderGlobals *sg,
+                                int npoints, const bool *mask,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds, float *dresultdt,
+                                ustring *errormessage);
+
     /// Filtered 3D texture lookup for a single point.
     ///
     /// P is the volumetric texture coordinate; dPd{x,y,z} are the
@@ -339,6 +397,11 @@ public:
     /// but distances can be NULL.  If a derivs_offset > 0 is given,
     /// derivatives will be computed for distances (when provided).
     ///
+    /// The default implementations of the pointcloud methods handle
+    /// files ending in ".oslpc" (OSL's own memory-mapped format, searched
+    /// with a built-in KD-tree) without needing Partio, and hand any
+    /// other file to Partio if OSL was built with it.
+    ///
     /// Return the number of points found, always < max_points
     virtual int pointcloud_search (ShaderGlobals *sg,
                                    ustring filename, const OSL::Vec3 &center,
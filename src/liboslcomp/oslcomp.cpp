@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cerrno>
 
 #include "oslcomp_pvt.h"
+#include "osoreader.h"
 
 #include <OpenImageIO/platform.h>
 #include <OpenImageIO/sysutil.h>
@@ -130,7 +131,7 @@ OSLCompilerImpl::OSLCompilerImpl (ErrorHandler *errhandler)
       m_err(false), m_symtab(*this),
       m_current_typespec(TypeDesc::UNKNOWN), m_current_output(false),
       m_verbose(false), m_quiet(false), m_debug(false),
-      m_preprocess_only(false), m_err_on_warning(false),
+      m_preprocess_only(false), m_err_on_warning(false), m_binary_oso(false),
       m_optimizelevel(1),
       m_next_temp(0), m_next_const(0),
       m_osofile(NULL),
@@ -394,6 +395,7 @@ OSLCompilerImpl::read_compile_options (const std::vector<std::string> &options,
 {
     m_output_filename.clear ();
     m_preprocess_only = false;
+    m_binary_oso = false;
     for (size_t i = 0;  i < options.size();  ++i) {
         if (options[i] == "-v") {
             // verbose mode
@@ -417,6 +419,8 @@ OSLCompilerImpl::read_compile_options (const std::vector<std::string> &options,
             m_optimizelevel = 2;
         } else if (options[i] == "-Werror") {
             m_err_on_warning = true;
+        } else if (options[i] == "-binary") {
+            m_binary_oso = true;
         } else if (options[i].c_str()[0] == '-' && options[i].size() > 2) {
             // options meant for the preprocessor
             if (options[i].c_str()[1] == 'D' || options[i].c_str()[1] == 'U')
@@ -523,6 +527,10 @@ OSLCompilerImpl::compile (string_view filename,
 
     read_compile_options (options, defines, includepaths);
 
+    // Already-compiled shaders can only be converted to binary oso
+    if (OIIO::Strutil::ends_with (filename, ".oso"))
+        return convert_oso_file (filename);
+
     // Determine where the installed shader include directory is, and
     // look for ../shaders/stdosl.h and force it to include.
     if (stdoslpath.empty()) {
@@ -573,18 +581,32 @@ OSLCompilerImpl::compile (string_view filename,
             if (m_output_filename.size() == 0)
                 m_output_filename = default_output_filename ();
 
-            std::ofstream oso_output;
-            OIIO::Filesystem::open (oso_output, m_output_filename);
-            if (! oso_output.good()) {
-                error (ustring(), 0, "Could not open \"%s\"",
-                       m_output_filename);
-                return false;
-            }
-            ASSERT (m_osofile == NULL);
-            m_osofile = &oso_output;
+            if (m_binary_oso) {
+                // Write the text to memory, and save its binary form
+                std::ostringstream oso_output;
+                oso_output.imbue (std::locale::classic());  // force C locale
+                ASSERT (m_osofile == NULL);
+                m_osofile = &oso_output;
+                write_oso_file (m_output_filename, OIIO::Strutil::join(options," "));
+                ASSERT (m_osofile == NULL);
+                std::string binary;
+                if (! oso_to_binary (oso_output.str(), binary) ||
+                    ! write_output_file (binary))
+                    return false;
+            } else {
+                std::ofstream oso_output;
+                OIIO::Filesystem::open (oso_output, m_output_filename);
+                if (! oso_output.good()) {
+                    error (ustring(), 0, "Could not open \"%s\"",
+                           m_output_filename);
+                    return false;
+                }
+                ASSERT (m_osofile == NULL);
+                m_osofile = &oso_output;
 
-            write_oso_file (m_output_filename, OIIO::Strutil::join(options," "));
-            ASSERT (m_osofile == NULL);
+                write_oso_file (m_output_filename, OIIO::Strutil::join(options," "));
+                ASSERT (m_osofile == NULL);
+            }
         }
 
         oslcompiler = nullptr;
@@ -667,6 +689,11 @@ OSLCompilerImpl::compile_buffer (string_view sourcecode,
             write_oso_file (m_output_filename, OIIO::Strutil::join(options," "));
             osobuffer = oso_output.str();
             ASSERT (m_osofile == NULL);
+            if (m_binary_oso) {
+                std::string binary;
+                if (oso_to_binary (osobuffer, binary))
+                    osobuffer.swap (binary);
+            }
         }
 
         oslcompiler = nullptr;
@@ -677,6 +704,63 @@ OSLCompilerImpl::compile_buffer (string_view sourcecode,
 
 
 
+bool
+OSLCompilerImpl::oso_to_binary (const std::string &oso, std::string &binary)
+{
+    OSOBinaryWriter writer (m_errhandler);
+    if (! writer.convert (oso, binary)) {
+        error (ustring(), 0, "Could not convert \"%s\" to binary oso",
+               m_output_filename);
+        return false;
+    }
+    return true;
+}
+
+
+
+bool
+OSLCompilerImpl::write_output_file (const std::string &oso)
+{
+    std::ofstream file;
+    OIIO::Filesystem::open (file, m_output_filename,
+                            std::ios::out | std::ios::binary);
+    if (! file.good()) {
+        error (ustring(), 0, "Could not open \"%s\"", m_output_filename);
+        return false;
+    }
+    file.write (oso.data(), oso.size());
+    if (! file.good()) {
+        error (ustring(), 0, "Could not write \"%s\"", m_output_filename);
+        return false;
+    }
+    return true;
+}
+
+
+
+bool
+OSLCompilerImpl::convert_oso_file (string_view filename)
+{
+    if (! m_binary_oso) {
+        error (ustring(filename), 0,
+               "\"%s\" is already compiled (use -binary to convert it to binary oso)",
+               filename);
+        return false;
+    }
+    std::string oso;
+    if (! OIIO::Filesystem::read_text_file (filename, oso)) {
+        error (ustring(filename), 0, "Could not read \"%s\"", filename);
+        return false;
+    }
+    // Convert in place unless told otherwise
+    if (m_output_filename.empty())
+        m_output_filename = filename;
+    std::string binary;
+    return oso_to_binary (oso, binary) && write_output_file (binary);
+}
+
+
+
 struct GlobalTable {
     const char *name;
     TypeSpec type;
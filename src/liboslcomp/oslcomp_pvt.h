@@ -398,6 +398,12 @@ private:
     void initialize_builtin_funcs ();
     std::string default_output_filename ();
     void write_oso_file (const std::string &outfilename, string_view options);
+    /// Convert text oso to binary oso, reporting any errors.
+    bool oso_to_binary (const std::string &oso, std::string &binary);
+    /// Write the (text or binary) oso to m_output_filename.
+    bool write_output_file (const std::string &oso);
+    /// Convert an already-compiled .oso file to binary oso.
+    bool convert_oso_file (string_view filename);
     void write_oso_const_value (const ConstantSymbol *sym) const;
     void write_oso_symbol (const Symbol *sym);
     void write_oso_metadata (const ASTNode *metanode) const;
@@ -479,6 +485,7 @@ private:
     bool m_debug;             ///< Debug mode
     bool m_preprocess_only;   ///< Preprocess only?
     bool m_err_on_warning;    ///< Treat warnings as errors?
+    bool m_binary_oso;        ///< Write binary oso?
     int m_optimizelevel;      ///< Optimization level
     OpcodeVec m_ircode;       ///< Generated IR code
     SymbolPtrVec m_opargs;    ///< Arguments for all instructions
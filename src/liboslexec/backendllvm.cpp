@@ -90,7 +90,8 @@ BackendLLVM::BackendLLVM (ShadingSystemImpl &shadingsys,
       ll(llvm_debug()),
       m_stat_total_llvm_time(0), m_stat_llvm_setup_time(0),
       m_stat_llvm_irgen_time(0), m_stat_llvm_opt_time(0),
-      m_stat_llvm_jit_time(0)
+      m_stat_llvm_jit_time(0), m_groupdata_bytes_saved(0),
+      m_pgo_instrument(nullptr), m_pgo_feedback(nullptr)
 {
 #ifdef OSL_SPI
     // Temporary (I hope) check to diagnose an intermittent failure of
@@ -1188,5 +1189,83 @@ int BackendLLVM::find_userdata_index (const Symbol& sym)
 
 
 
+PGOProfile::BranchKey
+BackendLLVM::pgo_branch_key (int opnum) const
+{
+    const OpcodeVec &ops (inst()->ops());
+    const Opcode &op (ops[opnum]);
+    int same = 0;
+    for (int i = 0;  i < opnum;  ++i)
+        if (ops[i].opname() == op.opname() &&
+            ops[i].sourceline() == op.sourceline() &&
+            ops[i].sourcefile() == op.sourcefile())
+            ++same;
+    return PGOProfile::BranchKey (layer(), op.sourcefile(), op.sourceline(),
+                                  op.opname(), same);
+}
+
+
+
+void
+BackendLLVM::llvm_pgo_branch (int opnum, llvm::Value *cond,
+                              llvm::BasicBlock *trueblock,
+                              llvm::BasicBlock *falseblock)
+{
+    if (m_pgo_instrument) {
+        int c = m_pgo_instrument->branch_counter (pgo_branch_key (opnum));
+        ll.call_function ("osl_pgo_count", sg_void_ptr(), ll.constant (c));
+        ll.op_branch (cond, trueblock, falseblock);
+        // op_branch leaves us at the top of trueblock
+        ll.call_function ("osl_pgo_count", sg_void_ptr(), ll.constant (c+1));
+        return;
+    }
+    long long reached = 0, taken = 0;
+    if (m_pgo_feedback &&
+        m_pgo_feedback->branch_counts (pgo_branch_key (opnum), reached, taken) &&
+        reached > 0) {
+        // Branch weights are 32 bit; only their ratio matters.
+        long long nottaken = reached - taken;
+        while (taken >= 0x7fffffff || nottaken >= 0x7fffffff) {
+            taken /= 2;
+            nottaken /= 2;
+        }
+        ll.op_branch (cond, trueblock, falseblock,
+                      uint32_t(taken+1), uint32_t(nottaken+1));
+        return;
+    }
+    ll.op_branch (cond, trueblock, falseblock);
+}
+
+
+
+bool
+BackendLLVM::pgo_run_eagerly (int layer) const
+{
+    if (! m_pgo_feedback || m_pgo_feedback->shades <= 0 ||
+        m_pgo_feedback->layer_runs (layer) < m_pgo_feedback->shades)
+        return false;
+    // Every sampled shade ran it anyway, so we can save the "has it run
+    // yet" checks -- unless running it early could be observed, through
+    // any of its ops, including those that initialize its params.
+    for (const Opcode &op : group()[layer]->ops()) {
+        const OpDescriptor *opd = shadingsys().op_descriptor (op.opname());
+        if (! opd || (opd->flags & OpDescriptor::SideEffects))
+            return false;
+    }
+    return true;
+}
+
+
+
+bool
+BackendLLVM::pgo_cold_layer (int layer) const
+{
+    return m_pgo_feedback && m_pgo_feedback->shades > 0 &&
+           m_pgo_feedback->layer_runs (layer) == 0 &&
+           ! group().is_entry_layer(layer) && ! group().is_last_layer(layer);
+}
+
+
+
 }; // namespace pvt
 OSL_NAMESPACE_EXIT
@@ -449,6 +449,35 @@ public:
     /// entry in the groupdata struct.
     int find_userdata_index (const Symbol& sym);
 
+    /// Return the fixed message slot for a message name that is known at
+    /// JIT time, assigning the next unused one if it doesn't have one yet.
+    /// (See MessageList.)
+    int message_slot (ustring name) {
+        auto found = m_message_slots.find (name);
+        if (found != m_message_slots.end())
+            return found->second;
+        int slot = (int) m_message_slots.size();
+        m_message_slots[name] = slot;
+        return slot;
+    }
+
+    /// Emit the conditional branch for an 'if' or loop op, counting its
+    /// outcomes if this build is collecting a profile, or weighting it
+    /// by a previously collected profile (see the "pgo_samples" option).
+    void llvm_pgo_branch (int opnum, llvm::Value *cond,
+                          llvm::BasicBlock *trueblock,
+                          llvm::BasicBlock *falseblock);
+
+    /// How the profile identifies the current layer's branch op.
+    PGOProfile::BranchKey pgo_branch_key (int opnum) const;
+
+    /// Should the lazy layer be run unconditionally from the group entry,
+    /// because the profile says that every shade needed it anyway?
+    bool pgo_run_eagerly (int layer) const;
+
+    /// Did the profile find that the layer was never run at all?
+    bool pgo_cold_layer (int layer) const;
+
     LLVM_Util ll;
 
 private:
@@ -461,6 +490,11 @@ private:
     double m_stat_llvm_irgen_time;        ///<     llvm IR generation time
     double m_stat_llvm_opt_time;          ///<     llvm IR optimization time
     double m_stat_llvm_jit_time;          ///<     llvm JIT time
+    std::vector<double> m_stat_layer_irgen_time; ///< IR gen time per layer
+    std::vector<double> m_stat_layer_opt_time;   ///< Func pass time per layer
+    std::vector<double> m_stat_layer_jit_time;   ///< Layer's share of codegen
+    std::vector<size_t> m_stat_layer_instructions; ///< Post-opt IR size
+    int m_groupdata_bytes_saved;          ///< Saved by groupdata layout
 
     // LLVM stuff
     AllocationMap m_named_values;
@@ -483,7 +517,12 @@ private:
     // create variable names.
     std::map<std::string,std::string>           m_varname_map;
 
+    // Fixed message slots assigned to constant message names
+    std::unordered_map<ustring,int,ustringHash> m_message_slots;
+
     bool m_use_optix;                   ///< Compile for OptiX?
+    PGOProfile *m_pgo_instrument;       ///< Profile we're collecting
+    const PGOProfile *m_pgo_feedback;   ///< Profile guiding this build
 
     friend class ShadingSystemImpl;
 };
@@ -148,6 +148,9 @@ DECL (osl_error, "xXs*")
 DECL (osl_warning, "xXs*")
 DECL (osl_split, "isXsii")
 DECL (osl_incr_layers_executed, "xX")
+DECL (osl_profile_enter, "xX")
+DECL (osl_profile_exit, "xXii")
+DECL (osl_pgo_count, "xXi")
 
 NOISE_IMPL(cellnoise)
 //NOISE_DERIV_IMPL(cellnoise)
@@ -199,8 +202,8 @@ DECL (osl_splineinverse_fff, "xXXXXii")
 DECL (osl_splineinverse_dfdfdf, "xXXXXii")
 DECL (osl_splineinverse_dfdff, "xXXXXii")
 DECL (osl_splineinverse_dffdf, "xXXXXii")
-DECL (osl_setmessage, "xXsLXisi")
-DECL (osl_getmessage, "iXssLXiisi")
+DECL (osl_setmessage, "xXsLXisii")
+DECL (osl_getmessage, "iXssLXiisii")
 DECL (osl_pointcloud_search, "iXsXfiiXXii*")
 DECL (osl_pointcloud_get, "iXsXisLX")
 DECL (osl_pointcloud_write, "iXsXiXXX")
@@ -237,6 +240,7 @@ DECL (osl_uninit_check, "xLXXXiXiXXiXiXii")
 DECL (osl_get_attribute, "iXiXXiiXX")
 DECL (osl_bind_interpolated_param, "iXXLiXiXiXi")
 DECL (osl_get_texture_options, "XX");
+DECL (osl_init_texture_options, "XXX");
 DECL (osl_get_noise_options, "XX");
 DECL (osl_get_trace_options, "XX");
 
@@ -359,6 +363,7 @@ DECL (osl_stoi_is, "is")
 DECL (osl_stof_fs, "fs")
 DECL (osl_substr_ssii, "ssii")
 DECL (osl_regex_impl, "iXsXisi")
+DECL (osl_regex_compiled, "isXiXi")
 
 DECL (osl_texture_set_firstchannel, "xXi")
 DECL (osl_texture_set_swrap, "xXs")
@@ -147,4 +147,46 @@ print_closure (std::ostream &out, const ClosureColor *closure, ShadingSystemImpl
 
 
 
+static void
+flatten_closure (const ClosureColor *closure, Color3 w,
+                 std::vector<FlatClosure> &flat)
+{
+    // Only the first operand of an add recurses; muls and the second
+    // operand of an add just continue the loop.
+    while (closure) {
+        switch (closure->id) {
+        case ClosureColor::MUL:
+            w = closure->as_mul()->weight * w;
+            closure = closure->as_mul()->closure;
+            break;
+        case ClosureColor::ADD:
+            flatten_closure (closure->as_add()->closureA, w, flat);
+            closure = closure->as_add()->closureB;
+            break;
+        default: {
+            const ClosureComponent *comp = closure->as_comp();
+            Color3 weight = w * comp->w;
+            if (weight.x != 0.0f || weight.y != 0.0f || weight.z != 0.0f) {
+                FlatClosure f;
+                f.id = comp->id;
+                f.weight = weight;
+                f.comp = comp;
+                flat.push_back (f);
+            }
+            return;
+        }
+        }
+    }
+}
+
+
+
+void
+flatten_closure (const ClosureColor *closure, std::vector<FlatClosure> &flat)
+{
+    flatten_closure (closure, Color3(1, 1, 1), flat);
+}
+
+
+
 OSL_NAMESPACE_EXIT
@@ -54,6 +54,8 @@ static ustring u_nop    ("nop"),
                u_sqrt   ("sqrt"),
                u_inversesqrt ("inversesqrt"),
                u_if     ("if"),
+               u_getmatrix ("getmatrix"),
+               u_transformv ("transformv"),
                u_eq     ("eq"),
                u_return ("return");
 static ustring u_cell ("cell"), u_cellnoise ("cellnoise");
@@ -1472,8 +1474,13 @@ DECLFOLDER(constfold_regex_search)
         DASSERT (Subj.typespec().is_string() && Reg.typespec().is_string());
         const ustring &s (*(ustring *)Subj.data());
         const ustring &r (*(ustring *)Reg.data());
-        regex reg (r.string());
-        int result = regex_search (s.string(), reg);
+        const CompiledRegex *reg = rop.shadingsys().find_regex (r);
+        // A bad pattern was already reported by find_regex, just now,
+        // and is remembered as bad, so it won't be reported again when
+        // the op runs. Leave the op alone; it will fail the same way.
+        if (! reg)
+            return 0;
+        int result = reg->match (s.string(), NULL, 0, false);
         int cind = rop.add_constant (result);
         rop.turn_into_assign (op, cind, "const fold regex_search");
         return 1;
@@ -2099,8 +2106,91 @@ DECLFOLDER(constfold_matrix)
 
 
 
+// Do any of the ops in [begin,end) write to symbol symindex?
+static bool
+written_in_range (RuntimeOptimizer &rop, int symindex, int begin, int end)
+{
+    for (int j = begin; j < end; ++j) {
+        const Opcode &op (rop.inst()->ops()[j]);
+        for (int a = 0; a < op.nargs(); ++a)
+            if (op.argwrite(a) && rop.oparg(op,a) == symindex)
+                return true;
+    }
+    return false;
+}
+
+
+
+// Are the two string args (symbol indices) known to hold the same value?
+static bool
+same_string_arg (RuntimeOptimizer &rop, int a, int b)
+{
+    if (a == b)
+        return true;
+    const Symbol &A (*rop.inst()->symbol(a));
+    const Symbol &B (*rop.inst()->symbol(b));
+    return A.is_constant() && B.is_constant() &&
+           A.get_string() == B.get_string();
+}
+
+
+
+// If an earlier getmatrix in the same basic block fetched the same
+// transformation, and nothing since then has changed its space names or
+// results, turn R=getmatrix(from,to,M) into copies of those results.
+static int
+reuse_earlier_getmatrix (RuntimeOptimizer &rop, int opnum)
+{
+    Opcode &op (rop.inst()->ops()[opnum]);
+    int fromarg = rop.oparg (op, 1), toarg = rop.oparg (op, 2);
+    int bblock = rop.bblockid (opnum);
+    for (int j = opnum-1;  j >= 0 && rop.bblockid(j) == bblock;  --j) {
+        Opcode &prev (rop.inst()->ops()[j]);
+        if (prev.opname() != u_getmatrix ||
+            ! same_string_arg (rop, rop.oparg(prev,1), fromarg) ||
+            ! same_string_arg (rop, rop.oparg(prev,2), toarg))
+            continue;
+        int R1 = rop.oparg (prev, 0), M1 = rop.oparg (prev, 3);
+        int R2 = rop.oparg (op, 0), M2 = rop.oparg (op, 3);
+        if (written_in_range (rop, fromarg, j, opnum) ||
+            written_in_range (rop, toarg, j, opnum) ||
+            written_in_range (rop, R1, j+1, opnum) ||
+            written_in_range (rop, M1, j+1, opnum))
+            return 0;
+        if (M1 == M2 && R1 == R2) {
+            rop.turn_into_nop (op, "repeated getmatrix");
+            return 1;
+        }
+        if (M1 == M2) {
+            rop.turn_into_new_op (op, u_assign, R2, R1, -1,
+                                  "repeated getmatrix");
+            return 1;
+        }
+        rop.turn_into_new_op (op, u_assign, M2, M1, -1, "repeated getmatrix");
+        if (R1 != R2) {
+            std::vector<int> args_to_add;
+            args_to_add.push_back (R2);
+            args_to_add.push_back (R1);
+            rop.insert_code (opnum, u_assign, args_to_add,
+                             RuntimeOptimizer::RecomputeRWRanges,
+                             RuntimeOptimizer::GroupWithNext);
+            Opcode &newop (rop.inst()->ops()[opnum]);
+            newop.argwriteonly (0);
+            newop.argreadonly (1);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+
+
 DECLFOLDER(constfold_getmatrix)
 {
+    // Within a basic block, the same matrix needn't be fetched twice.
+    if (reuse_earlier_getmatrix (rop, opnum))
+        return 1;
+
     // Try to turn R=getmatrix(from,to,M) into R=1,M=const if it's an
     // identity transform or if the result is a non-time-varying matrix.
     Opcode &op (rop.inst()->ops()[opnum]);
@@ -2225,6 +2315,20 @@ DECLFOLDER(constfold_transformc)
                                   "transformc => constant");
             return 1;
         }
+        // If the renderer has vouched (opt_fold_ocio_matrix) that its OCIO
+        // conversions are matrix-only, one that fits a matrix becomes a
+        // matrix multiply rather than a per-shade processor call.
+        ColorSystem &cs (rop.shadingsys().colorsystem());
+        Matrix44 M;
+        if (rop.shadingsys().fold_ocio_matrix() &&
+            (! cs.is_builtin_space (from) || ! cs.is_builtin_space (to)) &&
+            rop.shadingsys().ocio_transform_matrix (From.get_string(),
+                                                    To.get_string(), M)) {
+            rop.turn_into_new_op (op, u_transformv, rop.oparg(op,0),
+                                  rop.add_constant(M), rop.oparg(op,3),
+                                  "transformc => matrix");
+            return 1;
+        }
     }
     return 0;
 }
@@ -2393,6 +2497,110 @@ DECLFOLDER(constfold_getattribute)
 
 
 
+DECLFOLDER(constfold_dict_find)
+{
+    // dict_find has two flavors:
+    //    dict_find (string dictionary, string query)
+    //    dict_find (int nodeID, string query)
+    Opcode &op (rop.inst()->ops()[opnum]);
+    Symbol &Source (*rop.opargsym (op, 1));
+    Symbol &Query (*rop.opargsym (op, 2));
+    bool by_name = Source.typespec().is_string();
+
+    // Record the dictionary, folded or not, as something the group needs.
+    if (by_name && Source.is_constant())
+        rop.m_dictionaries_needed.insert (*(ustring *)Source.data());
+
+    if (! rop.shadingsys().fold_dict() ||
+        ! Source.is_constant() || ! Query.is_constant())
+        return 0;
+
+    // The Dictionary is shared by the whole ShadingSystem and never
+    // forgets a node, so node IDs resolved now remain valid at run time.
+    // Errors aren't reported (or remembered) here, so that they're
+    // reported by the shader that hits them, just as without folding.
+    ustring query = *(ustring *)Query.data();
+    int result = by_name
+        ? rop.shadingcontext()->dict_find (*(ustring *)Source.data(), query, false)
+        : rop.shadingcontext()->dict_find (*(int *)Source.data(), query, false);
+    if (result < 0)
+        return 0;   // Unreadable dictionary or bad query -- leave it
+    rop.turn_into_assign (op, rop.add_constant (result),
+                          "const fold dict_find");
+    return 1;
+}
+
+
+
+DECLFOLDER(constfold_dict_next)
+{
+    Opcode &op (rop.inst()->ops()[opnum]);
+    Symbol &NodeID (*rop.opargsym (op, 1));
+    if (! rop.shadingsys().fold_dict() || ! NodeID.is_constant())
+        return 0;
+    int result = rop.shadingcontext()->dict_next (*(int *)NodeID.data());
+    rop.turn_into_assign (op, rop.add_constant (result),
+                          "const fold dict_next");
+    return 1;
+}
+
+
+
+DECLFOLDER(constfold_dict_value)
+{
+    Opcode &op (rop.inst()->ops()[opnum]);
+    Symbol &NodeID (*rop.opargsym (op, 1));
+    Symbol &Name (*rop.opargsym (op, 2));
+    Symbol &Data (*rop.opargsym (op, 3));
+    ASSERT (NodeID.typespec().is_int() && Name.typespec().is_string());
+
+    if (! rop.shadingsys().fold_dict() ||
+        ! NodeID.is_constant() || ! Name.is_constant() ||
+        Data.typespec().is_array() /* N.B. we punt on arrays */)
+        return 0;
+
+    TypeDesc t = Data.typespec().simpletype();
+    void *mydata = alloca (t.size ());
+    int result = rop.shadingcontext()->dict_value (*(int *)NodeID.data(),
+                                                   *(ustring *)Name.data(),
+                                                   t, mydata);
+    // Now we turn
+    //       dict_value result nodeID name data
+    // into this for success:
+    //       assign result 1
+    //       assign data [retrieved values]
+    // but on failure, the data must be left untouched, so only the
+    // result is assigned.
+    if (! result) {
+        rop.turn_into_assign_zero (op, "const fold dict_value (not found)");
+        return 1;
+    }
+    int oldresultarg = rop.inst()->args()[op.firstarg()+0];
+    int dataarg = rop.inst()->args()[op.firstarg()+3];
+    // Make data the first argument
+    rop.inst()->args()[op.firstarg()+0] = dataarg;
+    // Now turn it into an assignment
+    int cind = rop.add_constant (Data.typespec(), mydata);
+    rop.turn_into_assign (op, cind, "const fold dict_value");
+
+    // Now insert a new instruction that assigns 1 to the
+    // original return result of dict_value.
+    int one = 1;
+    std::vector<int> args_to_add;
+    args_to_add.push_back (oldresultarg);
+    args_to_add.push_back (rop.add_constant (TypeDesc::TypeInt, &one));
+    rop.insert_code (opnum, u_assign, args_to_add,
+                     RuntimeOptimizer::RecomputeRWRanges,
+                     RuntimeOptimizer::GroupWithNext);
+    Opcode &newop (rop.inst()->ops()[opnum]);
+    newop.argwriteonly (0);
+    newop.argread (1, true);
+    newop.argwrite (1, false);
+    return 1;
+}
+
+
+
 DECLFOLDER(constfold_gettextureinfo)
 {
     Opcode &op (rop.inst()->ops()[opnum]);
@@ -29,6 +29,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include <cstdio>
+#include <cstring>
 
 #include <OpenImageIO/dassert.h>
 #include <OpenImageIO/sysutil.h>
@@ -46,11 +47,14 @@ static mutex buffered_errors_mutex;
 ShadingContext::ShadingContext (ShadingSystemImpl &shadingsys,
                                 PerThreadInfo *threadinfo)
     : m_shadingsys(shadingsys), m_renderer(m_shadingsys.renderer()),
-      m_group(NULL), m_max_warnings(shadingsys.max_warnings_per_thread()), m_dictionary(NULL), m_next_failed_attrib(0)
+      m_group(NULL), m_max_warnings(shadingsys.max_warnings_per_thread()), m_next_failed_attrib(0),
+      m_attrib_cache_epoch(shadingsys.m_attrib_cache_epoch),
+      m_matrix_cache_size(0), m_next_matrix_cache(0), m_msgbuf_used(0)
 {
     m_shadingsys.m_stat_contexts += 1;
     m_threadinfo = threadinfo ? threadinfo : shadingsys.get_perthread_info ();
     m_texture_thread_info = NULL;
+    m_renderer_texture_batch = m_renderer->supports ("texture_batch");
 }
 
 
@@ -58,8 +62,9 @@ ShadingContext::ShadingContext (ShadingSystemImpl &shadingsys,
 ShadingContext::~ShadingContext ()
 {
     process_errors ();
+    merge_profile ();
+    merge_pgo ();
     m_shadingsys.m_stat_contexts -= 1;
-    free_dict_resources ();
 }
 
 
@@ -70,12 +75,25 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
     if (m_group)
         execute_cleanup ();
     m_group = &sgroup;
+    m_group_pin.reset ();   // A superseded copy we ran may go away now
     m_ticks = 0;
+    m_profile_stack.clear ();
+    m_closure_results.clear ();
+    m_closure_globals = NULL;
+    m_deferred = false;
 
     // Optimize if we haven't already
     if (sgroup.nlayers()) {
         sgroup.start_running ();
         if (! sgroup.optimized()) {
+            if (shadingsys().m_async_jit) {
+                // Don't stall this thread (and every other thread that
+                // hits the same group) while it compiles: hand the group
+                // to the background JIT and tell the caller to defer.
+                shadingsys().optimize_group_async (sgroup);
+                m_deferred = true;
+                return false;
+            }
             auto ctx = shadingsys().get_context(thread_info());
             shadingsys().optimize_group (sgroup, ctx);
             if (shadingsys().m_greedyjit && shadingsys().m_groups_to_compile_count) {
@@ -84,7 +102,23 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
             }
             shadingsys().release_context(ctx);
         }
-        if (sgroup.does_nothing())
+        // Pairs with the release fence in optimize_group, in case it was
+        // compiled by another thread.
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (sgroup.m_pgo)
+            pgo_sample (sgroup);
+        if (sgroup.has_interactive_params() ||
+                (sgroup.m_pgo && sgroup.m_pgo->done)) {
+            // Run the fully specialized (or profile-guided) copy, if the
+            // edits have settled long enough, or enough shades have been
+            // profiled, for one to have been built.
+            // We hold on to it (until our next execution, so that its
+            // symbols can still be retrieved after this one) in case a
+            // newer copy supersedes it meanwhile.
+            if ((m_group_pin = shadingsys().specialized_group (sgroup)))
+                m_group = m_group_pin.get();
+        }
+        if (group()->does_nothing())
             return false;
     } else {
        // empty shader - nothing to do!
@@ -95,7 +129,7 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
     OIIO::Timer timer (profile ? OIIO::Timer::StartNow : OIIO::Timer::DontStartNow);
 
     // Allocate enough space on the heap
-    size_t heap_size_needed = sgroup.llvm_groupdata_size();
+    size_t heap_size_needed = group()->llvm_groupdata_size();
     if (heap_size_needed > m_heap.size()) {
         if (shadingsys().debug())
             info ("  ShadingContext %p growing heap to %llu",
@@ -108,6 +142,9 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
 
     // Set up closure storage
     m_closure_pool.clear();
+    // Only remember where the result will be; it's flattened on request.
+    if (group()->flat_closures())
+        m_closure_globals = &ssg;
 
     // Clear the message blackboard
     m_messages.clear ();
@@ -115,6 +152,9 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
     // Clear miscellaneous scratch space
     m_scratch_pool.clear ();
 
+    // Matrices may differ from shade to shade
+    clear_matrix_cache ();
+
     // Zero out stats for this execution
     clear_runtime_stats ();
 
@@ -122,9 +162,9 @@ ShadingContext::execute_init (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
         ssg.context = this;
         ssg.renderer = renderer();
         ssg.Ci = NULL;
-        RunLLVMGroupFunc run_func = sgroup.llvm_compiled_init();
+        RunLLVMGroupFunc run_func = group()->llvm_compiled_init();
         DASSERT (run_func);
-        DASSERT (sgroup.llvm_groupdata_size() <= m_heap.size());
+        DASSERT (group()->llvm_groupdata_size() <= m_heap.size());
         run_func (&ssg, &m_heap[0]);
     }
 
@@ -169,6 +209,12 @@ ShadingContext::execute_cleanup ()
     // Process any queued up error messages, warnings, printfs from shaders
     process_errors ();
 
+    // Whichever layers were run, Ci now holds the final closure result.
+    if (m_closure_globals) {
+        m_closure_results.push_back (m_closure_globals->Ci);
+        m_closure_globals = NULL;
+    }
+
     if (shadingsys().m_profile) {
         record_runtime_stats ();   // Transfer runtime stats to the shadingsys
         shadingsys().m_stat_total_shading_time_ticks += m_ticks;
@@ -217,11 +263,108 @@ ShadingContext::execute (ShaderGroup &sgroup, ShaderGlobals &ssg, bool run)
 
 
 
+bool
+ShadingContext::execute_batch (ShaderGroup &sgroup, int npoints,
+                               ShaderGlobals *globals, const bool *mask)
+{
+    if (npoints < 1)
+        return false;
+    DASSERT (globals);
+
+    // Do the binding, optimization and heap setup just once, for the
+    // first point, without running anything yet.
+    if (! execute_init (sgroup, globals[0], false))
+        return false;
+
+    int profile = shadingsys().m_profile;
+    OIIO::Timer timer (OIIO::Timer::DontStartNow);
+
+    // execute_init may have swapped in a specialized copy of sgroup.
+    ShaderGroup &g (*group());
+    RunLLVMGroupFunc init_func = g.llvm_compiled_init();
+    int entry = g.nlayers()-1;
+    DASSERT (init_func);
+    DASSERT (g.llvm_groupdata_size() <= m_heap.size());
+    size_t heap_size_needed = g.llvm_groupdata_size();
+    bool clearmemory = shadingsys().m_clearmemory;
+    bool flat_closures = g.flat_closures();
+    bool first = true;   // execute_init already sampled the first point
+    m_closure_globals = NULL;   // every point is recorded here instead
+    m_in_batch = true;          // texture lookups may go to texture_batch
+
+    for (int i = 0;  i < npoints;  ++i) {
+        if (mask && ! mask[i]) {
+            if (flat_closures)
+                m_closure_results.push_back (NULL);  // keep points lined up
+            continue;
+        }
+        // Each point counts as a shade of the profile-guided group, just
+        // as it would with execute().
+        if (sgroup.m_pgo && ! first)
+            pgo_sample (sgroup);
+        first = false;
+        ShaderGlobals &ssg (globals[i]);
+        ssg.context = this;
+        ssg.renderer = renderer();
+        ssg.Ci = NULL;
+        // Closures of all the points must survive until the end of the
+        // batch, so only the per-point scratch state is reset here.
+        m_messages.clear ();
+        m_scratch_pool.clear ();
+        clear_matrix_cache ();
+        if (profile)
+            timer.start ();
+        if (clearmemory)
+            memset (&m_heap[0], 0, heap_size_needed);
+        init_func (&ssg, &m_heap[0]);
+        if (profile)
+            timer.stop ();
+        // The same layer entry (and its timing) as execute() uses.
+        execute_layer (ssg, entry);
+        if (flat_closures)
+            m_closure_results.push_back (ssg.Ci);
+    }
+
+    m_in_batch = false;
+    if (profile)
+        m_ticks += timer.ticks();
+
+    return execute_cleanup ();
+}
+
+
+
+char *
+ShadingContext::append_msg (ErrorHandler::ErrCode code, size_t length) const
+{
+    size_t needed = sizeof(BufferedMsg) + length;
+    if (needed > MSGBUF_SIZE)
+        return NULL;
+    if (m_msgbuf_used + needed > MSGBUF_SIZE)
+        process_errors ();
+    if (! m_msgbuf)
+        m_msgbuf.reset (new char[MSGBUF_SIZE]);
+    BufferedMsg header { code, length };
+    memcpy (&m_msgbuf[m_msgbuf_used], &header, sizeof(header));
+    char *text = &m_msgbuf[m_msgbuf_used + sizeof(header)];
+    m_msgbuf_used += needed;
+    return text;
+}
+
+
+
 void
 ShadingContext::record_error (ErrorHandler::ErrCode code,
                               const std::string &text) const
 {
-    m_buffered_errors.emplace_back(code,text);
+    if (char *dst = append_msg (code, text.size())) {
+        memcpy (dst, text.data(), text.size());
+    } else {
+        // Too big to ever buffer, so keep the order and pass it on now
+        process_errors ();
+        lock_guard lock (buffered_errors_mutex);
+        emit_msg (code, text);
+    }
     // If we aren't buffering, just process immediately
     if (! shadingsys().m_buffer_printf)
         process_errors ();
@@ -229,11 +372,78 @@ ShadingContext::record_error (ErrorHandler::ErrCode code,
 
 
 
+void
+ShadingContext::record_vformat (ErrorHandler::ErrCode code,
+                                const char *format, va_list args) const
+{
+    // Format straight into the free space of the buffer.  Only if it
+    // doesn't fit there do we flush and format it again.
+    if (! m_msgbuf)
+        m_msgbuf.reset (new char[MSGBUF_SIZE]);
+    for (int attempt = 0;  attempt < 2;  ++attempt) {
+        if (m_msgbuf_used + sizeof(BufferedMsg) >= MSGBUF_SIZE)
+            process_errors ();
+        size_t start = m_msgbuf_used + sizeof(BufferedMsg);
+        size_t avail = MSGBUF_SIZE - start;
+        va_list ap;
+        va_copy (ap, args);
+        int len = vsnprintf (&m_msgbuf[start], avail, format, ap);
+        va_end (ap);
+        if (len < 0)
+            return;
+        if (size_t(len) < avail) {
+            BufferedMsg header { code, size_t(len) };
+            memcpy (&m_msgbuf[m_msgbuf_used], &header, sizeof(header));
+            m_msgbuf_used = start + size_t(len);
+            // If we aren't buffering, just process immediately
+            if (! shadingsys().m_buffer_printf)
+                process_errors ();
+            return;
+        }
+        if (! m_msgbuf_used)
+            break;   // Won't fit even in an empty buffer
+        process_errors ();
+    }
+    // Bigger than the whole buffer, so take the slow road
+    va_list ap;
+    va_copy (ap, args);
+    std::string s = Strutil::vformat (format, ap);
+    va_end (ap);
+    record_error (code, s);
+}
+
+
+
+void
+ShadingContext::emit_msg (ErrorHandler::ErrCode code,
+                          const std::string &text) const
+{
+    switch (code) {
+    case ErrorHandler::EH_MESSAGE :
+    case ErrorHandler::EH_DEBUG :
+        shadingsys().message (text);
+        break;
+    case ErrorHandler::EH_INFO :
+        shadingsys().info (text);
+        break;
+    case ErrorHandler::EH_WARNING :
+        shadingsys().warning (text);
+        break;
+    case ErrorHandler::EH_ERROR :
+    case ErrorHandler::EH_SEVERE :
+        shadingsys().error (text);
+        break;
+    default:
+        break;
+    }
+}
+
+
+
 void
 ShadingContext::process_errors () const
 {
-    size_t nerrors = m_buffered_errors.size();
-    if (! nerrors)
+    if (! m_msgbuf_used)
         return;
 
     // Use a mutex to make sure output from different threads stays
@@ -241,27 +451,53 @@ ShadingContext::process_errors () const
     // interleaved with other threads.
     lock_guard lock (buffered_errors_mutex);
 
-    for (size_t i = 0;  i < nerrors;  ++i) {
-        switch (m_buffered_errors[i].first) {
-        case ErrorHandler::EH_MESSAGE :
-        case ErrorHandler::EH_DEBUG :
-           shadingsys().message (m_buffered_errors[i].second);
-            break;
-        case ErrorHandler::EH_INFO :
-            shadingsys().info (m_buffered_errors[i].second);
-            break;
-        case ErrorHandler::EH_WARNING :
-            shadingsys().warning (m_buffered_errors[i].second);
-            break;
-        case ErrorHandler::EH_ERROR :
-        case ErrorHandler::EH_SEVERE :
-            shadingsys().error (m_buffered_errors[i].second);
-            break;
-        default:
-            break;
-        }
+    for (size_t pos = 0;  pos < m_msgbuf_used;  ) {
+        BufferedMsg header;
+        memcpy (&header, &m_msgbuf[pos], sizeof(header));
+        pos += sizeof(header);
+        m_msg_scratch.assign (&m_msgbuf[pos], header.length);
+        pos += header.length;
+        emit_msg (header.code, m_msg_scratch);
     }
-    m_buffered_errors.clear();
+    m_msgbuf_used = 0;
+}
+
+
+
+int
+ShadingContext::flat_closures (int point, const FlatClosure* &closures) const
+{
+    closures = NULL;
+    if (point < 0 || point >= (int)m_closure_results.size())
+        return 0;
+    m_flat_closures.clear ();
+    flatten_closure (m_closure_results[point], m_flat_closures);
+    if (m_flat_closures.size())
+        closures = &m_flat_closures[0];
+    return (int)m_flat_closures.size();
+}
+
+
+
+const ClosureColor *
+ShadingContext::closure_tree (const FlatClosure *closures, int n)
+{
+    // The component keeps its own weight, so a mul above it supplies the
+    // rest of the total. Build from the back, so that the adds hold the
+    // components in their original order.
+    const ClosureColor *tree = NULL;
+    for (int i = n-1;  i >= 0;  --i) {
+        const FlatClosure &f (closures[i]);
+        const Color3 &cw (f.comp->w);
+        Color3 w (cw.x != 0.0f ? f.weight.x / cw.x : 0.0f,
+                  cw.y != 0.0f ? f.weight.y / cw.y : 0.0f,
+                  cw.z != 0.0f ? f.weight.z / cw.z : 0.0f);
+        const ClosureColor *c = f.comp;
+        if (w != Color3(1.0f, 1.0f, 1.0f))
+            c = closure_mul_allot (w, c);
+        tree = tree ? closure_add_allot (c, tree) : c;
+    }
+    return tree;
 }
 
 
@@ -275,12 +511,19 @@ ShadingContext::symbol (ustring layername, ustring symbolname) const
 
 
 const void *
-ShadingContext::symbol_data (const Symbol &sym) const
+ShadingContext::symbol_data (const Symbol &handle) const
 {
     const ShaderGroup &sgroup (*group());
     if (! sgroup.optimized())
         return NULL;   // can't retrieve symbol if we didn't optimize it
 
+    // A handle found on the original group of a specialized copy we're
+    // running stands for the copy's own symbol, wherever that lives.
+    const Symbol *copysym = sgroup.symbol_in_copy (&handle);
+    if (! copysym)
+        return NULL;   // optimized away in the copy
+    const Symbol &sym (*copysym);
+
     if (sym.dataoffset() >= 0 && (int)m_heap.size() > sym.dataoffset()) {
         // lives on the heap
         return &m_heap[sym.dataoffset()];
@@ -298,17 +541,16 @@ ShadingContext::symbol_data (const Symbol &sym) const
 
 
 
-const regex &
+const CompiledRegex *
 ShadingContext::find_regex (ustring r)
 {
     RegexMap::const_iterator found = m_regex_map.find (r);
     if (found != m_regex_map.end())
-        return *found->second;
-    // otherwise, it wasn't found, add it
-    m_regex_map[r].reset (new regex(r.c_str()));
-    m_shadingsys.m_stat_regexes += 1;
-    // std::cerr << "Made new regex for " << r << "\n";
-    return *m_regex_map[r];
+        return found->second;
+    // otherwise, get it from (or add it to) the shared cache
+    const CompiledRegex *re = shadingsys().find_regex (r);
+    m_regex_map[r] = re;
+    return re;
 }
 
 
@@ -341,6 +583,35 @@ ShadingContext::osl_get_attribute (ShaderGlobals *sg, void *objdata,
         }
     }
 
+    // Next, look for the value among those that the renderer told us
+    // are constant for the object. A named object doesn't depend on
+    // objdata, otherwise we need objdata to know which object it is.
+    bool cacheable = (objdata || ! obj_name.empty());
+    AttribCacheKey key;
+    key.objdata = obj_name.empty() ? objdata : NULL;
+    key.obj_name = obj_name;
+    key.attr_name = attr_name;
+    key.attr_type = attr_type;
+    key.array_lookup = array_lookup;
+    key.index = index;
+    key.derivs = dest_derivs;
+    size_t size = attr_type.size() * (dest_derivs ? 3 : 1);
+    int epoch = shadingsys().m_attrib_cache_epoch;
+    if (epoch != m_attrib_cache_epoch) {
+        // The renderer invalidated the constants since we cached them.
+        m_attrib_cache.clear ();
+        m_attrib_cache_epoch = epoch;
+    }
+    if (cacheable && ! m_attrib_cache.empty()) {
+        auto found = m_attrib_cache.find (key);
+        if (found != m_attrib_cache.end()) {
+            memcpy (attr_dest, found->second.data(), size);
+            ++m_stat_attrib_cache_hits;
+            return true;
+        }
+    }
+
+    ++m_stat_attrib_cache_misses;
     if (array_lookup)
         ok = renderer()->get_array_attribute (sg, dest_derivs,
                                               obj_name, attr_type,
@@ -349,6 +620,13 @@ ShadingContext::osl_get_attribute (ShaderGlobals *sg, void *objdata,
         ok = renderer()->get_attribute (sg, dest_derivs,
                                         obj_name, attr_type,
                                         attr_name, attr_dest);
+    if (ok && cacheable &&
+          renderer()->attribute_is_constant (sg, obj_name, attr_name)) {
+        if (m_attrib_cache.size() >= MAX_CACHED_ATTRIBS)
+            m_attrib_cache.clear ();   // Crude, but keeps it bounded
+        const char *val = (const char *) attr_dest;
+        m_attrib_cache[key].assign (val, val + size);
+    }
     if (!ok) {
         int i = m_next_failed_attrib;
         m_failed_attribs[i].objdata = objdata;
@@ -373,6 +651,153 @@ ShadingContext::osl_get_attribute (ShaderGlobals *sg, void *objdata,
 
 
 
+bool
+ShadingContext::get_matrix (ShaderGlobals *sg, Matrix44 &M, ustring name,
+                            bool inverse)
+{
+    TransformationPtr xform = NULL;
+    if (name == Strings::shader)
+        xform = sg->shader2common;
+    else if (name == Strings::object)
+        xform = sg->object2common;
+
+    for (int i = 0; i < m_matrix_cache_size; ++i) {
+        const MatrixCacheEntry &e (m_matrix_cache[i]);
+        if (e.name == name && e.inverse == inverse && e.xform == xform &&
+              e.time == sg->time) {
+            M = e.M;
+            ++m_stat_matrix_cache_hits;
+            return e.ok;
+        }
+    }
+    if (! xform && ! m_constant_matrices[inverse].empty()) {
+        auto found = m_constant_matrices[inverse].find (name);
+        if (found != m_constant_matrices[inverse].end()) {
+            M = found->second;
+            ++m_stat_matrix_cache_hits;
+            return true;
+        }
+    }
+
+    ++m_stat_matrix_cache_misses;
+    bool ok;
+    if (xform)
+        ok = inverse ? renderer()->get_inverse_matrix (sg, M, xform, sg->time)
+                     : renderer()->get_matrix (sg, M, xform, sg->time);
+    else
+        ok = inverse ? renderer()->get_inverse_matrix (sg, M, name, sg->time)
+                     : renderer()->get_matrix (sg, M, name, sg->time);
+
+    if (ok && ! xform && renderer()->matrix_is_constant (sg, name)) {
+        if (m_constant_matrices[inverse].size() >= MAX_CONSTANT_MATRICES)
+            m_constant_matrices[inverse].clear ();   // Crude, but keeps it bounded
+        m_constant_matrices[inverse][name] = M;
+        return ok;
+    }
+    // Remember it for the rest of the shade, replacing the oldest entry
+    // once the cache is full.
+    int i = m_next_matrix_cache;
+    m_next_matrix_cache = (i == MATRIX_CACHE_SIZE-1) ? 0 : (i+1);
+    m_matrix_cache_size = std::max (m_matrix_cache_size, i+1);
+    MatrixCacheEntry &e (m_matrix_cache[i]);
+    e.name = name;
+    e.xform = xform;
+    e.time = sg->time;
+    e.inverse = inverse;
+    e.ok = ok;
+    e.M = M;
+    return ok;
+}
+
+
+
+void
+ShadingContext::profile_enter ()
+{
+    m_profile_stack.emplace_back (OIIO::Timer::now(), 0LL);
+}
+
+
+
+void
+ShadingContext::profile_exit (int slot, bool layer)
+{
+    DASSERT (m_profile_stack.size());
+    long long elapsed = OIIO::Timer::now() - m_profile_stack.back().first;
+    long long nested = m_profile_stack.back().second;
+    m_profile_stack.pop_back ();
+    if (slot >= (int)m_profile_ticks.size()) {
+        m_profile_ticks.resize (slot+1, 0);
+        m_profile_calls.resize (slot+1, 0);
+    }
+    m_profile_ticks[slot] += elapsed - nested;
+    m_profile_calls[slot] += 1;
+    // A layer's whole time is excluded from its caller's self time, but
+    // an op's self time counts as part of the layer that contains it.
+    if (m_profile_stack.size())
+        m_profile_stack.back().second += layer ? elapsed : nested;
+}
+
+
+
+void
+ShadingContext::merge_profile ()
+{
+    if (m_profile_calls.empty())
+        return;
+    {
+        lock_guard lock (shadingsys().m_profile_mutex);
+        auto &slots (shadingsys().m_profile_slots);
+        for (size_t i = 0, e = m_profile_calls.size();  i < e;  ++i) {
+            slots[i].ticks += m_profile_ticks[i];
+            slots[i].calls += m_profile_calls[i];
+        }
+    }
+    m_profile_ticks.clear ();
+    m_profile_calls.clear ();
+}
+
+
+
+void
+ShadingContext::pgo_sample (ShaderGroup &group)
+{
+    if (m_pgo != group.m_pgo) {
+        merge_pgo ();
+        m_pgo = group.m_pgo;
+        m_pgo_counts.assign (m_pgo->counts.size(), 0);
+    }
+    if (m_pgo->done)
+        return;   // Already rebuilt (or given up on), stop counting
+    // Merge every so often, so that the total can trigger the rebuild.
+    // This precedes counting the shade about to run, so that the merged
+    // counts are always those of whole shades.
+    int samples = std::max (shadingsys().pgo_samples(), 1);
+    if (m_pgo_shades >= std::min (samples, 64) && merge_pgo () >= samples)
+        shadingsys().respecialize_group_async (group);
+    ++m_pgo_shades;
+}
+
+
+
+long long
+ShadingContext::merge_pgo ()
+{
+    if (! m_pgo)
+        return 0;
+    for (size_t i = 0, e = m_pgo_counts.size();  i < e;  ++i) {
+        if (m_pgo_counts[i]) {
+            m_pgo->counts[i].fetch_add (m_pgo_counts[i], std::memory_order_relaxed);
+            m_pgo_counts[i] = 0;
+        }
+    }
+    long long shades = (m_pgo->shades += m_pgo_shades);
+    m_pgo_shades = 0;
+    return shades;
+}
+
+
+
 OSL_SHADEOP void
 osl_incr_layers_executed (ShaderGlobals *sg)
 {
@@ -381,4 +806,32 @@ osl_incr_layers_executed (ShaderGlobals *sg)
 }
 
 
+
+OSL_SHADEOP void
+osl_profile_enter (ShaderGlobals *sg)
+{
+    ShadingContext *ctx = (ShadingContext *)sg->context;
+    ctx->profile_enter ();
+}
+
+
+
+OSL_SHADEOP void
+osl_profile_exit (ShaderGlobals *sg, int slot, int layer)
+{
+    ShadingContext *ctx = (ShadingContext *)sg->context;
+    ctx->profile_exit (slot, layer);
+}
+
+
+
+// Bump one of a group's PGOProfile counters (see the "pgo_samples" option).
+OSL_SHADEOP void
+osl_pgo_count (ShaderGlobals *sg, int counter)
+{
+    ShadingContext *ctx = (ShadingContext *)sg->context;
+    ctx->pgo_count (counter);
+}
+
+
 OSL_NAMESPACE_EXIT
@@ -31,9 +31,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cstdio>
 #include <cstdlib>
 #include <cctype>
+#include <ctime>
 #include <unordered_map>
 
 #include <OpenImageIO/dassert.h>
+#include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/strutil.h>
 
 #include <pugixml.hpp>
@@ -69,9 +71,25 @@ namespace pvt {   // OSL::pvt
 // particular query to return a string is a totally different cache
 // entry than asking for it to be converted to a matrix, say.
 //
+// There is one Dictionary per ShadingSystem, shared by all the shading
+// contexts (and therefore all threads), so each document is parsed only
+// once and each query is resolved only once.  Documents, nodes, and
+// decoded values are only ever appended, never modified, so node IDs and
+// value offsets stay valid for the life of the ShadingSystem.  Cache hits
+// only need a read lock.  Misses are serialized by m_miss_mutex, and the
+// expensive work (parsing the XML, running the XPath query) happens
+// without blocking readers; the write lock is held only long enough to
+// publish the results.
+//
+// XML files are read once and then kept, even if they change on disk,
+// until invalidate() is called.  That re-reads (at next use) only the
+// files whose modification time changed, as new documents; the nodes of
+// the old contents stay valid, so a shader that's in the middle of
+// walking them isn't disturbed.
+//
 class Dictionary {
 public:
-    Dictionary (ShadingContext *ctx) : m_context(ctx)
+    Dictionary ()
     {
         // Create placeholder element 0 == 'not found'
         m_nodes.emplace_back(0, pugi::xml_node());
@@ -82,11 +100,17 @@ public:
             delete doc;
     }
 
-    int dict_find (ustring dictionaryname, ustring query);
-    int dict_find (int nodeID, ustring query);
+    // A NULL ctx means not to report errors (nor remember failures),
+    // just return -1, as the runtime optimizer wants.
+    int dict_find (ShadingContext *ctx, ustring dictionaryname, ustring query);
+    int dict_find (ShadingContext *ctx, int nodeID, ustring query);
     int dict_next (int nodeID);
     int dict_value (int nodeID, ustring attribname, TypeDesc type, void *data);
 
+    // Forget the XML files that have changed on disk since they were
+    // read, so that the next dict_find of each reads it again.
+    void invalidate ();
+
 private:
     // We cache individual queries with a key that is a tuple of the
     // (nodeID, query_string, type_requested).
@@ -136,14 +160,15 @@ private:
     typedef std::unordered_map <Query, QueryResult, QueryHash> QueryMap;
     typedef std::unordered_map<ustring, int, ustringHash> DocMap;
 
-    ShadingContext *m_context;  // back-pointer to shading context
-
     // List of XML documents we've read in.
     std::vector<pugi::xml_document *> m_documents;
 
     // Map xml strings and/or filename to indices in m_documents.
     DocMap m_document_map;
 
+    // Modification time of each xml file when we read it (or tried to).
+    std::unordered_map<ustring, std::time_t, ustringHash> m_file_mtimes;
+
     // Cache of fully resolved queries.
     Dictionary::QueryMap m_cache;  // query cache
 
@@ -156,76 +181,94 @@ private:
     std::vector<int>     m_intdata;
     std::vector<ustring> m_stringdata;
 
+    // Readers hold m_rwmutex for read; anybody changing the containers
+    // above must hold both m_miss_mutex and m_rwmutex for write.  Holding
+    // m_miss_mutex alone is enough to read them safely.
+    OIIO::spin_rw_mutex m_rwmutex;
+    mutex m_miss_mutex;
+
     // Helper function: return the document index given dictionary name.
-    int get_document_index (ustring dictionaryname);
+    // Caller must hold m_miss_mutex.
+    int get_document_index (ShadingContext *ctx, ustring dictionaryname);
+
+    // Helper function: run the query (relative to the given node, or to
+    // the whole document if nodeID is 0) and record its matches.
+    // Caller must hold m_miss_mutex.
+    int find_and_cache (ShadingContext *ctx, const Query &q,
+                        const pugi::xpath_node &root);
+
+    // Helper function: copy a cached value out to data.
+    // Caller must hold m_rwmutex for read, or m_miss_mutex.
+    int copy_value (const QueryResult &r, TypeDesc type, void *data) const;
 };
 
 
 
 int
-Dictionary::get_document_index (ustring dictionaryname)
+Dictionary::get_document_index (ShadingContext *ctx, ustring dictionaryname)
 {
     DocMap::iterator dm = m_document_map.find(dictionaryname);
-    int dindex;
-    if (dm == m_document_map.end()) {
-        dindex = m_documents.size();
-        m_document_map[dictionaryname] = dindex;
-        pugi::xml_document *doc = new pugi::xml_document;
-        m_documents.push_back (doc);
-        pugi::xml_parse_result parse_result;
-        if (Strutil::ends_with (dictionaryname.string(), ".xml")) {
-            // xml file -- read it
-            parse_result = doc->load_file (dictionaryname.c_str());
-        } else {
-            // load xml directly from the string
-            parse_result = doc->load_buffer (dictionaryname.c_str(),
-                                             dictionaryname.length());
-        }
-        if (! parse_result) {
-            m_context->error ("XML parsed with errors: %s, at offset %d",
-                              parse_result.description(),
-                              parse_result.offset);
-            m_document_map[dictionaryname] = -1;
-            return -1;
-        }
+    if (dm != m_document_map.end())
+        return dm->second;
+
+    // Parse without blocking readers of other documents.
+    pugi::xml_document *doc = new pugi::xml_document;
+    pugi::xml_parse_result parse_result;
+    if (Strutil::ends_with (dictionaryname.string(), ".xml")) {
+        // xml file -- read it
+        m_file_mtimes[dictionaryname] =
+            OIIO::Filesystem::last_write_time (dictionaryname.string());
+        parse_result = doc->load_file (dictionaryname.c_str());
     } else {
-        dindex = dm->second;
+        // load xml directly from the string
+        parse_result = doc->load_buffer (dictionaryname.c_str(),
+                                         dictionaryname.length());
+    }
+    if (! parse_result) {
+        delete doc;
+        if (! ctx)
+            return -1;   // Leave the error for run time
+        ctx->error ("XML parsed with errors: %s, at offset %d",
+                    parse_result.description(),
+                    parse_result.offset);
+        OIIO::spin_rw_write_lock lock (m_rwmutex);
+        m_document_map[dictionaryname] = -1;
+        return -1;
     }
 
-    DASSERT (dindex < (int)m_documents.size());
+    OIIO::spin_rw_write_lock lock (m_rwmutex);
+    int dindex = (int) m_documents.size();
+    m_documents.push_back (doc);
+    m_document_map[dictionaryname] = dindex;
     return dindex;
 }
 
 
 
 int
-Dictionary::dict_find (ustring dictionaryname, ustring query)
+Dictionary::find_and_cache (ShadingContext *ctx, const Query &q,
+                            const pugi::xpath_node &root)
 {
-    int dindex = get_document_index (dictionaryname);
-    if (dindex < 0)
-        return dindex;
-    ASSERT (dindex >= 0 && dindex < (int)m_documents.size());
-
-    Query q (dindex, 0, query);
+    // Somebody else may have resolved it while we waited for the lock.
     QueryMap::iterator qfound = m_cache.find (q);
-    if (qfound != m_cache.end()) {
+    if (qfound != m_cache.end())
         return qfound->second.valueoffset;
-    }
-
-    pugi::xml_document *doc = m_documents[dindex];
 
     // Query was not found.  Do the expensive lookup and cache it
     pugi::xpath_node_set matches;
-
     try {
-        matches = doc->select_nodes (query.c_str());
+        matches = root.node() ? root.node().select_nodes (q.name.c_str())
+                              : m_documents[q.document]->select_nodes (q.name.c_str());
     }
     catch (const pugi::xpath_exception& e) {
-        m_context->error ("Invalid dict_find query '%s': %s",
-                          query.c_str(), e.what());
+        if (! ctx)
+            return -1;   // Leave the error for run time
+        ctx->error ("Invalid dict_find query '%s': %s",
+                    q.name.c_str(), e.what());
         return 0;
     }
 
+    OIIO::spin_rw_write_lock lock (m_rwmutex);
     if (matches.empty()) {
         m_cache[q] = QueryResult (false);  // mark invalid
         return 0;   // Not found
@@ -233,7 +276,7 @@ Dictionary::dict_find (ustring dictionaryname, ustring query)
     int firstmatch = (int) m_nodes.size();
     int last = -1;
     for (auto&& m : matches) {
-        m_nodes.emplace_back(dindex, m.node());
+        m_nodes.emplace_back(q.document, m.node());
         int nodeid = (int) m_nodes.size()-1;
         if (last < 0) {
             // If this is the first match, add a cache entry for it
@@ -250,48 +293,48 @@ Dictionary::dict_find (ustring dictionaryname, ustring query)
 
 
 int
-Dictionary::dict_find (int nodeID, ustring query)
+Dictionary::dict_find (ShadingContext *ctx, ustring dictionaryname,
+                       ustring query)
 {
-    if (nodeID <= 0 || nodeID >= (int)m_nodes.size())
-        return 0;     // invalid node ID
-
-    int document = m_nodes[nodeID].document;
-    Query q (document, nodeID, query);
-    QueryMap::iterator qfound = m_cache.find (q);
-    if (qfound != m_cache.end()) {
-        return qfound->second.valueoffset;
+    {
+        OIIO::spin_rw_read_lock lock (m_rwmutex);
+        DocMap::const_iterator dm = m_document_map.find(dictionaryname);
+        if (dm != m_document_map.end()) {
+            if (dm->second < 0)
+                return dm->second;
+            QueryMap::const_iterator qfound = m_cache.find (Query (dm->second, 0, query));
+            if (qfound != m_cache.end())
+                return qfound->second.valueoffset;
+        }
     }
 
-    // Query was not found.  Do the expensive lookup and cache it
-    pugi::xpath_node_set matches;
-    try {
-        matches = m_nodes[nodeID].node.select_nodes (query.c_str());
-    }
-    catch (const pugi::xpath_exception& e) {
-        m_context->error ("Invalid dict_find query '%s': %s",
-                          query.c_str(), e.what());
-        return 0;
-    }
+    lock_guard lock (m_miss_mutex);
+    int dindex = get_document_index (ctx, dictionaryname);
+    if (dindex < 0)
+        return dindex;
+    ASSERT (dindex >= 0 && dindex < (int)m_documents.size());
+    return find_and_cache (ctx, Query (dindex, 0, query), pugi::xpath_node());
+}
 
-    if (matches.empty()) {
-        m_cache[q] = QueryResult (false);  // mark invalid
-        return 0;   // Not found
-    }
-    int firstmatch = (int) m_nodes.size();
-    int last = -1;
-    for (auto&& m : matches) {
-        m_nodes.emplace_back(document, m.node());
-        int nodeid = (int) m_nodes.size()-1;
-        if (last < 0) {
-            // If this is the first match, add a cache entry for it
-            m_cache[q] = QueryResult (true /* it's a node */, nodeid);
-        } else {
-            // If this is a subsequent match, set the last match's 'next'
-            m_nodes[last].next = nodeid;
-        }
-        last = nodeid;
+
+
+int
+Dictionary::dict_find (ShadingContext *ctx, int nodeID, ustring query)
+{
+    {
+        OIIO::spin_rw_read_lock lock (m_rwmutex);
+        if (nodeID <= 0 || nodeID >= (int)m_nodes.size())
+            return 0;     // invalid node ID
+        QueryMap::const_iterator qfound =
+            m_cache.find (Query (m_nodes[nodeID].document, nodeID, query));
+        if (qfound != m_cache.end())
+            return qfound->second.valueoffset;
     }
-    return firstmatch;
+
+    lock_guard lock (m_miss_mutex);
+    const Node &node (m_nodes[nodeID]);
+    return find_and_cache (ctx, Query (node.document, nodeID, query),
+                           pugi::xpath_node (node.node));
 }
 
 
@@ -299,6 +342,7 @@ Dictionary::dict_find (int nodeID, ustring query)
 int
 Dictionary::dict_next (int nodeID)
 {
+    OIIO::spin_rw_read_lock lock (m_rwmutex);
     if (nodeID <= 0 || nodeID >= (int)m_nodes.size())
         return 0;     // invalid node ID
     return m_nodes[nodeID].next;
@@ -306,39 +350,54 @@ Dictionary::dict_next (int nodeID)
 
 
 
+int
+Dictionary::copy_value (const QueryResult &r, TypeDesc type, void *data) const
+{
+    int offset = r.valueoffset;
+    int n = type.numelements() * type.aggregate;
+    if (type.basetype == TypeDesc::STRING) {
+        ASSERT (n == 1 && "no string arrays in XML");
+        ((ustring *)data)[0] = m_stringdata[offset];
+        return 1;
+    }
+    if (type.basetype == TypeDesc::INT) {
+        for (int i = 0;  i < n;  ++i)
+            ((int *)data)[i] = m_intdata[offset++];
+        return 1;
+    }
+    if (type.basetype == TypeDesc::FLOAT) {
+        for (int i = 0;  i < n;  ++i)
+            ((float *)data)[i] = m_floatdata[offset++];
+        return 1;
+    }
+    return 0;  // Unknown type
+}
+
+
+
 int
 Dictionary::dict_value (int nodeID, ustring attribname,
                         TypeDesc type, void *data)
 {
-    if (nodeID <= 0 || nodeID >= (int)m_nodes.size())
-        return 0;     // invalid node ID
-
-    const Dictionary::Node &node (m_nodes[nodeID]);
-    Dictionary::Query q (node.document, nodeID, attribname, type);
-    Dictionary::QueryMap::iterator qfound = m_cache.find (q);
-    if (qfound != m_cache.end()) {
-        // previously found
-        int offset = qfound->second.valueoffset;
-        int n = type.numelements() * type.aggregate;
-        if (type.basetype == TypeDesc::STRING) {
-            ASSERT (n == 1 && "no string arrays in XML");
-            ((ustring *)data)[0] = m_stringdata[offset];
-            return 1;
-        }
-        if (type.basetype == TypeDesc::INT) {
-            for (int i = 0;  i < n;  ++i)
-                ((int *)data)[i] = m_intdata[offset++];
-            return 1;
-        }
-        if (type.basetype == TypeDesc::FLOAT) {
-            for (int i = 0;  i < n;  ++i)
-                ((float *)data)[i] = m_floatdata[offset++];
-            return 1;
+    {
+        OIIO::spin_rw_read_lock lock (m_rwmutex);
+        if (nodeID <= 0 || nodeID >= (int)m_nodes.size())
+            return 0;     // invalid node ID
+        Dictionary::Query q (m_nodes[nodeID].document, nodeID, attribname, type);
+        Dictionary::QueryMap::const_iterator qfound = m_cache.find (q);
+        if (qfound != m_cache.end()) {
+            // previously found
+            return copy_value (qfound->second, type, data);
         }
-        return 0;  // Unknown type
     }
 
     // OK, the entry wasn't in the cache, we need to decode it and cache it.
+    lock_guard miss_lock (m_miss_mutex);
+    const Dictionary::Node &node (m_nodes[nodeID]);
+    Dictionary::Query q (node.document, nodeID, attribname, type);
+    Dictionary::QueryMap::iterator qfound = m_cache.find (q);
+    if (qfound != m_cache.end())
+        return copy_value (qfound->second, type, data);
 
     const char *val = NULL;
     if (attribname.empty()) {
@@ -358,14 +417,16 @@ Dictionary::dict_value (int nodeID, ustring attribname,
     Dictionary::QueryResult r (false, 0);
     int n = type.numelements() * type.aggregate;
     if (type.basetype == TypeDesc::STRING && n == 1) {
-        r.valueoffset = (int) m_stringdata.size();
         ustring s (val);
+        OIIO::spin_rw_write_lock lock (m_rwmutex);
+        r.valueoffset = (int) m_stringdata.size();
         m_stringdata.push_back (s);
         ((ustring *)data)[0] = s;
         m_cache[q] = r;
         return 1;
     }
     if (type.basetype == TypeDesc::INT) {
+        OIIO::spin_rw_write_lock lock (m_rwmutex);
         r.valueoffset = (int) m_intdata.size();
         string_view valstr (val);
         for (int i = 0;  i < n;  ++i) {
@@ -379,6 +440,7 @@ Dictionary::dict_value (int nodeID, ustring attribname,
         return 1;
     }
     if (type.basetype == TypeDesc::FLOAT) {
+        OIIO::spin_rw_write_lock lock (m_rwmutex);
         r.valueoffset = (int) m_floatdata.size();
         string_view valstr (val);
         for (int i = 0;  i < n;  ++i) {
@@ -397,28 +459,47 @@ Dictionary::dict_value (int nodeID, ustring attribname,
 }
 
 
+
+void
+Dictionary::invalidate ()
+{
+    lock_guard miss_lock (m_miss_mutex);
+    std::vector<ustring> changed;
+    for (auto&& f : m_file_mtimes)
+        if (OIIO::Filesystem::last_write_time (f.first.string()) != f.second)
+            changed.push_back (f.first);
+    if (changed.empty())
+        return;
+    // Just unmap the names.  The old documents, their nodes, and their
+    // cached queries stay where they are, since node IDs that shaders
+    // already hold still refer to them.
+    OIIO::spin_rw_write_lock lock (m_rwmutex);
+    for (auto&& name : changed) {
+        m_document_map.erase (name);
+        m_file_mtimes.erase (name);
+    }
+}
+
+
 }; // namespace pvt
 
 
 
 int
-ShadingContext::dict_find (ustring dictionaryname, ustring query)
+ShadingContext::dict_find (ustring dictionaryname, ustring query,
+                           bool report_errors)
 {
-    if (! m_dictionary) {
-        m_dictionary = new Dictionary (this);
-    }
-    return m_dictionary->dict_find (dictionaryname, query);
+    return shadingsys().dictionary()->dict_find (report_errors ? this : NULL,
+                                                 dictionaryname, query);
 }
 
 
 
 int
-ShadingContext::dict_find (int nodeID, ustring query)
+ShadingContext::dict_find (int nodeID, ustring query, bool report_errors)
 {
-    if (! m_dictionary) {
-        m_dictionary = new Dictionary (this);
-    }
-    return m_dictionary->dict_find (nodeID, query);
+    return shadingsys().dictionary()->dict_find (report_errors ? this : NULL,
+                                                 nodeID, query);
 }
 
 
@@ -426,9 +507,7 @@ ShadingContext::dict_find (int nodeID, ustring query)
 int
 ShadingContext::dict_next (int nodeID)
 {
-    if (! m_dictionary)
-        return 0;
-    return m_dictionary->dict_next (nodeID);
+    return shadingsys().dictionary()->dict_next (nodeID);
 }
 
 
@@ -437,17 +516,32 @@ int
 ShadingContext::dict_value (int nodeID, ustring attribname,
                             TypeDesc type, void *data)
 {
-    if (! m_dictionary)
-        return 0;
-    return m_dictionary->dict_value (nodeID, attribname, type, data);
+    return shadingsys().dictionary()->dict_value (nodeID, attribname, type, data);
+}
+
+
+
+void
+ShadingSystemImpl::init_dict_resources ()
+{
+    m_dictionary = new Dictionary;
+}
+
+
+
+void
+ShadingSystemImpl::invalidate_dictionaries ()
+{
+    m_dictionary->invalidate ();
 }
 
 
 
 void
-ShadingContext::free_dict_resources ()
+ShadingSystemImpl::free_dict_resources ()
 {
     delete m_dictionary;
+    m_dictionary = NULL;
 }
 
 
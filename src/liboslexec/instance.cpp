@@ -515,6 +515,8 @@ ShaderInstance::copy_code_from_master (ShaderGroup &group)
                 si->renderer_output (true);
                 renderer_outputs (true);
             }
+            if (group.is_interactive_param (layername(), si->name()))
+                si->interactive (true);
         }
     }
     evaluate_writes_globals_and_userdata_params ();
@@ -612,6 +614,11 @@ ShaderInstance::mergeable (const ShaderInstance &b, const ShaderGroup &g) const
     if (master() != b.master())
         return false;
 
+    // Interactive parameters may be changed independently, by layer,
+    // after the group is optimized, so don't merge layers in such groups.
+    if (g.has_interactive_params())
+        return false;
+
     // If the shaders haven't been optimized yet, they don't yet have
     // their own symbol tables and instructions (they just refer to
     // their unoptimized master), but they may have an "instance
@@ -780,6 +787,21 @@ ShaderGroup::find_layer (ustring layername) const
 
 
 
+bool
+ShaderGroup::is_interactive_param (ustring layername, ustring paramname) const
+{
+    const std::vector<ustring> &names (m_interactive_params);
+    if (names.empty())
+        return false;
+    if (std::find (names.begin(), names.end(), paramname) != names.end())
+        return true;
+    // Try "layer.name"
+    ustring name2 = ustring::format ("%s.%s", layername, paramname);
+    return std::find (names.begin(), names.end(), name2) != names.end();
+}
+
+
+
 const Symbol *
 ShaderGroup::find_symbol (ustring layername, ustring symbolname) const
 {
@@ -819,11 +841,19 @@ ShaderGroup::mark_entry_layer (int layer)
 
 std::string
 ShaderGroup::serialize () const
+{
+    lock_guard lock (m_mutex);
+    return serialize_locked ();
+}
+
+
+
+std::string
+ShaderGroup::serialize_locked () const
 {
     std::ostringstream out;
     out.imbue (std::locale::classic());  // force C locale
     out.precision (9);
-    lock_guard lock (m_mutex);
     for (int i = 0, nl = nlayers(); i < nl; ++i) {
         const ShaderInstance *inst = m_layers[i].get();
 
@@ -34,6 +34,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OSL/genclosure.h>
 #include "backendllvm.h"
 
+#include <llvm/IR/Instructions.h>
+
 using namespace OSL;
 using namespace OSL::pvt;
 
@@ -1902,9 +1904,16 @@ LLVMGEN (llvm_gen_regex)
             (Match.typespec().is_array() &&
              Match.typespec().elementtype().is_int()));
 
+    // A constant pattern is compiled now, and the shader is handed the
+    // compiled regex directly rather than looking it up on every call.
+    const CompiledRegex *compiled = NULL;
+    if (Pattern.is_constant() && ! rop.use_optix())
+        compiled = rop.shadingsys().find_regex (*(ustring *)Pattern.data());
+
     std::vector<llvm::Value*> call_args;
     // First arg is ShaderGlobals ptr
-    call_args.push_back (rop.sg_void_ptr());
+    if (! compiled)
+        call_args.push_back (rop.sg_void_ptr());
     // Next arg is subject string
     call_args.push_back (rop.llvm_load_value (Subject));
     // Pass the results array and length (just pass 0 if no results wanted).
@@ -1914,12 +1923,17 @@ LLVMGEN (llvm_gen_regex)
     else
         call_args.push_back (rop.ll.constant(0));
     // Pass the regex match pattern
-    call_args.push_back (rop.llvm_load_value (Pattern));
+    if (compiled)
+        call_args.push_back (rop.ll.constant_ptr ((void *)compiled));
+    else
+        call_args.push_back (rop.llvm_load_value (Pattern));
     // Pass whether or not to do the full match
     call_args.push_back (rop.ll.constant(fullmatch));
 
-    llvm::Value *ret = rop.ll.call_function ("osl_regex_impl", &call_args[0],
-                                               (int)call_args.size());
+    llvm::Value *ret = rop.ll.call_function (compiled ? "osl_regex_compiled"
+                                                      : "osl_regex_impl",
+                                             &call_args[0],
+                                             (int)call_args.size());
     rop.llvm_store_value (ret, Result);
     return true;
 }
@@ -2096,7 +2110,7 @@ LLVMGEN (llvm_gen_if)
     llvm::BasicBlock* then_block = rop.ll.new_basic_block ("then");
     llvm::BasicBlock* else_block = rop.ll.new_basic_block ("else");
     llvm::BasicBlock* after_block = rop.ll.new_basic_block ("");
-    rop.ll.op_branch (cond_val, then_block, else_block);
+    rop.llvm_pgo_branch (opnum, cond_val, then_block, else_block);
 
     // Then block
     rop.build_llvm_code (opnum+1, op.jump(0), then_block);
@@ -2137,7 +2151,7 @@ LLVMGEN (llvm_gen_loop_op)
     llvm::Value* cond_val = rop.llvm_test_nonzero (cond);
 
     // Jump to either LoopBody or AfterLoop
-    rop.ll.op_branch (cond_val, body_block, after_block);
+    rop.llvm_pgo_branch (opnum, cond_val, body_block, after_block);
 
     // Body of loop
     rop.build_llvm_code (op.jump(1), op.jump(2), body_block);
@@ -2172,21 +2186,66 @@ LLVMGEN (llvm_gen_loopmod_op)
 
 
 
+// Return the group's prototype TextureOpt whose options (of those that
+// texture calls may set) match opt, adding a copy of opt if there is none,
+// so that texture calls with the same constant options share one block.
+static const TextureOpt *
+texture_opt_block (ShaderGroup &group, const TextureOpt &opt)
+{
+    for (auto &b : group.m_texture_opt_blocks) {
+        if (b->firstchannel == opt.firstchannel &&
+            b->subimage == opt.subimage &&
+            b->subimagename == opt.subimagename &&
+            b->swrap == opt.swrap && b->twrap == opt.twrap &&
+            b->rwrap == opt.rwrap && b->interpmode == opt.interpmode &&
+            b->sblur == opt.sblur && b->tblur == opt.tblur &&
+            b->rblur == opt.rblur && b->swidth == opt.swidth &&
+            b->twidth == opt.twidth && b->rwidth == opt.rwidth &&
+            b->fill == opt.fill && b->time == opt.time)
+            return b.get();
+    }
+    group.m_texture_opt_blocks.emplace_back (new TextureOpt (opt));
+    return group.m_texture_opt_blocks.back().get();
+}
+
+
+
 static llvm::Value *
 llvm_gen_texture_options (BackendLLVM &rop, int opnum,
                           int first_optional_arg, bool tex3d, int nchans,
                           llvm::Value* &alpha, llvm::Value* &dalphadx,
                           llvm::Value* &dalphady, llvm::Value* &errormessage)
 {
-    llvm::Value* opt = rop.ll.call_function ("osl_get_texture_options",
-                                             rop.sg_void_ptr());
-    llvm::Value* missingcolor = NULL;
+    // Options whose values are constant are baked into a prototype
+    // TextureOpt owned by the group, which a single call copies into the
+    // context at run time; only the varying options need their own calls
+    // after that. The prototype lives in host memory, so with OptiX only
+    // constants equal to the defaults can be skipped, and any others are
+    // still set individually. The prototype is only known once all the
+    // options have been seen, so the call's pointer is filled in last.
     TextureOpt optdefaults;  // So we can check the defaults
-    bool swidth_set = false, twidth_set = false, rwidth_set = false;
-    bool sblur_set = false, tblur_set = false, rblur_set = false;
-    bool swrap_set = false, twrap_set = false, rwrap_set = false;
-    bool firstchannel_set = false, fill_set = false, interp_set = false;
-    bool time_set = false, subimage_set = false;
+    TextureOpt protoopt;
+    TextureOpt *proto = NULL;
+    llvm::Value* opt;
+    if (rop.use_optix()) {
+        opt = rop.ll.call_function ("osl_get_texture_options",
+                                    rop.sg_void_ptr());
+    } else {
+        proto = &protoopt;
+        opt = rop.ll.call_function ("osl_init_texture_options",
+                                    rop.sg_void_ptr(),
+                                    rop.ll.void_ptr_null());
+    }
+    llvm::Value* missingcolor = NULL;
+    // Once an option has been set by a call (because its value varies),
+    // later constant values for it must be set by calls, too, so that
+    // they still override it.
+    bool swidth_varying = false, twidth_varying = false, rwidth_varying = false;
+    bool sblur_varying = false, tblur_varying = false, rblur_varying = false;
+    bool swrap_varying = false, twrap_varying = false, rwrap_varying = false;
+    bool firstchannel_varying = false, fill_varying = false;
+    bool interp_varying = false, time_varying = false;
+    bool subimage_varying = false, subimagename_varying = false;
 
     Opcode &op (rop.inst()->ops()[opnum]);
     for (int a = first_optional_arg;  a < op.nargs();  ++a) {
@@ -2207,65 +2266,83 @@ llvm_gen_texture_options (BackendLLVM &rop, int opnum,
 
 #define PARAM_INT(paramname)                                            \
         if (name == Strings::paramname && valtype == TypeDesc::INT)   { \
-            if (! paramname##_set &&                                    \
-                ival && *ival == optdefaults.paramname)                 \
-                continue;     /* default constant */                    \
+            if (ival && ! paramname##_varying &&                        \
+                (proto || *ival == optdefaults.paramname)) {            \
+                if (proto)                                              \
+                    proto->paramname = *ival;                           \
+                continue;                                               \
+            }                                                           \
             llvm::Value *val = rop.llvm_load_value (Val);               \
             rop.ll.call_function ("osl_texture_set_" #paramname, opt, val); \
-            paramname##_set = true;                                     \
+            paramname##_varying = true;                                 \
             continue;                                                   \
         }
 
 #define PARAM_FLOAT(paramname)                                          \
         if (name == Strings::paramname &&                               \
             (valtype == TypeDesc::FLOAT || valtype == TypeDesc::INT)) { \
-            if (! paramname##_set &&                                    \
-                ((ival && *ival == optdefaults.paramname) ||            \
-                 (fval && *fval == optdefaults.paramname)))             \
-                continue;     /* default constant */                    \
+            float v = ival ? float(*ival) : (fval ? *fval : 0.0f);      \
+            if ((ival || fval) && ! paramname##_varying &&              \
+                (proto || v == optdefaults.paramname)) {                \
+                if (proto)                                              \
+                    proto->paramname = v;                               \
+                continue;                                               \
+            }                                                           \
             llvm::Value *val = rop.llvm_load_value (Val);               \
             if (valtype == TypeDesc::INT)                               \
                 val = rop.ll.op_int_to_float (val);                     \
             rop.ll.call_function ("osl_texture_set_" #paramname, opt, val); \
-            paramname##_set = true;                                     \
+            paramname##_varying = true;                                 \
             continue;                                                   \
         }
 
 #define PARAM_FLOAT_STR(paramname)                                      \
         if (name == Strings::paramname &&                               \
             (valtype == TypeDesc::FLOAT || valtype == TypeDesc::INT)) { \
-            if (! s##paramname##_set && ! t##paramname##_set &&         \
-                ! r##paramname##_set &&                                 \
-                ((ival && *ival == optdefaults.s##paramname) ||         \
-                 (fval && *fval == optdefaults.s##paramname)))          \
-                continue;     /* default constant */                    \
+            float v = ival ? float(*ival) : (fval ? *fval : 0.0f);      \
+            if ((ival || fval) && ! s##paramname##_varying &&           \
+                ! t##paramname##_varying && ! r##paramname##_varying && \
+                (proto || v == optdefaults.s##paramname)) {             \
+                if (proto) {                                            \
+                    proto->s##paramname = v;                            \
+                    proto->t##paramname = v;                            \
+                    if (tex3d)                                          \
+                        proto->r##paramname = v;                        \
+                }                                                       \
+                continue;                                               \
+            }                                                           \
             llvm::Value *val = rop.llvm_load_value (Val);               \
             if (valtype == TypeDesc::INT)                               \
                 val = rop.ll.op_int_to_float (val);                     \
             rop.ll.call_function ("osl_texture_set_st" #paramname, opt, val); \
             if (tex3d)                                                  \
                 rop.ll.call_function ("osl_texture_set_r" #paramname, opt, val); \
-            s##paramname##_set = true;                                  \
-            t##paramname##_set = true;                                  \
-            r##paramname##_set = true;                                  \
+            s##paramname##_varying = true;                              \
+            t##paramname##_varying = true;                              \
+            r##paramname##_varying = true;                              \
             continue;                                                   \
         }
 
-#define PARAM_STRING_CODE(paramname,decoder,fieldname)                  \
+#define PARAM_STRING_CODE(paramname,decoder,fieldname,fieldtype)        \
         if (name == Strings::paramname && valtype == TypeDesc::STRING) { \
             if (Val.is_constant()) {                                    \
                 int code = decoder (*(ustring *)Val.data());            \
-                if (! paramname##_set && code == optdefaults.fieldname) \
+                if (code < 0)                                           \
+                    continue;                                           \
+                if (! paramname##_varying &&                            \
+                    (proto || code == optdefaults.fieldname)) {         \
+                    if (proto)                                          \
+                        proto->fieldname = (fieldtype)code;             \
                     continue;                                           \
-                if (code >= 0) {                                        \
-                    llvm::Value *val = rop.ll.constant (code);          \
-                    rop.ll.call_function ("osl_texture_set_" #paramname "_code", opt, val); \
                 }                                                       \
-            } else {                                                    \
-                llvm::Value *val = rop.llvm_load_value (Val);           \
-                rop.ll.call_function ("osl_texture_set_" #paramname, opt, val); \
+                llvm::Value *val = rop.ll.constant (code);              \
+                rop.ll.call_function ("osl_texture_set_" #paramname "_code", opt, val); \
+                paramname##_varying = true;                             \
+                continue;                                               \
             }                                                           \
-            paramname##_set = true;                                     \
+            llvm::Value *val = rop.llvm_load_value (Val);               \
+            rop.ll.call_function ("osl_texture_set_" #paramname, opt, val); \
+            paramname##_varying = true;                                 \
             continue;                                                   \
         }
 
@@ -2281,6 +2358,16 @@ llvm_gen_texture_options (BackendLLVM &rop, int opnum,
         if (name == Strings::wrap && valtype == TypeDesc::STRING) {
             if (Val.is_constant()) {
                 int mode = TextureOpt::decode_wrapmode (*(ustring *)Val.data());
+                if (! swrap_varying && ! twrap_varying && ! rwrap_varying &&
+                    (proto || mode == optdefaults.swrap)) {
+                    if (proto) {
+                        proto->swrap = (TextureOpt::Wrap)mode;
+                        proto->twrap = (TextureOpt::Wrap)mode;
+                        if (tex3d)
+                            proto->rwrap = (TextureOpt::Wrap)mode;
+                    }
+                    continue;
+                }
                 llvm::Value *val = rop.ll.constant (mode);
                 rop.ll.call_function ("osl_texture_set_stwrap_code", opt, val);
                 if (tex3d)
@@ -2291,12 +2378,12 @@ llvm_gen_texture_options (BackendLLVM &rop, int opnum,
                 if (tex3d)
                     rop.ll.call_function ("osl_texture_set_rwrap", opt, val);
             }
-            swrap_set = twrap_set = rwrap_set = true;
+            swrap_varying = twrap_varying = rwrap_varying = true;
             continue;
         }
-        PARAM_STRING_CODE(swrap, TextureOpt::decode_wrapmode, swrap)
-        PARAM_STRING_CODE(twrap, TextureOpt::decode_wrapmode, twrap)
-        PARAM_STRING_CODE(rwrap, TextureOpt::decode_wrapmode, rwrap)
+        PARAM_STRING_CODE(swrap, TextureOpt::decode_wrapmode, swrap, TextureOpt::Wrap)
+        PARAM_STRING_CODE(twrap, TextureOpt::decode_wrapmode, twrap, TextureOpt::Wrap)
+        PARAM_STRING_CODE(rwrap, TextureOpt::decode_wrapmode, rwrap, TextureOpt::Wrap)
 
         PARAM_FLOAT (fill)
         PARAM_FLOAT (time)
@@ -2304,19 +2391,21 @@ llvm_gen_texture_options (BackendLLVM &rop, int opnum,
         PARAM_INT (subimage)
 
         if (name == Strings::subimage && valtype == TypeDesc::STRING) {
-            if (Val.is_constant()) {
+            if (Val.is_constant() && ! subimagename_varying) {
                 ustring v = *(ustring *)Val.data();
-                if (v.empty() && ! subimage_set) {
-                    continue;     // Ignore nulls unless they are overrides
+                if (proto || v.empty()) {
+                    if (proto)
+                        proto->subimagename = v;
+                    continue;
                 }
             }
             llvm::Value *val = rop.llvm_load_value (Val);
             rop.ll.call_function ("osl_texture_set_subimagename", opt, val);
-            subimage_set = true;
+            subimagename_varying = true;
             continue;
         }
 
-        PARAM_STRING_CODE (interp, tex_interp_to_code, interpmode)
+        PARAM_STRING_CODE (interp, tex_interp_to_code, interpmode, TextureOpt::InterpMode)
 
         if (name == Strings::alpha && valtype == TypeDesc::FLOAT) {
             alpha = rop.llvm_get_pointer (Val);
@@ -2380,6 +2469,11 @@ llvm_gen_texture_options (BackendLLVM &rop, int opnum,
 #endif
     }
 
+    if (proto) {
+        const TextureOpt *block = texture_opt_block (rop.group(), *proto);
+        llvm::cast<llvm::CallInst>(opt)->setArgOperand (1,
+                                rop.ll.constant_ptr ((void *)block));
+    }
     return opt;
 }
 
@@ -3040,7 +3134,7 @@ LLVMGEN (llvm_gen_getmessage)
     DASSERT (Result.typespec().is_int() && Name.typespec().is_string());
     DASSERT (has_source == 0 || Source.typespec().is_string());
 
-    llvm::Value *args[9];
+    llvm::Value *args[10];
     args[0] = rop.sg_void_ptr();
     args[1] = has_source ? rop.llvm_load_value(Source) 
                          : rop.ll.constant(ustring());
@@ -3061,8 +3155,11 @@ LLVMGEN (llvm_gen_getmessage)
     args[6] = rop.ll.constant(rop.inst()->id());
     args[7] = rop.ll.constant(op.sourcefile());
     args[8] = rop.ll.constant(op.sourceline());
+    // Names known now get a fixed slot, so the lookup is just an array
+    // reference at runtime.
+    args[9] = rop.ll.constant (Name.is_constant() ? rop.message_slot (*(ustring *)Name.data()) : -1);
 
-    llvm::Value *r = rop.ll.call_function ("osl_getmessage", args, 9);
+    llvm::Value *r = rop.ll.call_function ("osl_getmessage", args, 10);
     rop.llvm_store_value (r, Result);
     return true;
 }
@@ -3078,7 +3175,7 @@ LLVMGEN (llvm_gen_setmessage)
     Symbol& Data   = *rop.opargsym (op, 1);
     DASSERT (Name.typespec().is_string());
 
-    llvm::Value *args[7];
+    llvm::Value *args[8];
     args[0] = rop.sg_void_ptr();
     args[1] = rop.llvm_load_value (Name);
     if (Data.typespec().is_closure_based()) {
@@ -3095,8 +3192,9 @@ LLVMGEN (llvm_gen_setmessage)
     args[4] = rop.ll.constant(rop.inst()->id());
     args[5] = rop.ll.constant(op.sourcefile());
     args[6] = rop.ll.constant(op.sourceline());
+    args[7] = rop.ll.constant (Name.is_constant() ? rop.message_slot (*(ustring *)Name.data()) : -1);
 
-    rop.ll.call_function ("osl_setmessage", args, 7);
+    rop.ll.call_function ("osl_setmessage", args, 8);
     return true;
 }
 
@@ -31,6 +31,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unordered_map>
 #include <unordered_set>
 #include <bitset>
+#include <algorithm>
 
 #include <OpenImageIO/timer.h>
 #include <OpenImageIO/sysutil.h>
@@ -123,6 +124,22 @@ OSL_NAMESPACE_ENTER
 
 namespace pvt {
 
+// Hash of the shadeop library bitcode that every group is linked
+// against, computed just once. It's part of the JIT cache key, so that
+// cached code is never reused with a different library.
+static size_t
+llvm_ops_library_hash ()
+{
+#ifdef OSL_LLVM_NO_BITCODE
+    return 0;
+#else
+    static size_t hash = Strutil::strhash (string_view ((const char *)osl_llvm_compiled_ops_block,
+                                                        osl_llvm_compiled_ops_size));
+    return hash;
+#endif
+}
+
+
 static spin_mutex llvm_mutex;
 
 static ustring op_end("end");
@@ -243,6 +260,10 @@ BackendLLVM::llvm_type_groupdata ()
     std::vector<llvm::Type*> fields;
     int offset = 0;
     int order = 0;
+    // What the unoptimized layout (every param in declaration order,
+    // derivs for all userdata) would have needed, for the stats.
+    int plain_offset = 0;
+    bool opt_layout = shadingsys().opt_groupdata();
 
     if (llvm_debug() >= 2)
         std::cout << "Group param struct:\n";
@@ -255,6 +276,7 @@ BackendLLVM::llvm_type_groupdata ()
     int sz = (m_num_used_layers + 3) & (~3);  // Round up to 32 bit boundary
     fields.push_back (ll.type_array (ll.type_bool(), sz));
     offset += sz * sizeof(bool);
+    plain_offset = offset;
     ++order;
 
     // Now add the array that tells which userdata have been initialized,
@@ -270,21 +292,25 @@ BackendLLVM::llvm_type_groupdata ()
         int sz = (nuserdata + 3) & (~3);
         fields.push_back (ll.type_array (ll.type_bool(), sz));
         offset += nuserdata * sizeof(bool);
+        plain_offset += nuserdata * sizeof(bool);
         ++order;
         for (int i = 0; i < nuserdata; ++i) {
             TypeDesc type = types[i];
             // NB: Userdata derivs are not currently supported in OptiX, since
             //     making room for them in the GroupData struct can result in a
             //     large per-thread memory allocation, which could negatively
-            //     impact performance.
-            int n = (! use_optix())
-                ? type.numelements() * 3  // make room for derivs by default
-                : type.numelements();
+            //     impact performance. Nor do we make room for them if none
+            //     of the params bound to the userdata need derivs.
+            bool derivs = ! use_optix() &&
+                          (group().m_userdata_derivs[i] || ! opt_layout);
+            int n = derivs ? type.numelements() * 3 : type.numelements();
             type.arraylen = n;
             fields.push_back (llvm_type (type));
             // Alignment
             int align = type.basesize();
             offset = OIIO::round_to_multiple_of_pow2 (offset, align);
+            plain_offset = OIIO::round_to_multiple_of_pow2 (plain_offset, align);
+            plain_offset += int(types[i].size()) * (use_optix() ? 1 : 3);
             if (llvm_debug() >= 2)
                 std::cout << "  userdata " << names[i] << ' ' << type
                           << ", field " << order << ", offset " << offset << "\n";
@@ -296,16 +322,34 @@ BackendLLVM::llvm_type_groupdata ()
 
     // For each layer in the group, add entries for all params that are
     // connected or interpolated, and output params.  Also mark those
-    // symbols with their offset within the group struct.
+    // symbols with their offset within the group struct.  Within each
+    // layer, the params are laid out in the order that the layer's code
+    // first touches them (the ones it never touches going last), so that
+    // the fields used together share cache lines.
     m_param_order_map.clear ();
+    std::vector<Symbol *> params;
     for (int layer = 0;  layer < group().nlayers();  ++layer) {
         ShaderInstance *inst = group()[layer];
         if (inst->unused())
             continue;
+        params.clear ();
         FOREACH_PARAM (Symbol &sym, inst) {
-            TypeSpec ts = sym.typespec();
-            if (ts.is_structure())  // skip the struct symbol itself
+            if (sym.typespec().is_structure())  // skip the struct symbol itself
                 continue;
+            params.push_back (&sym);
+            size_t align = sym.typespec().is_closure_based() ? sizeof(void*) :
+                    sym.typespec().simpletype().basesize();
+            plain_offset = OIIO::round_to_multiple_of_pow2 (plain_offset, int(align));
+            plain_offset += (sym.has_derivs() ? 3 : 1) * int(sym.size());
+        }
+        if (opt_layout)
+            std::stable_sort (params.begin(), params.end(),
+                              [](const Symbol *a, const Symbol *b) {
+                                  return a->firstuse() < b->firstuse();
+                              });
+        for (Symbol *s : params) {
+            Symbol &sym (*s);
+            TypeSpec ts = sym.typespec();
             const int arraylen = std::max (1, sym.typespec().arraylength());
             const int derivSize = (sym.has_derivs() ? 3 : 1);
             ts.make_array (arraylen * derivSize);
@@ -330,9 +374,11 @@ BackendLLVM::llvm_type_groupdata ()
         }
     }
     group().llvm_groupdata_size (offset);
+    m_groupdata_bytes_saved = std::max (plain_offset - offset, 0);
     if (llvm_debug() >= 2)
         std::cout << " Group struct had " << order << " fields, total size "
-                  << offset << "\n\n";
+                  << offset << " (saved " << m_groupdata_bytes_saved
+                  << ")\n\n";
 
     std::string groupdataname = Strutil::sprintf("Groupdata_%llu",
                                                 (long long unsigned int)group().name().hash());
@@ -520,8 +566,10 @@ BackendLLVM::llvm_assign_initial_value (const Symbol& sym, bool force)
     } else if (sym.has_init_ops() && sym.valuesource() == Symbol::DefaultVal) {
         // Handle init ops.
         build_llvm_code (sym.initbegin(), sym.initend());
-    } else if (! sym.lockgeom() && ! sym.typespec().is_closure()) {
-        // geometrically-varying param; memcpy its default value
+    } else if ((! sym.lockgeom() || sym.interactive()) &&
+               ! sym.typespec().is_closure()) {
+        // geometrically-varying or interactive param; memcpy its value
+        // from the instance, where ReParameter may change it later
         TypeDesc t = sym.typespec().simpletype();
         ll.op_memcpy (llvm_void_ptr (sym), ll.constant_ptr (sym.data()),
                       t.size(), t.basesize() /*align*/);
@@ -692,13 +740,28 @@ BackendLLVM::build_llvm_code (int beginop, int endop, llvm::BasicBlock *bb)
         const Opcode& op = inst()->ops()[opnum];
         const OpDescriptor *opd = shadingsys().op_descriptor (op.opname());
         if (opd && opd->llvmgen) {
+            if (ll.debug_is_enabled() && op.sourcefile())
+                ll.debug_set_location (op.sourcefile(), op.sourceline());
             if (shadingsys().debug_uninit() /* debug uninitialized vals */)
                 llvm_generate_debug_uninit (op);
             if (shadingsys().llvm_debug_ops())
                 llvm_generate_debug_op_printf (op);
+            // Time the expensive ops individually, if asked
+            bool profile_op = shadingsys().profile_layers() >= 2 &&
+                              (opd->flags & OpDescriptor::Profiled) &&
+                              ! use_optix();
+            if (profile_op)
+                ll.call_function ("osl_profile_enter", sg_void_ptr());
             bool ok = (*opd->llvmgen) (*this, opnum);
             if (! ok)
                 return false;
+            if (profile_op) {
+                int slot = shadingsys().profile_slot (group().name(),
+                                         inst()->layername(), op.opname(),
+                                         op.sourcefile(), op.sourceline());
+                ll.call_function ("osl_profile_exit", sg_void_ptr(),
+                                  ll.constant(slot), ll.constant(0));
+            }
             if (shadingsys().debug_nan() /* debug NaN/Inf */
                 && op.farthest_jump() < 0 /* Jumping ops don't need it */) {
                 llvm_generate_debugnan (op);
@@ -812,6 +875,8 @@ BackendLLVM::build_llvm_instance (bool groupentry)
                              !is_entry_layer, // fastcall for non-entry layer functions
                              ll.type_void(), // return type
                              llvm_type_sg_ptr(), llvm_type_groupdata_ptr()));
+    if (pgo_cold_layer (layer()))
+        ll.mark_cold_function (ll.current_function());
 
     // Get shader globals and groupdata pointers
     m_llvm_shaderglobals_ptr = ll.current_function_arg(0); //arg_it++;
@@ -822,6 +887,17 @@ BackendLLVM::build_llvm_instance (bool groupentry)
 
     // Set up a new IR builder
     ll.new_builder (entry_bb);
+    if (ll.debug_is_enabled()) {
+        // Locate the function at the first op of main, if any
+        const OpcodeVec &ops (inst()->ops());
+        int mainbegin = inst()->maincodebegin();
+        if (mainbegin < (int)ops.size() && ops[mainbegin].sourcefile())
+            ll.debug_push_function (unique_layer_name, ops[mainbegin].sourcefile(),
+                                    ops[mainbegin].sourceline());
+        else
+            ll.debug_push_function (unique_layer_name,
+                                    ustring(inst()->shadername()), 0);
+    }
 
     llvm::Value *layerfield = layer_run_ref(layer_remap(layer()));
     if (is_entry_layer && ! group().is_last_layer(layer())) {
@@ -853,6 +929,10 @@ BackendLLVM::build_llvm_instance (bool groupentry)
         if (shadingsys().countlayerexecs())
             ll.call_function ("osl_incr_layers_executed", sg_void_ptr());
     }
+    if (m_pgo_instrument)
+        ll.call_function ("osl_pgo_count", sg_void_ptr(), ll.constant (layer()));
+    if (shadingsys().profile_layers() && ! use_optix())
+        ll.call_function ("osl_profile_enter", sg_void_ptr());
 
     // Setup the symbols
     m_named_values.clear ();
@@ -924,7 +1004,8 @@ BackendLLVM::build_llvm_instance (bool groupentry)
         // parameter initialization for this layer.
         for (int i = 0;  i < group().nlayers()-1;  ++i) {
             ShaderInstance *gi = group()[i];
-            if (!gi->unused() && !gi->empty_instance() && !gi->run_lazily())
+            if (!gi->unused() && !gi->empty_instance() &&
+                (!gi->run_lazily() || pgo_run_eagerly (i)))
                 llvm_call_layer (i, true /* unconditionally run */);
         }
     }
@@ -1005,6 +1086,13 @@ BackendLLVM::build_llvm_instance (bool groupentry)
     // llvm_gen_debug_printf ("done copying connections");
 
     // All done
+    if (shadingsys().profile_layers() && ! use_optix()) {
+        int slot = shadingsys().profile_slot (group().name(),
+                                              inst()->layername(), ustring(),
+                                              ustring(inst()->shadername()), 0);
+        ll.call_function ("osl_profile_exit", sg_void_ptr(),
+                          ll.constant(slot), ll.constant(1));
+    }
     if (shadingsys().llvm_debug_layers())
         llvm_gen_debug_printf (Strutil::sprintf("exit layer %d %s %s",
                                this->layer(), inst()->layername(), inst()->shadername()));
@@ -1015,6 +1103,7 @@ BackendLLVM::build_llvm_instance (bool groupentry)
                   << "/" << group().nlayers() << " after llvm  = " 
                   << ll.bitcode_string(ll.current_function()) << "\n";
 
+    ll.debug_pop_function ();
     ll.end_builder();  // clear the builder
 
     return ll.current_function();
@@ -1101,6 +1190,7 @@ BackendLLVM::run ()
     // of ShadingSystemImpl::optimize_group.
     OIIO::Timer timer;
     std::string err;
+    bool jit_cache = ! use_optix() && shadingsys().llvm_jit_cache().size();
 
     {
 #ifdef OSL_LLVM_NO_BITCODE
@@ -1133,9 +1223,16 @@ BackendLLVM::run ()
     ASSERT (ll.module());
 #endif
 
+    // If the machine code may be kept in the JIT cache, it must not embed
+    // any addresses, which would be meaningless to another process (and
+    // would make the IR, and so the cache key, different every run).
+    if (jit_cache)
+        ll.relocatable_constants ();
+
     // Create the ExecutionEngine. We don't create an ExecutionEngine in the
     // OptiX case, because we are using the NVPTX backend and not MCJIT
-    if (! use_optix() && ! ll.make_jit_execengine (&err)) {
+    if (! use_optix() &&
+        ! ll.make_jit_execengine (&err, shadingsys().llvm_profiling_events())) {
         shadingcontext()->error ("Failed to create engine: %s\n", err.c_str());
         ASSERT (0);
         return;
@@ -1171,20 +1268,41 @@ BackendLLVM::run ()
 
     initialize_llvm_group ();
 
+    // Attach OSL source locations to the generated code, if asked.
+    if (shadingsys().llvm_debugging_symbols() && ! use_optix())
+        ll.debug_setup_compile_unit (group().name().string());
+
+    // Profile-guided re-JIT: either this is a rebuild guided by the counts
+    // that an earlier build of the group collected, or (if "pgo_samples"
+    // is set) this build should collect them.
+    if (! use_optix()) {
+        if (group().m_pgo_feedback && group().m_pgo_feedback->shades > 0)
+            m_pgo_feedback = group().m_pgo_feedback.get();
+        else if (shadingsys().pgo_samples() > 0 && ! group().m_respecialized &&
+                 group().m_original_spec.size()) {
+            group().m_pgo = std::make_shared<PGOProfile> (nlayers);
+            m_pgo_instrument = group().m_pgo.get();
+        }
+    }
+
     // Generate the LLVM IR for each layer.  Skip unused layers.
     m_llvm_local_mem = 0;
     llvm::Function* init_func = build_llvm_init ();
     std::vector<llvm::Function*> funcs (nlayers, NULL);
+    m_stat_layer_irgen_time.assign (nlayers, 0.0);
     for (int layer = 0; layer < nlayers; ++layer) {
         set_inst (layer);
         if (m_layer_remap[layer] != -1) {
             // If no entry points were specified, the last layer is special,
             // it's the single entry point for the whole group.
             bool is_single_entry = (layer == (nlayers-1) && group().num_entry_layers() == 0);
+            OIIO::Timer layertimer;
             funcs[layer] = build_llvm_instance (is_single_entry);
+            m_stat_layer_irgen_time[layer] = layertimer();
         }
     }
     // llvm::Function* entry_func = group().num_entry_layers() ? NULL : funcs[m_num_used_layers-1];
+    ll.debug_finalize ();
     m_stat_llvm_irgen_time += timer.lap();
 
     if (shadingsys().m_max_local_mem_KB &&
@@ -1227,9 +1345,52 @@ BackendLLVM::run ()
         }
     }
 
-    // Optimize the LLVM IR unless it's a do-nothing group.
-    if (! group().does_nothing())
-        ll.do_optimize();
+    // If there is a JIT cache, look for machine code previously compiled
+    // from this exact IR. Since constants were made relocatable above,
+    // the IR refers to ustrings, texture handles, and the like only by
+    // symbolic names that are bound to this process's addresses at link
+    // time, so the same group hashes the same in every process. On a
+    // hit, there is no need to optimize the IR, since the cached object
+    // will be loaded in place of generating code for the module.
+    // Instrumented code is never cached, since it is specific to this
+    // group's counters and is only run briefly.
+    bool jit_cache_hit = false;
+    if (jit_cache && ! m_pgo_instrument) {
+        // The entry points are named by group and instance IDs, which
+        // depend on what else this process has loaded; name them by
+        // position in the group instead, so the IR is the same anywhere.
+        ll.func_name (init_func, Strutil::sprintf ("%s_init", group().name()));
+        for (int layer = 0; layer < nlayers; ++layer) {
+            if (funcs[layer])
+                ll.func_name (funcs[layer], Strutil::sprintf ("%s_%s_layer%d",
+                                  group().name(), group()[layer]->layername(), layer));
+        }
+        std::vector<llvm::Function*> groupfuncs (funcs);
+        groupfuncs.push_back (init_func);
+        std::string extra = Strutil::sprintf ("%s %d %llu", OSL_LIBRARY_VERSION_STRING,
+                                              shadingsys().llvm_optimize(),
+                                              (unsigned long long)llvm_ops_library_hash());
+        std::string key = ll.func_hash (groupfuncs, extra);
+        size_t bytes_read = 0;
+        jit_cache_hit = ll.use_object_cache (shadingsys().llvm_jit_cache().string(),
+                                             key, &bytes_read);
+        if (jit_cache_hit) {
+            shadingsys().m_stat_jit_cache_hits += 1;
+            shadingsys().m_stat_jit_cache_bytes_read += bytes_read;
+        } else {
+            shadingsys().m_stat_jit_cache_misses += 1;
+        }
+    }
+
+    // Optimize the LLVM IR unless it's a do-nothing group.  This is one
+    // serial pass over the whole module: the layers call each other and
+    // share the group data type, all within this thread's LLVMContext,
+    // so they can't be split up and optimized on separate threads. Use
+    // optimize_all_groups or async_jit to spread groups over cores.
+    // The per-function passes are run (and timed) layer by layer.
+    m_stat_layer_opt_time.assign (nlayers, 0.0);
+    if (! group().does_nothing() && ! jit_cache_hit)
+        ll.do_optimize (NULL, &funcs, &m_stat_layer_opt_time);
 
     m_stat_llvm_opt_time += timer.lap();
 
@@ -1256,6 +1417,18 @@ BackendLLVM::run ()
         }
     }
 
+    // Note how big each layer ended up, for the compile report, while
+    // we still have the IR.  On a JIT cache hit the IR was never
+    // optimized, so these are the sizes before optimization.
+    m_stat_layer_instructions.assign (nlayers, 0);
+    size_t total_instructions = ll.func_instruction_count (init_func);
+    for (int layer = 0; layer < nlayers; ++layer)
+        if (funcs[layer]) {
+            m_stat_layer_instructions[layer] = ll.func_instruction_count (funcs[layer]);
+            total_instructions += m_stat_layer_instructions[layer];
+        }
+    m_stat_layer_jit_time.assign (nlayers, 0.0);
+
     if (use_optix()) {
         // Create an llvm::Module from the renderer-supplied library bitcode
         std::vector<char>& bitcode = shadingsys().m_lib_bitcode;
@@ -1275,8 +1448,17 @@ BackendLLVM::run ()
     }
     else {
         // Force the JIT to happen now and retrieve the JITed function pointers
-        // for the initialization and all public entry points.
+        // for the initialization and all public entry points.  The first
+        // lookup generates the machine code for the whole module at once;
+        // share that out among the layers by their size, which is what
+        // codegen time mostly tracks.  (On a cache hit it only loads.)
+        OIIO::Timer codegentimer;
         group().llvm_compiled_init ((RunLLVMGroupFunc) ll.getPointerToFunction(init_func));
+        double codegen_time = codegentimer();
+        if (! jit_cache_hit && total_instructions)
+            for (int layer = 0; layer < nlayers; ++layer)
+                m_stat_layer_jit_time[layer] = codegen_time
+                    * m_stat_layer_instructions[layer] / total_instructions;
         for (int layer = 0; layer < nlayers; ++layer) {
             llvm::Function* f = funcs[layer];
             if (f && group().is_entry_layer (layer))
@@ -1317,6 +1499,40 @@ BackendLLVM::run ()
                            m_stat_llvm_irgen_time, m_stat_llvm_opt_time,
                            m_stat_llvm_jit_time,
                            m_llvm_local_mem/1024);
+        // Break out the most expensive few layers, which is where to look
+        // when a big group is slow to compile.  A layer's opt time is
+        // its own per-function passes; the module-wide passes (inlining
+        // and the like) can't be split up, so they are reported apart.
+        // Its jit time is its share of codegen, going by size.
+        std::vector<int> layers;
+        std::vector<double> layer_time (nlayers, 0.0);
+        double layers_opt_time = 0.0;
+        for (int layer = 0; layer < nlayers; ++layer)
+            if (funcs[layer]) {
+                layers.push_back (layer);
+                layer_time[layer] = m_stat_layer_irgen_time[layer]
+                                  + m_stat_layer_opt_time[layer]
+                                  + m_stat_layer_jit_time[layer];
+                layers_opt_time += m_stat_layer_opt_time[layer];
+            }
+        std::sort (layers.begin(), layers.end(), [&](int a, int b) {
+            return layer_time[a] > layer_time[b];
+        });
+        const int maxreport = 5;
+        if ((int)layers.size() > maxreport)
+            layers.resize (maxreport);
+        if (! jit_cache_hit && ! group().does_nothing())
+            shadingcontext()->info ("      module-wide opt: %1.3fs",
+                                    std::max (0.0, m_stat_llvm_opt_time - layers_opt_time));
+        for (int layer : layers)
+            shadingcontext()->info ("      layer %d %s: %1.3fs ir, %1.3fs opt, ~%1.3fs jit, %d instructions %s",
+                                    layer, group()[layer]->layername(),
+                                    m_stat_layer_irgen_time[layer],
+                                    m_stat_layer_opt_time[layer],
+                                    m_stat_layer_jit_time[layer],
+                                    (int)m_stat_layer_instructions[layer],
+                                    jit_cache_hit ? "before opt (JIT cache hit)"
+                                                  : "after opt");
     }
 }
 
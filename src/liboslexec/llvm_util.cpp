@@ -29,7 +29,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <memory>
 #include <cinttypes>
+#include <cstdio>
 #include <OpenImageIO/thread.h>
+#include <OpenImageIO/strutil.h>
+#include <OpenImageIO/timer.h>
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
 
 #include <OSL/oslconfig.h>
@@ -47,6 +50,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/DebugInfo/DIContext.h>
+#include <llvm/DebugInfo/DWARF/DWARFContext.h>
+#include <llvm/Object/SymbolSize.h>
 #include <llvm/Linker/Linker.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/ErrorOr.h>
@@ -56,10 +64,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/Support/ManagedStatic.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/ADT/StringExtras.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/PrettyStackTrace.h>
@@ -78,6 +90,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <llvm/Transforms/InstCombine/InstCombine.h>
 #endif
 
+#include <algorithm>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 // additional includes for PTX generation
 #include <llvm/Transforms/Utils/SymbolRewriter.h>
 #include <llvm/Transforms/Utils/Cloning.h>
@@ -165,15 +184,51 @@ LLVM_Util::total_jit_memory_held ()
 
 
 
+/// RelocTable - When constants are relocatable, each distinct address
+/// baked into the generated code is replaced by a reference to an
+/// external symbol, named in the order the addresses are first seen.
+/// The names (unlike the addresses) are the same in every process that
+/// generates the same code, so the IR can key a persistent cache. The
+/// table maps the names back to this process's addresses when the
+/// object (freshly compiled or loaded from the cache) is linked.
+class LLVM_Util::RelocTable {
+public:
+    const std::string &name (const void *p) {
+        auto found = m_names.find (p);
+        if (found != m_names.end())
+            return found->second;
+        std::string name = OIIO::Strutil::sprintf ("__osl_reloc_%d", (int)m_names.size());
+        m_addrs[name] = uint64_t (uintptr_t (p));
+        return m_names[p] = name;
+    }
+
+    // Return the address of the named symbol, or 0 if it isn't ours.
+    uint64_t address (const std::string &name) const {
+        auto found = m_addrs.find (name);
+        if (found == m_addrs.end() && name.size() && name[0] == '_')
+            found = m_addrs.find (name.substr(1));  // platform mangling
+        return found == m_addrs.end() ? 0 : found->second;
+    }
+
+private:
+    std::unordered_map<const void*, std::string> m_names;
+    std::unordered_map<std::string, uint64_t> m_addrs;
+};
+
+
+
 /// MemoryManager - Create a shell that passes on requests
 /// to a real LLVMMemoryManager underneath, but can be retained after the
 /// dummy is destroyed.  Also, we don't pass along any deallocations.
 class LLVM_Util::MemoryManager : public LLVMMemoryManager {
 protected:
     LLVMMemoryManager *mm;  // the real one
+    std::shared_ptr<RelocTable> relocs;  // resolves relocatable constants
 public:
 
-    MemoryManager(LLVMMemoryManager *realmm) : mm(realmm) {}
+    MemoryManager(LLVMMemoryManager *realmm,
+                  std::shared_ptr<RelocTable> relocs=nullptr)
+        : mm(realmm), relocs(relocs) {}
     
     virtual void notifyObjectLoaded(llvm::ExecutionEngine *EE, const llvm::object::ObjectFile &oi) {
         mm->notifyObjectLoaded (EE, oi);
@@ -220,6 +275,10 @@ public:
     }
 
     virtual uint64_t getSymbolAddress(const std::string &Name) {
+        if (relocs) {
+            if (uint64_t addr = relocs->address (Name))
+                return addr;
+        }
         return mm->getSymbolAddress (Name);
     }
     virtual bool finalizeMemory(std::string *ErrMsg = 0) {
@@ -229,6 +288,169 @@ public:
 
 
 
+/// ObjectCache - Persistent cache of JIT-compiled machine code. Each
+/// object is stored as its own file, named by its key, in the cache
+/// directory.  An instance serves just the one module compiled by its
+/// ExecutionEngine.
+class LLVM_Util::ObjectCache : public llvm::ObjectCache {
+public:
+    ObjectCache (const std::string &dir, const std::string &key)
+        : m_path(dir + "/" + key + ".o") {}
+
+    // Read the cached object for our key into memory. Return true if
+    // it was found.
+    bool load () {
+        auto buf = llvm::MemoryBuffer::getFile (m_path);
+        if (! buf)
+            return false;
+        m_cached = std::move (*buf);
+        return true;
+    }
+
+    size_t cached_size () const {
+        return m_cached ? m_cached->getBufferSize() : 0;
+    }
+
+    virtual void notifyObjectCompiled (const llvm::Module *M,
+                                       llvm::MemoryBufferRef obj) {
+        // Write to a uniquely named file and then rename it into place,
+        // so that other threads or processes sharing the cache never
+        // see a partially written object.
+        int fd = -1;
+        llvm::SmallString<256> tmppath;
+        if (llvm::sys::fs::createUniqueFile (m_path + "-%%%%%%%%.tmp", fd, tmppath))
+            return;
+        bool ok;
+        {
+            llvm::raw_fd_ostream out (fd, true /* close when done */);
+            out << obj.getBuffer();
+            out.close ();
+            ok = ! out.has_error();
+            out.clear_error ();
+        }
+        if (! ok || llvm::sys::fs::rename (tmppath, m_path))
+            llvm::sys::fs::remove (tmppath);
+    }
+
+    virtual std::unique_ptr<llvm::MemoryBuffer> getObject (const llvm::Module *M) {
+        if (! m_cached)
+            return nullptr;
+        return llvm::MemoryBuffer::getMemBufferCopy (m_cached->getBuffer(),
+                                                     m_cached->getBufferIdentifier());
+    }
+
+private:
+    std::string m_path;
+    std::unique_ptr<llvm::MemoryBuffer> m_cached;
+};
+
+
+
+/// PerfMapListener - Append the address ranges of each JIT-compiled
+/// function to /tmp/perf-<pid>.map, the file in which perf (and other
+/// sampling profilers that follow its convention) look up the names of
+/// code that doesn't belong to any binary. If the object has a line
+/// table, there is an entry for each run of code from a single source
+/// line, named "function [file:line]".
+class LLVM_Util::PerfMapListener : public llvm::JITEventListener {
+public:
+    static PerfMapListener *instance () {
+        // It has no state, so one is shared by all the engines.
+        static PerfMapListener listener;
+        return &listener;
+    }
+
+#if OSL_LLVM_VERSION >= 80
+    virtual void notifyObjectLoaded (ObjectKey /*key*/,
+                                     const llvm::object::ObjectFile &obj,
+                                     const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+        write_map (obj, info);
+    }
+#else
+    virtual void NotifyObjectEmitted (const llvm::object::ObjectFile &obj,
+                                      const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+        write_map (obj, info);
+    }
+#endif
+
+private:
+    void write_map (const llvm::object::ObjectFile &obj,
+                    const llvm::RuntimeDyld::LoadedObjectInfo &info)
+    {
+#ifndef _WIN32
+        // The "debug" object has its sections' load addresses applied.
+        llvm::object::OwningBinary<llvm::object::ObjectFile> debugobj =
+            info.getObjectForDebug (obj);
+        if (! debugobj.getBinary())
+            return;
+        const llvm::object::ObjectFile &dobj (*debugobj.getBinary());
+#if OSL_LLVM_VERSION >= 60
+        std::unique_ptr<llvm::DIContext> dwarf = llvm::DWARFContext::create (dobj);
+#else
+        std::unique_ptr<llvm::DIContext> dwarf (new llvm::DWARFContextInMemory (dobj));
+#endif
+        std::string map;
+        for (auto&& symsize : llvm::object::computeSymbolSizes (dobj)) {
+            const llvm::object::SymbolRef &sym (symsize.first);
+            uint64_t size = symsize.second;
+            auto type = sym.getType ();
+            if (! type) {
+                llvm::consumeError (type.takeError());
+                continue;
+            }
+            if (*type != llvm::object::SymbolRef::ST_Function || ! size)
+                continue;
+            auto name = sym.getName ();
+            if (! name) {
+                llvm::consumeError (name.takeError());
+                continue;
+            }
+            auto addr = sym.getAddress ();
+            if (! addr) {
+                llvm::consumeError (addr.takeError());
+                continue;
+            }
+            uint64_t begin = *addr, end = *addr + size;
+            llvm::DILineInfoTable lines =
+                dwarf->getLineInfoForAddressRange (begin, size);
+            if (lines.empty() || lines[0].first > begin) {
+                uint64_t e = lines.empty() ? end : lines[0].first;
+                map += OIIO::Strutil::sprintf ("%llx %llx %s\n",
+                                               (unsigned long long) begin,
+                                               (unsigned long long) (e - begin),
+                                               name->str());
+            }
+            for (size_t i = 0, n = lines.size();  i < n;  ) {
+                // Merge consecutive rows for the same line
+                const llvm::DILineInfo &line (lines[i].second);
+                uint64_t b = lines[i].first;
+                for (++i;  i < n && lines[i].second.Line == line.Line &&
+                           lines[i].second.FileName == line.FileName;  ++i)
+                    ;
+                uint64_t e = i < n ? lines[i].first : end;
+                if (e > b)
+                    map += OIIO::Strutil::sprintf ("%llx %llx %s [%s:%d]\n",
+                                                   (unsigned long long) b,
+                                                   (unsigned long long) (e - b),
+                                                   name->str(), line.FileName,
+                                                   line.Line);
+            }
+        }
+        if (map.empty())
+            return;
+        static OIIO::mutex map_mutex;
+        OIIO::lock_guard lock (map_mutex);
+        std::string filename = OIIO::Strutil::sprintf ("/tmp/perf-%d.map", getpid());
+        if (FILE *f = fopen (filename.c_str(), "a")) {
+            fwrite (map.data(), 1, map.size(), f);
+            fclose (f);
+        }
+#endif
+    }
+};
+
+
+
 class LLVM_Util::IRBuilder : public llvm::IRBuilder<llvm::ConstantFolder,
                                                llvm::IRBuilderDefaultInserter> {
     typedef llvm::IRBuilder<llvm::ConstantFolder,
@@ -245,7 +467,8 @@ LLVM_Util::LLVM_Util (int debuglevel)
       m_builder(NULL), m_llvm_jitmm(NULL),
       m_current_function(NULL),
       m_llvm_module_passes(NULL), m_llvm_func_passes(NULL),
-      m_llvm_exec(NULL)
+      m_func_passes_first(true), m_llvm_exec(NULL), m_llvm_debug_builder(NULL), m_debug_cu(NULL),
+      m_debug_function(NULL), m_debug_scope(NULL), m_debug_scope_file(NULL)
 {
     SetupLLVM ();
     m_thread = PerThreadInfo::get();
@@ -309,6 +532,7 @@ LLVM_Util::~LLVM_Util ()
     delete m_llvm_module_passes;
     delete m_llvm_func_passes;
     delete m_builder;
+    delete m_llvm_debug_builder;
     module (NULL);
     // DO NOT delete m_llvm_jitmm;  // just the dummy wrapper around the real MM
 }
@@ -437,7 +661,7 @@ LLVM_Util::end_builder ()
 
 
 llvm::ExecutionEngine *
-LLVM_Util::make_jit_execengine (std::string *err)
+LLVM_Util::make_jit_execengine (std::string *err, bool profiling_events)
 {
     execengine (NULL);   // delete and clear any existing engine
     if (err)
@@ -449,7 +673,7 @@ LLVM_Util::make_jit_execengine (std::string *err)
 
     // We are actually holding a LLVMMemoryManager
     engine_builder.setMCJITMemoryManager (std::unique_ptr<llvm::RTDyldMemoryManager>
-        (new MemoryManager(m_llvm_jitmm)));
+        (new MemoryManager(m_llvm_jitmm, m_relocs)));
 
     engine_builder.setOptLevel (llvm::CodeGenOpt::Default);
 
@@ -468,6 +692,18 @@ LLVM_Util::make_jit_execengine (std::string *err)
     if (vtuneProfiler)
         m_llvm_exec->RegisterJITEventListener (vtuneProfiler);
 
+    if (profiling_events) {
+        m_llvm_exec->RegisterJITEventListener (PerfMapListener::instance());
+#if OSL_LLVM_VERSION >= 80
+        // Like the Intel one, this is a stub that returns nullptr unless
+        // LLVM was built with -DLLVM_USE_PERF=ON. If so, it writes a
+        // jitdump file (with line info) for "perf inject --jit".
+        auto perfProfiler = llvm::JITEventListener::createPerfJITEventListener();
+        if (perfProfiler)
+            m_llvm_exec->RegisterJITEventListener (perfProfiler);
+#endif
+    }
+
     // Force it to JIT as soon as we ask it for the code pointer,
     // don't take any chances that it might JIT lazily, since we
     // will be stealing the JIT code memory from under its nose and
@@ -483,6 +719,69 @@ LLVM_Util::execengine (llvm::ExecutionEngine *exec)
 {
     delete m_llvm_exec;
     m_llvm_exec = exec;
+    // Any object cache belonged to the old engine
+    m_object_cache.reset ();
+}
+
+
+
+std::string
+LLVM_Util::func_hash (const std::vector<llvm::Function*> &funcs,
+                      const std::string &extra)
+{
+    llvm::SHA1 sha;
+    sha.update (OSL_LLVM_FULL_VERSION);
+    sha.update (llvm::sys::getProcessTriple());
+    sha.update (llvm::sys::getHostCPUName());
+    // Two machines that report the same CPU name may still differ in the
+    // instruction set extensions available (or enabled), so fold in the
+    // full feature list too, sorted since the map is unordered.
+    llvm::StringMap<bool> features;
+    if (llvm::sys::getHostCPUFeatures (features)) {
+        std::vector<std::string> featurelist;
+        for (auto &f : features)
+            featurelist.push_back ((f.second ? "+" : "-") + f.first().str());
+        std::sort (featurelist.begin(), featurelist.end());
+        for (auto &f : featurelist)
+            sha.update (f);
+    }
+    sha.update (extra);
+    for (auto f : funcs) {
+        if (f)
+            sha.update (bitcode_string (f));
+    }
+    return llvm::toHex (sha.result());
+}
+
+
+
+void
+LLVM_Util::relocatable_constants ()
+{
+    ASSERT (! m_llvm_exec && "must precede make_jit_execengine");
+    if (! m_relocs)
+        m_relocs = std::make_shared<RelocTable> ();
+}
+
+
+
+bool
+LLVM_Util::use_object_cache (const std::string &dir, const std::string &key,
+                             size_t *bytes_read)
+{
+    llvm::ExecutionEngine *exec = execengine();
+    if (dir.empty() || key.empty()) {
+        exec->setObjectCache (nullptr);
+        m_object_cache.reset ();
+        return false;
+    }
+    llvm::sys::fs::create_directories (dir);
+    m_object_cache.reset (new ObjectCache (dir, key));
+    exec->setObjectCache (m_object_cache.get());
+    bool found = m_object_cache->load ();
+    if (bytes_read)
+        *bytes_read = m_object_cache->cached_size();
+    return found;
 }
 
 
@@ -509,6 +808,100 @@ LLVM_Util::InstallLazyFunctionCreator (void* (*P)(const std::string &))
 
 
 
+void
+LLVM_Util::debug_setup_compile_unit (const std::string &name)
+{
+    ASSERT (m_llvm_module);
+    delete m_llvm_debug_builder;
+    if (! m_llvm_module->getModuleFlag ("Debug Info Version"))
+        m_llvm_module->addModuleFlag (llvm::Module::Warning,
+                                      "Debug Info Version",
+                                      llvm::DEBUG_METADATA_VERSION);
+    m_llvm_debug_builder = new llvm::DIBuilder (*m_llvm_module);
+    m_debug_cu = m_llvm_debug_builder->createCompileUnit (
+                    llvm::dwarf::DW_LANG_C,
+                    m_llvm_debug_builder->createFile (name, "."),
+                    "OSL", true /* optimized */, "", 0 /* runtime version */,
+                    "", llvm::DICompileUnit::LineTablesOnly);
+    m_debug_function = NULL;
+    m_debug_scope = NULL;
+    m_debug_scope_file = NULL;
+}
+
+
+
+void
+LLVM_Util::debug_push_function (const std::string &function_name,
+                                OIIO::ustring sourcefile, int sourceline)
+{
+    if (! m_llvm_debug_builder || ! m_current_function)
+        return;
+    llvm::DIFile *file = m_llvm_debug_builder->createFile (sourcefile.string(), ".");
+    llvm::DISubroutineType *type = m_llvm_debug_builder->createSubroutineType (
+        m_llvm_debug_builder->getOrCreateTypeArray (llvm::ArrayRef<llvm::Metadata*>()));
+    sourceline = std::max (sourceline, 0);
+#if OSL_LLVM_VERSION >= 80
+    llvm::DISubprogram *sp = m_llvm_debug_builder->createFunction (
+        file, function_name, llvm::StringRef(), file, sourceline, type,
+        sourceline, llvm::DINode::FlagZero,
+        llvm::DISubprogram::SPFlagDefinition | llvm::DISubprogram::SPFlagOptimized);
+#else
+    llvm::DISubprogram *sp = m_llvm_debug_builder->createFunction (
+        file, function_name, llvm::StringRef(), file, sourceline, type,
+        false /* local to unit */, true /* definition */, sourceline,
+        llvm::DINode::FlagZero, true /* optimized */);
+#endif
+    m_current_function->setSubprogram (sp);
+    m_debug_function = sp;
+    m_debug_scope = sp;
+    m_debug_scope_file = sourcefile.c_str();
+    debug_set_location (sourcefile, sourceline);
+}
+
+
+
+void
+LLVM_Util::debug_pop_function ()
+{
+    if (! m_llvm_debug_builder)
+        return;
+    if (m_builder)
+        m_builder->SetCurrentDebugLocation (llvm::DebugLoc());
+    m_debug_function = NULL;
+    m_debug_scope = NULL;
+    m_debug_scope_file = NULL;
+}
+
+
+
+void
+LLVM_Util::debug_set_location (OIIO::ustring sourcefile, int sourceline)
+{
+    if (! m_llvm_debug_builder || ! m_debug_function)
+        return;
+    // Ops inlined from a header (e.g. stdosl.h) keep the layer's
+    // subprogram but switch files via a lexical block.
+    if (sourcefile.c_str() != m_debug_scope_file) {
+        m_debug_scope = m_llvm_debug_builder->createLexicalBlockFile (
+            m_debug_function,
+            m_llvm_debug_builder->createFile (sourcefile.string(), "."));
+        m_debug_scope_file = sourcefile.c_str();
+    }
+    builder().SetCurrentDebugLocation (
+        llvm::DebugLoc::get (std::max (sourceline, 0), 0, m_debug_scope));
+}
+
+
+
+void
+LLVM_Util::debug_finalize ()
+{
+    if (m_llvm_debug_builder)
+        m_llvm_debug_builder->finalize ();
+}
+
+
+
 void
 LLVM_Util::setup_optimization_passes (int optlevel)
 {
@@ -532,9 +925,13 @@ LLVM_Util::setup_optimization_passes (int optlevel)
         // builder.DisableUnrollLoops = true;
         builder.populateFunctionPassManager (fpm);
         builder.populateModulePassManager (mpm);
+        m_func_passes_first = true;
     } else {
         // Unknown choices for llvm_optimize: use the same basic
-        // set of passes that we always have.
+        // set of passes that we always have. Everything after inlining
+        // is per-function, so it goes in fpm, which do_optimize runs
+        // (function by function) after the module passes.
+        m_func_passes_first = false;
 
         // Always add verifier?
         mpm.add (llvm::createVerifierPass());
@@ -548,28 +945,30 @@ LLVM_Util::setup_optimization_passes (int optlevel)
         // Inline small functions
         mpm.add (llvm::createFunctionInliningPass());  // 250?
         // Eliminate early returns
-        mpm.add (llvm::createUnifyFunctionExitNodesPass());
+        fpm.add (llvm::createUnifyFunctionExitNodesPass());
         // resassociate exprssions (a = x + (3 + y) -> a = x + y + 3)
-        mpm.add (llvm::createReassociatePass());
+        fpm.add (llvm::createReassociatePass());
         // Eliminate common sub-expressions
-        mpm.add (llvm::createGVNPass());
+        fpm.add (llvm::createGVNPass());
         // Constant propagation with SCCP
-        mpm.add (llvm::createSCCPPass());
+        fpm.add (llvm::createSCCPPass());
         // More dead code elimination
-        mpm.add (llvm::createAggressiveDCEPass());
+        fpm.add (llvm::createAggressiveDCEPass());
         // Combine instructions where possible -- peephole opts & bit-twiddling
-        mpm.add (llvm::createInstructionCombiningPass());
+        fpm.add (llvm::createInstructionCombiningPass());
         // Simplify the call graph if possible (deleting unreachable blocks, etc.)
-        mpm.add (llvm::createCFGSimplificationPass());
+        fpm.add (llvm::createCFGSimplificationPass());
         // Try to make stuff into registers one last time.
-        mpm.add (llvm::createPromoteMemoryToRegisterPass());
+        fpm.add (llvm::createPromoteMemoryToRegisterPass());
     }
 }
 
 
 
 void
-LLVM_Util::do_optimize (std::string *out_err)
+LLVM_Util::do_optimize (std::string *out_err,
+                        const std::vector<llvm::Function*> *funcs,
+                        std::vector<double> *func_times)
 {
     ASSERT(m_llvm_module && "No module to optimize!");
 
@@ -579,9 +978,32 @@ LLVM_Util::do_optimize (std::string *out_err)
         return;
 #endif
 
+    if (func_times)
+        func_times->assign (funcs ? funcs->size() : 0, 0.0);
+    if (! m_func_passes_first)
+        m_llvm_module_passes->run (*m_llvm_module);
     m_llvm_func_passes->doInitialization();
-    m_llvm_module_passes->run (*m_llvm_module);
+    if (funcs) {
+        // The named functions one at a time, so that each can be timed.
+        for (size_t i = 0, e = funcs->size(); i < e; ++i) {
+            llvm::Function *f = (*funcs)[i];
+            if (! f || f->isDeclaration())
+                continue;
+            OIIO::Timer timer;
+            m_llvm_func_passes->run (*f);
+            if (func_times)
+                (*func_times)[i] = timer();
+        }
+    }
+    for (llvm::Function &f : *m_llvm_module) {
+        if (f.isDeclaration() ||
+            (funcs && std::find (funcs->begin(), funcs->end(), &f) != funcs->end()))
+            continue;
+        m_llvm_func_passes->run (f);
+    }
     m_llvm_func_passes->doFinalization();
+    if (m_func_passes_first)
+        m_llvm_module_passes->run (*m_llvm_module);
 }
 
 
@@ -933,6 +1355,11 @@ LLVM_Util::constant_ptr (void *p, llvm::PointerType *type)
 {
     if (! type)
         type = type_void_ptr();
+    if (m_relocs && p) {
+        llvm::Constant *sym = module()->getOrInsertGlobal (m_relocs->name (p),
+                                                           type_char());
+        return builder().CreatePointerCast (sym, type, "const pointer");
+    }
     return builder().CreateIntToPtr (constant (size_t (p)), type, "const pointer");
 }
 
@@ -941,6 +1368,8 @@ LLVM_Util::constant_ptr (void *p, llvm::PointerType *type)
 llvm::Value *
 LLVM_Util::constant (ustring s)
 {
+    if (m_relocs && s.c_str())
+        return constant_ptr ((void *)s.c_str(), type_string());
     // Create a const size_t with the ustring contents
     size_t bits = sizeof(size_t)*8;
     llvm::Value *str = llvm::ConstantInt::get (context(),
@@ -1110,6 +1539,15 @@ LLVM_Util::mark_fast_func_call (llvm::Value *funccall)
 
 
 
+void
+LLVM_Util::mark_cold_function (llvm::Function *func)
+{
+    func->addFnAttr (llvm::Attribute::Cold);
+    func->addFnAttr (llvm::Attribute::NoInline);
+}
+
+
+
 void
 LLVM_Util::op_branch (llvm::BasicBlock *block)
 {
@@ -1129,6 +1567,19 @@ LLVM_Util::op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
 
 
 
+void
+LLVM_Util::op_branch (llvm::Value *cond, llvm::BasicBlock *trueblock,
+                      llvm::BasicBlock *falseblock,
+                      uint32_t trueweight, uint32_t falseweight)
+{
+    llvm::MDBuilder mdbuilder (context());
+    builder().CreateCondBr (cond, trueblock, falseblock,
+                            mdbuilder.createBranchWeights (trueweight, falseweight));
+    set_insert_point (trueblock);
+}
+
+
+
 void
 LLVM_Util::set_insert_point (llvm::BasicBlock *block)
 {
@@ -1640,6 +2091,17 @@ LLVM_Util::delete_func_body (llvm::Function *func)
 
 
 
+size_t
+LLVM_Util::func_instruction_count (llvm::Function *func)
+{
+    size_t n = 0;
+    for (auto&& bb : *func)
+        n += bb.size();
+    return n;
+}
+
+
+
 bool
 LLVM_Util::func_is_empty (llvm::Function *func)
 {
@@ -1656,5 +2118,13 @@ LLVM_Util::func_name (llvm::Function *func)
 }
 
 
+
+void
+LLVM_Util::func_name (llvm::Function *func, const std::string &name)
+{
+    func->setName (name);
+}
+
+
 }; // namespace pvt
 OSL_NAMESPACE_EXIT
@@ -694,6 +694,18 @@ ColorSystem::from_rgb (StringParam tospace, const Color3& C, Context context)
 
 
 
+OSL_HOSTDEVICE bool
+ColorSystem::is_builtin_space (StringParam space) const
+{
+    return space == StringParams::RGB || space == StringParams::rgb
+        || space == StringParams::linear || space == m_colorspace
+        || space == StringParams::hsv || space == StringParams::hsl
+        || space == StringParams::YIQ || space == StringParams::XYZ
+        || space == StringParams::xyY || space == StringParams::sRGB;
+}
+
+
+
 template <typename COLOR> OSL_HOSTDEVICE COLOR
 ColorSystem::transformc (StringParam fromspace, StringParam tospace,
                          const COLOR& C, Context context)
@@ -46,6 +46,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   #undef OIIO_HAS_COLORPROCESSOR
 #endif
 
+#if OIIO_HAS_COLORPROCESSOR
+  #include <atomic>
+  #include <memory>
+  #include <vector>
+  #include <OpenImageIO/thread.h>
+#endif
+
 
 OSL_NAMESPACE_ENTER
 
@@ -110,6 +117,10 @@ public:
     template <typename Color> OSL_HOSTDEVICE Color
     ocio_transform (StringParam fromspace, StringParam tospace, const Color& C, Context);
 
+    /// Is this one of the spaces that transformc() converts itself? If
+    /// either space isn't, the whole conversion is left to OCIO.
+    OSL_HOSTDEVICE bool is_builtin_space (StringParam space) const;
+
     OSL_HOSTDEVICE StringParam colorspace() const { return m_colorspace; }
 
     OSL_HOSTDEVICE void error(StringParam src, StringParam dst, Context);
@@ -135,7 +146,11 @@ class OCIOColorSystem {
 #if OIIO_HAS_COLORPROCESSOR
 public:
 
-    OIIO::ColorProcessorHandle
+    /// Return the processor for the conversion, or NULL if the color
+    /// config doesn't know one. Processors are made once per (from,to)
+    /// pair and live as long as the OCIOColorSystem; looking up one that
+    /// was already made takes no locks.
+    const OIIO::ColorProcessor *
     load_transform(StringParam fromspace, StringParam tospace);
 
     const OIIO::ColorConfig& colorconfig () const { return m_colorconfig; }
@@ -144,10 +159,19 @@ private:
 
     OIIO::ColorConfig m_colorconfig; ///< OIIO/OCIO color configuration
 
-    // 1-item cache for the last requested custom color conversion processor
-    OIIO::ColorProcessorHandle m_last_colorproc;
-    ustring m_last_colorproc_fromspace;
-    ustring m_last_colorproc_tospace;
+    // Cache of every custom color conversion processor requested so far.
+    // Readers search the current table without locking. A miss makes the
+    // processor and, holding m_transforms_mutex, publishes a copy of the
+    // table with it added. Replaced tables are kept (in m_tables) because
+    // other threads may still be searching them.
+    struct Transform {
+        ustring fromspace, tospace;
+        OIIO::ColorProcessorHandle processor;  // NULL if there isn't one
+    };
+    typedef std::vector<Transform> TransformTable;
+    std::atomic<const TransformTable *> m_transforms {nullptr};
+    std::vector<std::unique_ptr<TransformTable>> m_tables;
+    OIIO::mutex m_transforms_mutex;
 #endif
 };
 
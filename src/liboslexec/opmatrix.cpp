@@ -164,15 +164,11 @@ osl_get_matrix (void *sg_, void *r, const char *from)
         MAT(r).makeIdentity ();
         return true;
     }
-    if (USTR(from) == Strings::shader) {
-        ctx->renderer()->get_matrix (sg, MAT(r), sg->shader2common, sg->time);
+    if (USTR(from) == Strings::shader || USTR(from) == Strings::object) {
+        ctx->get_matrix (sg, MAT(r), USTR(from), false);
         return true;
     }
-    if (USTR(from) == Strings::object) {
-        ctx->renderer()->get_matrix (sg, MAT(r), sg->object2common, sg->time);
-        return true;
-    }
-    int ok = ctx->renderer()->get_matrix (sg, MAT(r), USTR(from), sg->time);
+    int ok = ctx->get_matrix (sg, MAT(r), USTR(from), false);
     if (! ok) {
         MAT(r).makeIdentity();
         ShadingContext *ctx = (ShadingContext *)((ShaderGlobals *)sg)->context;
@@ -194,15 +190,11 @@ osl_get_inverse_matrix (void *sg_, void *r, const char *to)
         MAT(r).makeIdentity ();
         return true;
     }
-    if (USTR(to) == Strings::shader) {
-        ctx->renderer()->get_inverse_matrix (sg, MAT(r), sg->shader2common, sg->time);
-        return true;
-    }
-    if (USTR(to) == Strings::object) {
-        ctx->renderer()->get_inverse_matrix (sg, MAT(r), sg->object2common, sg->time);
+    if (USTR(to) == Strings::shader || USTR(to) == Strings::object) {
+        ctx->get_matrix (sg, MAT(r), USTR(to), true);
         return true;
     }
-    int ok = ctx->renderer()->get_inverse_matrix (sg, MAT(r), USTR(to), sg->time);
+    int ok = ctx->get_matrix (sg, MAT(r), USTR(to), true);
     if (! ok) {
         MAT(r).makeIdentity ();
         ShadingContext *ctx = (ShadingContext *)((ShaderGlobals *)sg)->context;
@@ -33,8 +33,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /////////////////////////////////////////////////////////////////////////
 // Notes on how messages work:
 //
-// The messages are stored in a ParamValueList in the ShadingContext.
-// For simple types, just slurp them up into the PVL.
+// The messages are stored in the MessageList of the ShadingContext, a
+// hash table keyed on the message name that is reset for each shade.
+// When the name is a constant, BackendLLVM also passes a fixed slot
+// number, which lets MessageList skip the hashing altogether.
 //
 // FIXME -- setmessage only stores message values, not derivs, so
 // getmessage only retrieves the values and has zero derivs.
@@ -51,7 +53,7 @@ namespace pvt {
 
 
 OSL_SHADEOP void
-osl_setmessage (ShaderGlobals *sg, const char *name_, long long type_, void *val, int layeridx, const char* sourcefile_, int sourceline)
+osl_setmessage (ShaderGlobals *sg, const char *name_, long long type_, void *val, int layeridx, const char* sourcefile_, int sourceline, int slot)
 {
     const ustring &name (USTR(name_));
     const ustring &sourcefile (USTR(sourcefile_));
@@ -62,7 +64,7 @@ osl_setmessage (ShaderGlobals *sg, const char *name_, long long type_, void *val
         type.basetype = TypeDesc::PTR;  // for closures, we store a pointer
 
     MessageList &messages (sg->context->messages());
-    const Message* m = messages.find(name);
+    const Message* m = messages.find(name, slot);
     if (m != NULL) {
         if (m->name == name) {
             // message already exists?
@@ -88,7 +90,7 @@ osl_setmessage (ShaderGlobals *sg, const char *name_, long long type_, void *val
         }
     }
     // The message didn't exist - create it
-    messages.add(name, val, type, layeridx, sourcefile, sourceline);
+    messages.add(name, val, type, layeridx, sourcefile, sourceline, slot);
 }
 
 
@@ -96,7 +98,8 @@ osl_setmessage (ShaderGlobals *sg, const char *name_, long long type_, void *val
 OSL_SHADEOP int
 osl_getmessage (ShaderGlobals *sg, const char *source_, const char *name_,
                 long long type_, void *val, int derivs,
-                int layeridx, const char* sourcefile_, int sourceline)
+                int layeridx, const char* sourcefile_, int sourceline,
+                int slot)
 {
     const ustring &source (USTR(source_));
     const ustring &name (USTR(name_));
@@ -115,7 +118,7 @@ osl_getmessage (ShaderGlobals *sg, const char *source_, const char *name_,
     }
 
     MessageList &messages (sg->context->messages());
-    const Message* m = messages.find(name);
+    const Message* m = messages.find(name, slot);
     if (m != NULL) {
         if (m->name == name) {
             if (m->type != type) {
@@ -163,7 +166,7 @@ osl_getmessage (ShaderGlobals *sg, const char *source_, const char *name_,
     }
     // Message not found -- we must record this event in case another layer tries to set the message again later on
     if (sg->context->shadingsys().strict_messages())
-        messages.add(name, NULL, type, layeridx, sourcefile, sourceline);
+        messages.add(name, NULL, type, layeridx, sourcefile, sourceline, slot);
     return 0;
 }
 
@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /////////////////////////////////////////////////////////////////////////
 
 #include <cstdarg>
+#include <cstring>
 
 #include <OpenImageIO/strutil.h>
 #include <OpenImageIO/fmath.h>
@@ -129,43 +130,165 @@ osl_substr_ssii (const char *s_, int start, int length)
 }
 
 
-OSL_SHADEOP int
-osl_regex_impl (void *sg_, const char *subject_, void *results, int nresults,
-                const char *pattern, int fullmatch)
+CompiledRegex::CompiledRegex (ustring pattern)
+    : m_pattern(pattern), m_regex(pattern.c_str()),
+      m_simple(true), m_anchor_begin(false), m_anchor_end(false)
 {
-    ShaderGlobals *sg = (ShaderGlobals *)sg_;
-    ShadingContext *ctx = sg->context;
-    const std::string &subject (ustring::from_unique(subject_).string());
-    match_results<std::string::const_iterator> mresults;
-    const regex &regex (ctx->find_regex (USTR(pattern)));
+    // Decide whether the pattern is just literal text, possibly with
+    // escaped punctuation and '^'/'$' anchors at the ends.
+    static const char *metachars = ".[]{}()\\*+?|^$";
+    const char *p = pattern.c_str();
+    size_t len = pattern.length();
+    size_t i = 0;
+    if (len && p[0] == '^') {
+        m_anchor_begin = true;
+        ++i;
+    }
+    for ( ; i < len && m_simple; ++i) {
+        char c = p[i];
+        if (c == '\\') {
+            // Only an escaped metacharacter is a literal ("\d" etc. aren't)
+            if (i+1 < len && strchr (metachars, p[i+1]))
+                m_literal += p[++i];
+            else
+                m_simple = false;
+        } else if (c == '$' && i == len-1) {
+            m_anchor_end = true;
+        } else if (strchr (metachars, c)) {
+            m_simple = false;
+        } else {
+            m_literal += c;
+        }
+    }
+    if (! m_simple)
+        m_literal.clear();
+}
+
+
+int
+CompiledRegex::match (const std::string &subject, int *results,
+                      int nresults, bool fullmatch) const
+{
+    // Anchors may also match at embedded newlines (depending on which
+    // regex library we use), so leave those subjects to the real thing.
+    if (m_simple && subject.find ('\n') == std::string::npos) {
+        size_t pos = std::string::npos;
+        size_t len = m_literal.size();
+        if (fullmatch || (m_anchor_begin && m_anchor_end)) {
+            if (subject == m_literal)
+                pos = 0;
+        } else if (m_anchor_begin) {
+            if (Strutil::starts_with (subject, m_literal))
+                pos = 0;
+        } else if (m_anchor_end) {
+            if (Strutil::ends_with (subject, m_literal))
+                pos = subject.size() - len;
+        } else {
+            pos = subject.find (m_literal);
+        }
+        // A literal has no subexpressions, so only the whole match has
+        // offsets, just as the regex would report.
+        for (int r = 0;  r < nresults;  ++r) {
+            if (pos != std::string::npos && r < 2)
+                results[r] = int(r == 0 ? pos : pos + len);
+            else
+                results[r] = int(m_pattern.length());
+        }
+        return pos != std::string::npos;
+    }
+
     if (nresults > 0) {
+        match_results<std::string::const_iterator> mresults;
         std::string::const_iterator start = subject.begin();
-        int res = fullmatch ? regex_match (subject, mresults, regex)
-                            : regex_search (subject, mresults, regex);
-        int *m = (int *)results;
+        int res = fullmatch ? regex_match (subject, mresults, m_regex)
+                            : regex_search (subject, mresults, m_regex);
         for (int r = 0;  r < nresults;  ++r) {
             if (r/2 < (int)mresults.size()) {
                 if ((r & 1) == 0)
-                    m[r] = mresults[r/2].first - start;
+                    results[r] = mresults[r/2].first - start;
                 else
-                    m[r] = mresults[r/2].second - start;
+                    results[r] = mresults[r/2].second - start;
             } else {
-                m[r] = USTR(pattern).length();
+                results[r] = m_pattern.length();
             }
         }
         return res;
     } else {
-        return fullmatch ? regex_match (subject, regex)
-                         : regex_search (subject, regex);
+        return fullmatch ? regex_match (subject, m_regex)
+                         : regex_search (subject, m_regex);
+    }
+}
+
+
+const CompiledRegex *
+ShadingSystemImpl::find_regex (ustring pattern)
+{
+    {
+        OIIO::spin_rw_read_lock lock (m_regex_cache_mutex);
+        RegexCache::const_iterator found = m_regex_cache.find (pattern);
+        if (found != m_regex_cache.end())
+            return found->second.get();
     }
+    // Compile without holding the lock.  If another thread beat us to
+    // it, keep theirs, since somebody may already be holding on to it.
+    std::unique_ptr<CompiledRegex> re;
+    try {
+        re.reset (new CompiledRegex (pattern));
+    } catch (const std::exception &e) {
+        error ("Invalid regex \"%s\": %s", pattern, e.what());
+    }
+    OIIO::spin_rw_write_lock lock (m_regex_cache_mutex);
+    std::unique_ptr<CompiledRegex> &entry (m_regex_cache[pattern]);
+    if (! entry && re) {
+        entry = std::move (re);
+        m_stat_regexes += 1;
+    }
+    return entry.get();
+}
+
+
+OSL_SHADEOP int
+osl_regex_impl (void *sg_, const char *subject_, void *results, int nresults,
+                const char *pattern, int fullmatch)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    ShadingContext *ctx = sg->context;
+    const std::string &subject (ustring::from_unique(subject_).string());
+    const CompiledRegex *regex = ctx->find_regex (USTR(pattern));
+    if (! regex) {
+        for (int r = 0;  r < nresults;  ++r)
+            ((int *)results)[r] = USTR(pattern).length();
+        return 0;
+    }
+    return regex->match (subject, (int *)results, nresults, fullmatch);
+}
+
+
+// Same as osl_regex_impl, but for a pattern that was constant and so
+// was compiled when the shader was JITed.
+OSL_SHADEOP int
+osl_regex_compiled (const char *subject_, void *results, int nresults,
+                    void *compiled, int fullmatch)
+{
+    const std::string &subject (ustring::from_unique(subject_).string());
+    return ((const CompiledRegex *)compiled)->match (subject, (int *)results,
+                                                     nresults, fullmatch);
 }
 
 
 OSL_SHADEOP const char *
 osl_format (const char* format_str, ...)
 {
+    // Format on the stack; only a result too long for that needs a
+    // temporary string on its way to becoming a ustring.
+    char buf[1024];
     va_list args;
     va_start (args, format_str);
+    int len = vsnprintf (buf, sizeof(buf), format_str, args);
+    va_end (args);
+    if (len >= 0 && len < int(sizeof(buf)))
+        return ustring(buf, 0, size_t(len)).c_str();
+    va_start (args, format_str);
     std::string s = Strutil::vformat (format_str, args);
     va_end (args);
     return ustring(s).c_str();
@@ -182,9 +305,8 @@ osl_printf (ShaderGlobals *sg, const char* format_str, ...)
     std::string newfmt = std::string("llvm: ") + format_str;
     format_str = newfmt.c_str();
 #endif
-    std::string s = Strutil::vformat (format_str, args);
+    sg->context->record_vformat (ErrorHandler::EH_MESSAGE, format_str, args);
     va_end (args);
-    sg->context->message ("%s", s);
 }
 
 
@@ -193,9 +315,8 @@ osl_error (ShaderGlobals *sg, const char* format_str, ...)
 {
     va_list args;
     va_start (args, format_str);
-    std::string s = Strutil::vformat (format_str, args);
+    sg->context->record_vformat (ErrorHandler::EH_ERROR, format_str, args);
     va_end (args);
-    sg->context->error ("%s", s);
 }
 
 
@@ -205,9 +326,8 @@ osl_warning (ShaderGlobals *sg, const char* format_str, ...)
     if (sg->context->allow_warnings()) {
         va_list args;
         va_start (args, format_str);
-        std::string s = Strutil::vformat (format_str, args);
+        sg->context->record_vformat (ErrorHandler::EH_WARNING, format_str, args);
         va_end (args);
-        sg->context->warning ("%s", s);
     }
 }
 
@@ -60,6 +60,19 @@ osl_get_texture_options (void *sg_)
 }
 
 
+// Utility: initialize the ShadingContext's texture options struct from a
+// prototype built at JIT time with all the constant options already set,
+// and return a pointer to it.
+OSL_SHADEOP void *
+osl_init_texture_options (void *sg_, const void *proto)
+{
+    ShaderGlobals *sg = (ShaderGlobals *)sg_;
+    TextureOpt *opt = sg->context->texture_options_ptr ();
+    *opt = *(const TextureOpt *)proto;
+    return opt;
+}
+
+
 OSL_SHADEOP void
 osl_texture_set_firstchannel (void *opt, int x)
 {
@@ -258,13 +271,27 @@ osl_texture (void *sg_, const char *name, void *handle,
     // It's actually faster to ask for 4 channels (even if we need fewer)
     // and ensure that they're being put in aligned memory.
     OIIO::simd::float4 result_simd, dresultds_simd, dresultdt_simd;
-    bool ok = sg->renderer->texture (USTR(name),
+    bool ok;
+    if (sg->context->batch_textures()) {
+        // Under execute_batch, a renderer that asked for it sees the
+        // lookup as part of a batch. The points are still shaded one
+        // after another, so each call has just the one point.
+        ok = sg->renderer->texture_batch (USTR(name),
+                                     (TextureSystem::TextureHandle *)handle, sg->context->texture_thread_info(),
+                                     *opt, sg, 1, NULL, &s, &t, &dsdx, &dtdx, &dsdy, &dtdy, 4,
+                                     (float *)&result_simd,
+                                     derivs ? (float *)&dresultds_simd : NULL,
+                                     derivs ? (float *)&dresultdt_simd : NULL,
+                                     errormessage);
+    } else {
+        ok = sg->renderer->texture (USTR(name),
                                      (TextureSystem::TextureHandle *)handle, sg->context->texture_thread_info(),
                                      *opt, sg, s, t, dsdx, dtdx, dsdy, dtdy, 4,
                                      (float *)&result_simd,
                                      derivs ? (float *)&dresultds_simd : NULL,
                                      derivs ? (float *)&dresultdt_simd : NULL,
                                      errormessage);
+    }
 
     for (int i = 0;  i < chans;  ++i)
         ((float *)result)[i] = result_simd[i];
@@ -28,13 +28,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <cstdarg>
 #include <string>
 #include <vector>
+#include <deque>
 #include <stack>
 #include <map>
 #include <memory>
 #include <list>
 #include <set>
+#include <tuple>
 #include <unordered_map>
 
 #include <boost/thread/tss.hpp>   /* for thread_specific_ptr */
@@ -98,6 +101,37 @@ OSL_NAMESPACE_ENTER
 
 
 
+/// A regular expression compiled once and shared by every context of a
+/// ShadingSystem.  Patterns that are just a literal string, optionally
+/// anchored with '^' and/or '$' (which covers most of what shaders match
+/// against object and attribute names), are matched with plain string
+/// compares rather than running the regex engine.
+class CompiledRegex {
+public:
+    /// Compile the pattern; throws if it isn't a valid regex.
+    CompiledRegex (ustring pattern);
+
+    /// Match the subject against the pattern (the whole subject if
+    /// fullmatch, otherwise searching for it), storing the offsets of
+    /// up to nresults/2 submatches in results the way the OSL regex
+    /// functions do.  Return nonzero if it matched.
+    int match (const std::string &subject, int *results, int nresults,
+               bool fullmatch) const;
+
+    ustring pattern () const { return m_pattern; }
+    bool is_simple () const { return m_simple; }
+
+private:
+    ustring m_pattern;            ///< The original pattern
+    regex m_regex;                ///< Compiled regex
+    std::string m_literal;        ///< The literal text, if m_simple
+    bool m_simple;                ///< Pattern is an (anchored) literal
+    bool m_anchor_begin;          ///< Simple pattern started with '^'
+    bool m_anchor_end;            ///< Simple pattern ended with '$'
+};
+
+
+
 struct PerThreadInfo
 {
     PerThreadInfo ();
@@ -148,7 +182,7 @@ struct OpDescriptor {
         : name(n), llvmgen(ll), folder(fold), simple_assign(simple), flags(flags)
     {}
 
-    enum FlagValues { None=0, Tex=1, SideEffects=2 };
+    enum FlagValues { None=0, Tex=1, SideEffects=2, Profiled=4 };
 };
 
 
@@ -387,6 +421,9 @@ public:
 
     int num_params () const { return m_lastparam - m_firstparam; }
 
+    /// Total number of ops in the master's code.
+    int num_ops () const { return (int) m_ops.size(); }
+
     int raytype_queries () const { return m_raytype_queries; }
 
 private:
@@ -585,14 +622,24 @@ public:
     int llvm_debug_layers () const { return m_llvm_debug_layers; }
     int llvm_debug_ops () const { return m_llvm_debug_ops; }
     int llvm_output_bitcode () const { return m_llvm_output_bitcode; }
+    int llvm_debugging_symbols () const { return m_llvm_debugging_symbols; }
+    int llvm_profiling_events () const { return m_llvm_profiling_events; }
+    int pgo_samples () const { return m_pgo_samples; }
+    ustring llvm_jit_cache () const { return m_llvm_jit_cache; }
+    /// The dictionary (dict_find/dict_value) cache shared by all contexts.
+    Dictionary *dictionary () const { return m_dictionary; }
     bool fold_getattribute () const { return m_opt_fold_getattribute; }
+    bool fold_dict () const { return m_opt_fold_dict; }
+    bool fold_ocio_matrix () const { return m_opt_fold_ocio_matrix; }
     bool opt_texture_handle () const { return m_opt_texture_handle; }
+    bool opt_groupdata () const { return m_opt_groupdata; }
     int opt_passes() const { return m_opt_passes; }
     int max_warnings_per_thread() const { return m_max_warnings_per_thread; }
     bool countlayerexecs() const { return m_countlayerexecs; }
     bool lazy_userdata () const { return m_lazy_userdata; }
     bool userdata_isconnected () const { return m_userdata_isconnected; }
     int profile() const { return m_profile; }
+    int profile_layers() const { return m_profile_layers; }
     bool no_noise() const { return m_no_noise; }
     bool no_pointcloud() const { return m_no_pointcloud; }
     bool force_derivs() const { return m_force_derivs; }
@@ -612,6 +659,22 @@ public:
     /// (at least the ones that can't be overridden by the geometry).
     void optimize_group (ShaderGroup &group, ShadingContext *ctx);
 
+    /// Queue the group to be optimized and JITed by the background
+    /// compile threads (the "async_jit" option), if it isn't already
+    /// queued, and return immediately.
+    void optimize_group_async (ShaderGroup &group);
+
+    /// Make every context forget the attribute values it cached because
+    /// the renderer declared them constant.
+    void invalidate_attribute_cache () { ++m_attrib_cache_epoch; }
+
+    /// If a fully specialized copy of a group with interactive params (or
+    /// a profile-guided rebuild of an instrumented group) is ready, return
+    /// it; otherwise return an empty ref, first queueing the construction
+    /// of such a copy if the group's edits have gone idle. The caller's
+    /// ref keeps the copy alive even after a newer one supersedes it.
+    ShaderGroupRef specialized_group (ShaderGroup &group);
+
     /// After doing all optimization and code JIT, we can clean up by
     /// deleting the instances' code and arguments, and paring their
     /// symbol tables down to just parameters.
@@ -637,7 +700,9 @@ public:
 
     int raytype_bit (ustring name);
 
-    void optimize_all_groups (int nthreads=0, int mythread=0, int totalthreads=1);
+    /// Optimize and JIT all complete groups that haven't been already,
+    /// using nthreads threads (0 means all hardware cores).
+    void optimize_all_groups (int nthreads=0);
 
     typedef std::unordered_map<ustring,OpDescriptor,ustringHash> OpDescriptorMap;
 
@@ -669,6 +734,20 @@ public:
     ocio_transform (StringParam fromspace, StringParam tospace,
                     const Color& C, Color& Cout);
 
+    /// If the OCIO conversion between the two color spaces matches a 3x3
+    /// matrix on a set of probe colors, store it in M (transforming row
+    /// vectors, like OSL's matrices) and return true. The probes can't
+    /// prove the transform linear, so this is only consulted when the
+    /// opt_fold_ocio_matrix option is on.
+    bool ocio_transform_matrix (StringParam fromspace, StringParam tospace,
+                                Matrix44 &M);
+
+    /// Return the compiled regex for the pattern, compiling it the first
+    /// time any context asks for it, or NULL if it's not a valid regex.
+    /// The CompiledRegex lives as long as the ShadingSystem, so JITed code
+    /// may hold on to the pointer.
+    const CompiledRegex *find_regex (ustring pattern);
+
 private:
     void printstats () const;
 
@@ -705,6 +784,31 @@ private:
 
     void setup_op_descriptors ();
 
+    void init_dict_resources ();
+    void free_dict_resources ();
+
+    /// Make dict_find re-read the XML files that have changed on disk.
+    void invalidate_dictionaries ();
+
+    /// Return the ShaderGroupRef that owns the group (empty if it wasn't
+    /// made by ShaderGroupBegin, or is being destroyed).
+    ShaderGroupRef find_group_ref (ShaderGroup &group);
+
+    /// Return the pool used for background JIT, creating it if needed.
+    OIIO::thread_pool *async_jit_pool ();
+
+    /// Build a copy of the group with its current interactive param
+    /// values folded in (and laid out from its profile counts, if it has
+    /// any), and publish it as the group's m_specialized. This is done
+    /// in the background, except for a profile-guided rebuild when there
+    /// are no async_jit threads.
+    void respecialize_group_async (ShaderGroup &group);
+
+    /// Add the layers, params and connections of a serialized group
+    /// description to the group.
+    bool parse_group_spec (ShaderGroup &group, string_view usage,
+                           string_view groupspec);
+
     RendererServices *m_renderer;         ///< Renderer services
     TextureSystem *m_texturesys;          ///< Texture system
 
@@ -746,6 +850,7 @@ private:
     bool m_relaxed_param_typecheck;       ///< Allow parameters to be set from isomorphic types (same data layout)
     int m_max_warnings_per_thread;        ///< How many warnings to display per thread before giving up?
     int m_profile;                        ///< Level of profiling of shader execution
+    int m_profile_layers;                 ///< Instrument layers (1), ops (2)
     int m_optimize;                       ///< Runtime optimization level
     bool m_opt_simplify_param;            ///< Turn instance params into const?
     bool m_opt_constant_fold;             ///< Allow constant folding?
@@ -759,9 +864,12 @@ private:
     char m_opt_merge_instances;           ///< Merge identical instances?
     bool m_opt_merge_instances_with_userdata; ///< Merge identical instances if they have userdata?
     bool m_opt_fold_getattribute;         ///< Constant-fold getattribute()?
+    bool m_opt_fold_dict;                 ///< Constant-fold dict_find/value?
+    bool m_opt_fold_ocio_matrix;          ///< OCIO transformc => matrix?
     bool m_opt_middleman;                 ///< Middle-man optimization?
     bool m_opt_texture_handle;            ///< Use texture handles?
     bool m_opt_seed_bblock_aliases;       ///< Turn on basic block alias seeds
+    bool m_opt_groupdata;                 ///< Optimize the groupdata layout?
     bool m_optimize_nondebug;             ///< Fully optimize non-debug!
     int m_opt_passes;                     ///< Opt passes per layer
     int m_llvm_optimize;                  ///< OSL optimization strategy
@@ -770,6 +878,9 @@ private:
     int m_llvm_debug_layers;              ///< Add layer enter/exit printfs
     int m_llvm_debug_ops;                 ///< Add printfs to every op
     int m_llvm_output_bitcode;            ///< Output bitcode for each group
+    int m_llvm_debugging_symbols;         ///< Line info in JIT code
+    int m_llvm_profiling_events;          ///< Tell profilers about JIT code
+    ustring m_llvm_jit_cache;             ///< Dir for the JIT machine code cache
     ustring m_debug_groupname;            ///< Name of sole group to debug
     ustring m_debug_layername;            ///< Name of sole layer to debug
     ustring m_opt_layername;              ///< Name of sole layer to optimize
@@ -789,6 +900,9 @@ private:
     bool m_force_derivs;                  ///< Force derivs on everything
     bool m_allow_shader_replacement;      ///< Allow shader masters to replace
     int m_exec_repeat;                    ///< How many times to execute group
+    int m_async_jit;                      ///< Background JIT threads (0=off)
+    int m_interactive_respecialize;       ///< Idle ms before respecializing
+    int m_pgo_samples;                    ///< Shades to profile before re-JIT
     int m_opt_warnings;                   ///< Warn on inability to optimize
     int m_gpu_opt_error;                  ///< Error on inability to optimize
                                           ///<   away things that can't GPU.
@@ -834,11 +948,24 @@ private:
     double m_stat_llvm_irgen_time;        ///<     llvm IR generation time
     double m_stat_llvm_opt_time;          ///<     llvm IR optimization time
     double m_stat_llvm_jit_time;          ///<     llvm JIT time
+    atomic_int m_stat_jit_cache_hits;     ///< Stat: groups found in JIT cache
+    atomic_int m_stat_jit_cache_misses;   ///< Stat: groups not in JIT cache
+    atomic_ll m_stat_jit_cache_bytes_read; ///< Stat: bytes read from JIT cache
+    atomic_int m_stat_async_jit_groups;   ///< Stat: groups JITed in background
+    atomic_ll m_stat_async_jit_deferrals; ///< Stat: executions deferred
+    atomic_int m_stat_respecializations;  ///< Stat: interactive respecializations
+    atomic_int m_stat_pgo_rejits;         ///< Stat: profile-guided re-JITs
+    double m_stat_compile_all_time;       ///< Stat: optimize_all_groups wall time
+    std::vector<double> m_stat_compile_thread_idle; ///< Idle time per thread
     double m_stat_inst_merge_time;        ///< Stat: time merging instances
     double m_stat_getattribute_time;      ///< Stat: time spent in getattribute
     double m_stat_getattribute_fail_time; ///< Stat: time spent in getattribute
     atomic_ll m_stat_getattribute_calls;  ///< Stat: Number of getattribute
     atomic_ll m_stat_get_userdata_calls;  ///< Stat: # of get_userdata calls
+    atomic_ll m_stat_attrib_cache_hits;   ///< Stat: getattribute cache hits
+    atomic_ll m_stat_attrib_cache_misses; ///< Stat: getattribute cache misses
+    atomic_ll m_stat_matrix_cache_hits;   ///< Stat: get_matrix cache hits
+    atomic_ll m_stat_matrix_cache_misses; ///< Stat: get_matrix cache misses
     atomic_ll m_stat_noise_calls;         ///< Stat: # of noise calls
     long long m_stat_pointcloud_searches;
     long long m_stat_pointcloud_searches_total_results;
@@ -850,6 +977,9 @@ private:
     atomic_ll m_stat_total_shading_time_ticks; ///< Total shading time (ticks)
 
     int m_stat_max_llvm_local_mem;        ///< Stat: max LLVM local mem
+    long long m_stat_groupdata_bytes;     ///< Stat: total groupdata size
+    int m_stat_max_groupdata_bytes;       ///< Stat: max groupdata size
+    long long m_stat_groupdata_bytes_saved; ///< Stat: saved by the layout
     PeakCounter<off_t> m_stat_memory;     ///< Stat: all shading system memory
 
     PeakCounter<off_t> m_stat_mem_master; ///< Stat: master-related mem
@@ -865,6 +995,10 @@ private:
 
     mutable spin_mutex m_stat_mutex;     ///< Mutex for non-atomic stats
     ClosureRegistry m_closure_registry;
+    Dictionary *m_dictionary;             ///< Shared dict_find cache
+    typedef std::unordered_map<ustring, std::unique_ptr<CompiledRegex>, ustringHash> RegexCache;
+    RegexCache m_regex_cache;             ///< Shared compiled regex's
+    OIIO::spin_rw_mutex m_regex_cache_mutex;
     std::vector<std::weak_ptr<ShaderGroup> > m_all_shader_groups;
     mutable spin_mutex m_all_shader_groups_mutex;
 
@@ -874,10 +1008,45 @@ private:
     ShaderGroupRef m_curgroup;
 
     atomic_int m_groups_to_compile_count;
+    atomic_int m_attrib_cache_epoch;      ///< Bumped to invalidate caches
+    std::unique_ptr<OIIO::thread_pool> m_async_jit_pool; ///< Background JIT
+    spin_mutex m_async_jit_mutex;         ///< Protects m_async_jit_pool
     atomic_int m_threads_currently_compiling;
+    std::unique_ptr<OIIO::thread_pool> m_compile_pool; ///< optimize_all_groups
+    mutex m_compile_pool_mutex;           ///< Held by optimize_all_groups
     mutable std::map<ustring,long long> m_group_profile_times;
     // N.B. group_profile_times is protected by m_stat_mutex.
 
+    // Instrumentation points of the "profile_layers" execution profile:
+    // one per JITed layer function and (at level 2) per expensive op.
+    // Contexts accumulate their own times and merge them in here.
+    struct ProfileSlot {
+        ustring group, layer;     ///< Where it is
+        ustring op;               ///< Op name, or empty for a whole layer
+        ustring sourcefile;
+        int sourceline;
+        long long ticks = 0;      ///< Self time, excluding called layers
+        long long calls = 0;
+        ProfileSlot (ustring group, ustring layer, ustring op,
+                     ustring sourcefile, int sourceline)
+            : group(group), layer(layer), op(op), sourcefile(sourcefile),
+              sourceline(sourceline) {}
+    };
+    std::vector<ProfileSlot> m_profile_slots;
+    typedef std::tuple<ustring,ustring,ustring,ustring,int> ProfileSlotKey;
+    std::map<ProfileSlotKey,int> m_profile_slot_index;  ///< Slot of each point
+    mutable mutex m_profile_mutex;        ///< Protects m_profile_slots
+
+    /// Register a profile instrumentation point and return its index. A
+    /// point that was already registered (because its group was JITed
+    /// again, e.g. respecialized or rebuilt from its PGO profile) gets
+    /// its old slot back, so the times of both builds add up together.
+    int profile_slot (ustring group, ustring layer, ustring op,
+                      ustring sourcefile, int sourceline);
+
+    /// Print the "profile_layers" report.
+    void print_layer_profile (std::ostream &out) const;
+
     friend class OSL::ShadingContext;
     friend class ShaderMaster;
     friend class ShaderInstance;
@@ -1344,8 +1513,8 @@ private:
 /// Represents a single message for use by getmessage and setmessage opcodes
 ///
 struct Message {
-    Message(ustring name, const TypeDesc& type, int layeridx, ustring sourcefile, int sourceline, Message* next) :
-       name(name), data(nullptr), type(type), layeridx(layeridx), sourcefile(sourcefile), sourceline(sourceline), next(next) {}
+    Message(ustring name, const TypeDesc& type, int layeridx, ustring sourcefile, int sourceline) :
+       name(name), data(nullptr), type(type), layeridx(layeridx), sourcefile(sourcefile), sourceline(sourceline) {}
 
     /// Some messages don't have data because getmessage() was called before setmessage
     /// (which is flagged as an error to avoid ambiguities caused by execution order)
@@ -1358,36 +1527,102 @@ struct Message {
     int layeridx;           ///< layer index where this was message was created
     ustring sourcefile;     ///< source code file that contains the call that created this message
     int sourceline;         ///< source code line that contains the call that created this message
-    Message* next;          ///< linked list of messages (managed by MessageList below)
 };
 
 /// Represents the list of messages set by a given shader using setmessage and getmessage
 ///
+/// Messages are kept in an open-addressing hash table keyed on the name.
+/// Each entry is stamped with the generation in which it was stored, so
+/// clear() merely bumps the generation and is O(1) however many messages
+/// were set. Message names that are known when the group is JITed are
+/// also assigned fixed "slot" numbers (see BackendLLVM::message_slot),
+/// and lookups using a slot are just an array reference.
 struct MessageList {
-     MessageList() : list_head(nullptr), message_data() {}
+     MessageList() : message_data() {}
 
      void clear() {
-         list_head = NULL;
          message_data.clear();
+         m_count = 0;
+         if (++m_generation == 0) {
+             // The generation wrapped around, and stale entries could
+             // look current again, so really clear them this once.
+             for (auto&& e : m_table)
+                 e.generation = 0;
+             for (auto&& e : m_slots)
+                 e.generation = 0;
+             m_generation = 1;
+         }
      }
 
-    const Message* find(ustring name) const {
-        for (const Message* m = list_head; m != NULL; m = m->next)
-            if (m->name == name)
-                return m; // name matches
-        return nullptr; // not found
+    const Message* find(ustring name, int slot = -1) {
+        if (slot >= 0 && slot < (int)m_slots.size() &&
+              m_slots[slot].generation == m_generation)
+            return m_slots[slot].message;
+        if (m_table.empty())
+            return nullptr;
+        size_t mask = m_table.size() - 1;
+        for (size_t i = name.hash() & mask; ; i = (i+1) & mask) {
+            const Entry &e (m_table[i]);
+            if (e.generation != m_generation)
+                return nullptr;  // hit an empty entry -- not found
+            if (e.message->name == name) {
+                if (slot >= 0)
+                    set_slot (slot, e.message);
+                return e.message;
+            }
+        }
     }
 
-    void add(ustring name, void* data, const TypeDesc& type, int layeridx, ustring sourcefile, int sourceline) {
-        list_head = new (message_data.alloc(sizeof(Message), alignof(Message))) Message(name, type, layeridx, sourcefile, sourceline, list_head);
+    void add(ustring name, void* data, const TypeDesc& type, int layeridx, ustring sourcefile, int sourceline, int slot = -1) {
+        Message *m = new (message_data.alloc(sizeof(Message), alignof(Message))) Message(name, type, layeridx, sourcefile, sourceline);
         if (data) {
-            list_head->data = message_data.alloc(type.size());
-            memcpy(list_head->data, data, type.size());
+            m->data = message_data.alloc(type.size());
+            memcpy(m->data, data, type.size());
         }
+        // Keep the table at most half full, so probe sequences stay short
+        if (2 * (m_count + 1) > m_table.size())
+            grow ();
+        insert (m);
+        ++m_count;
+        if (slot >= 0)
+            set_slot (slot, m);
     }
 
 private:
-    Message*         list_head;
+    struct Entry {
+        Message* message = nullptr;
+        unsigned int generation = 0;   ///< Valid only if current
+    };
+
+    void insert (Message *m) {
+        size_t mask = m_table.size() - 1;
+        size_t i = m->name.hash() & mask;
+        while (m_table[i].generation == m_generation)
+            i = (i+1) & mask;
+        m_table[i].message = m;
+        m_table[i].generation = m_generation;
+    }
+
+    void grow () {
+        std::vector<Entry> old;
+        old.swap (m_table);
+        m_table.resize (std::max (size_t(16), 2 * old.size()));
+        for (auto&& e : old)
+            if (e.generation == m_generation)
+                insert (e.message);
+    }
+
+    void set_slot (int slot, Message *m) {
+        if (slot >= (int)m_slots.size())
+            m_slots.resize (slot+1);
+        m_slots[slot].message = m;
+        m_slots[slot].generation = m_generation;
+    }
+
+    std::vector<Entry> m_table;    ///< Hash table, size is a power of 2
+    std::vector<Entry> m_slots;    ///< Messages by fixed slot number
+    size_t m_count = 0;            ///< Number of current messages
+    unsigned int m_generation = 1; ///< Current generation of entries
     SimplePool<1024> message_data;
 };
 
@@ -1398,6 +1633,57 @@ private:
 
 /// A ShaderGroup consists of one or more layers (each of which is a
 /// ShaderInstance), and the connections among them.
+/// Execution counts gathered by the instrumented first build of a group
+/// (see the "pgo_samples" option), from which its re-JIT is laid out.
+/// The JITed code bumps counters private to each ShadingContext, which
+/// are merged in here every so often (ShadingContext::merge_pgo).
+struct PGOProfile {
+    PGOProfile (int nlayers) : counts(nlayers) { }
+
+    /// Identifies a conditional branch op in a way that survives the
+    /// rebuild, whose op numbering may differ: its layer, source file and
+    /// line, opcode, and how many earlier ops of the layer share those.
+    typedef std::tuple<int,ustring,int,ustring,int> BranchKey;
+
+    atomic_ll shades {0};                 ///< Group executions sampled
+    atomic_int done {0};                  ///< Was a re-JIT attempted?
+    std::deque<atomic_ll> counts;         ///< Layer runs, then branch pairs
+    std::map<BranchKey,int> branches;     ///< Branch -> counter index
+
+    /// Runs of the given layer that were counted.
+    long long layer_runs (int layer) const {
+        return counts[layer].load (std::memory_order_relaxed);
+    }
+
+    /// Index of the counter pair for a conditional branch op: [i] counts
+    /// its evaluations, [i+1] those that went the 'true' way. Only called
+    /// while generating the instrumented code.
+    int branch_counter (const BranchKey &key) {
+        auto found = branches.find (key);
+        if (found != branches.end())
+            return found->second;
+        int index = (int) counts.size();
+        counts.emplace_back ();
+        counts.emplace_back ();
+        branches[key] = index;
+        return index;
+    }
+
+    /// Retrieve the counts for a branch op, returning false if it wasn't
+    /// instrumented.
+    bool branch_counts (const BranchKey &key,
+                        long long &reached, long long &taken) const {
+        auto found = branches.find (key);
+        if (found == branches.end())
+            return false;
+        reached = counts[found->second].load (std::memory_order_relaxed);
+        taken = counts[found->second+1].load (std::memory_order_relaxed);
+        return true;
+    }
+};
+
+
+
 class ShaderGroup {
 public:
     ShaderGroup (string_view name);
@@ -1472,6 +1758,8 @@ public:
     ustring name () const { return m_name; }
 
     std::string serialize () const;
+    /// serialize() for a caller that already holds the group's lock.
+    std::string serialize_locked () const;
 
     void lock () const { m_mutex.lock(); }
     void unlock () const { m_mutex.unlock(); }
@@ -1499,6 +1787,23 @@ public:
         mark_entry_layer (find_layer (layername));
     }
 
+    /// If this is a specialized copy, return its counterpart of a symbol
+    /// of the original group (NULL if the copy has none); otherwise (or
+    /// for the copy's own symbols) return the symbol itself.
+    const Symbol *symbol_in_copy (const Symbol *sym) const {
+        if (m_symbol_map.empty())
+            return sym;
+        auto found = m_symbol_map.find (sym);
+        return found == m_symbol_map.end() ? sym : found->second;
+    }
+
+    /// Is the named parameter one of the group's "interactive_params"
+    /// (which may be named either "param" or "layer.param")?
+    bool is_interactive_param (ustring layername, ustring paramname) const;
+    bool has_interactive_params () const {
+        return ! m_interactive_params.empty();
+    }
+
     int num_entry_layers () const { return m_num_entry_layers; }
 
     bool is_last_layer (int layer) const {
@@ -1524,6 +1829,10 @@ public:
     int raytypes_on ()  const { return m_raytypes_on; }
     int raytypes_off () const { return m_raytypes_off; }
 
+    /// Should executions also leave a flattened list of the closure
+    /// result in the context?
+    bool flat_closures () const { return m_flat_closures; }
+
 private:
     // Put all the things that are read-only (after optimization) and
     // needed on every shade execution at the front of the struct, as much
@@ -1542,12 +1851,14 @@ private:
     int m_raytype_queries = -1;      ///< Bitmask of raytypes queried
     int m_raytypes_on = 0;           ///< Bitmask of raytypes we assume to be on
     int m_raytypes_off = 0;          ///< Bitmask of raytypes we assume to be off
+    bool m_flat_closures = false;    ///< Flatten the closure results?
     mutable mutex m_mutex;           ///< Thread-safe optimization
     int m_globals_read = 0;
     int m_globals_write = 0;
     std::vector<ustring> m_textures_needed;
     std::vector<ustring> m_closures_needed;
     std::vector<ustring> m_globals_needed;  // semi-deprecated
+    std::vector<ustring> m_dictionaries_needed;
     std::vector<ustring> m_userdata_names;
     std::vector<TypeDesc> m_userdata_types;
     std::vector<int> m_userdata_offsets;
@@ -1566,9 +1877,42 @@ private:
     // PTX assembly for compiled ShaderGroup
     std::string m_llvm_ptx_compiled_version;
 
+    // Prototype TextureOpts (with the constant options of texture calls
+    // filled in) that the JIT-compiled code refers to, one for each
+    // distinct set of constant options in the group.
+    std::vector<std::unique_ptr<TextureOpt>> m_texture_opt_blocks;
+
     ParamValueList m_pending_params;      ///< Pending Parameter() values
     ustring m_group_use;                  ///< "Usage" of group
     bool m_complete = false;              ///< Successfully ShaderGroupEnd?
+    atomic_int m_async_jit_queued {0};    ///< Queued for background JIT?
+    std::weak_ptr<ShaderGroup> m_self;    ///< The ref that owns this group
+
+    // Interactive editing: the params named here are kept live in the
+    // compiled group so ReParameter can change them instantly.  Once the
+    // edits go idle, a fully specialized copy of the group is built in
+    // the background and executed in its place until the next edit.
+    std::vector<ustring> m_interactive_params; ///< Params kept live
+    atomic_int m_interactive_edits {0};   ///< Count of ReParameter edits
+    atomic_ll m_interactive_edit_time {0}; ///< Timer ticks of last edit
+    // The group holds only the current copy. Each context that runs a
+    // copy holds its own ref to it (see ShadingContext::m_group_pin), so
+    // a superseded copy is freed as soon as the last context lets go.
+    atomic_int m_respecializing {0};      ///< Specialized copy underway?
+    ShaderGroupRef m_specialized;         ///< Current copy, if any
+    spin_mutex m_specialized_mutex;       ///< Protects m_specialized
+    std::string m_original_spec;          ///< serialize() before optimizing
+    bool m_respecialized = false;         ///< Is this such a copy?
+    /// For a copy, map the symbols of the original group to its own, so
+    /// ShaderSymbol handles found on the original still work.
+    std::unordered_map<const Symbol *, const Symbol *> m_symbol_map;
+
+    // Profile-guided re-JIT: the first build of a group counts layer runs
+    // and branch outcomes into m_pgo, and once "pgo_samples" shades have
+    // been counted, a copy is built (the same way as for interactive
+    // params) whose m_pgo_feedback guides its layout.
+    std::shared_ptr<PGOProfile> m_pgo;    ///< Counts, if instrumented
+    std::shared_ptr<PGOProfile> m_pgo_feedback; ///< Counts to build from
 
     friend class OSL::pvt::ShadingSystemImpl;
     friend class OSL::pvt::BackendLLVM;
@@ -1606,6 +1950,11 @@ public:
     /// layer, and cleanup. (See similarly named method of ShadingSystem.)
     bool execute (ShaderGroup &group, ShaderGlobals &globals, bool run=true);
 
+    /// Execute the shader group over a batch of points, sharing the
+    /// setup and cleanup. (See similarly named method of ShadingSystem.)
+    bool execute_batch (ShaderGroup &group, int npoints,
+                        ShaderGlobals *globals, const bool *mask=nullptr);
+
     ClosureComponent * closure_component_allot(int id, size_t prim_size, const Color3 &w) {
         // Allocate the component and the mul back to back
         size_t needed = sizeof(ClosureComponent) + prim_size;
@@ -1639,6 +1988,14 @@ public:
         return add;
     }
 
+    /// Flatten the closure result of the given point (within a batch, or
+    /// 0) of the last execution, and return its length. The list is
+    /// only valid until the next call or execution.
+    int flat_closures (int point, const FlatClosure* &closures) const;
+
+    /// Build a closure tree, in the closure pool, from a flat list.
+    const ClosureColor *closure_tree (const FlatClosure *closures, int n);
+
 
     /// Find the named symbol in the (already-executed!) stack of shaders of
     /// the given use. If a layer is given, search just that layer. If no
@@ -1653,10 +2010,11 @@ public:
     /// Return a pointer to where the symbol's data lives.
     const void *symbol_data (const Symbol &sym) const;
 
-    /// Return a reference to a compiled regular expression for the
-    /// given string, being careful to cache already-created ones so we
-    /// aren't constantly compiling new ones.
-    const regex & find_regex (ustring r);
+    /// Return the compiled regular expression for the given string (or
+    /// NULL if it's invalid).  Regex's are compiled once for the whole
+    /// ShadingSystem; the context just remembers the ones it has used so
+    /// that repeated lookups don't touch the shared cache.
+    const CompiledRegex *find_regex (ustring r);
 
     /// Return a pointer to the shading group for this context.
     ///
@@ -1669,12 +2027,16 @@ public:
 
     /// Look up a query from a dictionary (typically XML), staring the
     /// search from the root of the dictionary, and returning ID of the
-    /// first matching node.
-    int dict_find (ustring dictionaryname, ustring query);
+    /// first matching node.  If report_errors is false (as when constant
+    /// folding), an unreadable dictionary or bad query is neither
+    /// reported nor remembered, and returns -1, so that the error is
+    /// left for when the shader runs.
+    int dict_find (ustring dictionaryname, ustring query,
+                   bool report_errors=true);
     /// Look up a query from a dictionary (typically XML), staring the
     /// search from the given nodeID within the dictionary, and
     /// returning ID of the first matching node.
-    int dict_find (int nodeID, ustring query);
+    int dict_find (int nodeID, ustring query, bool report_errors=true);
     /// Return the next match of the same query that gave the nodeID.
     int dict_next (int nodeID);
     /// Look up an attribute of the given dictionary node.  If
@@ -1686,8 +2048,45 @@ public:
                             int array_lookup, int index,
                             TypeDesc attr_type, void *attr_dest);
 
+    /// Get the matrix that transforms from the named space to "common"
+    /// (or, if inverse is true, from "common" to it) at sg->time, reusing
+    /// it if this shade already asked the renderer for it, or if an
+    /// earlier shade did and the renderer said it is constant (see
+    /// RendererServices::matrix_is_constant). "shader" and "object" are
+    /// sg's shader2common and object2common.
+    bool get_matrix (ShaderGlobals *sg, Matrix44 &M, ustring name,
+                     bool inverse);
+
+    /// Forget the matrices fetched for the current shade.
+    void clear_matrix_cache () {
+        m_matrix_cache_size = 0;
+        m_next_matrix_cache = 0;
+    }
+
     PerThreadInfo *thread_info () const { return m_threadinfo; }
 
+    /// Is this context shading the points of an execute_batch?
+    bool in_batch () const { return m_in_batch; }
+
+    /// Should 2D texture lookups go to RendererServices::texture_batch?
+    /// Only under execute_batch, and only if the renderer asked for it
+    /// (with supports("texture_batch")).
+    bool batch_textures () const { return m_in_batch && m_renderer_texture_batch; }
+
+    /// Let go of the specialized copy of a group that the last execution
+    /// ran (if it did), so it can be freed once superseded. After this,
+    /// the context no longer refers to that execution's group at all.
+    void unpin_group () {
+        if (m_group_pin) {
+            m_group = NULL;
+            m_group_pin.reset ();
+        }
+    }
+
+    /// Did the last execute_init return false only because the group was
+    /// queued for background JIT (rather than because it does nothing)?
+    bool deferred () const { return m_deferred; }
+
     TextureSystem::Perthread *texture_thread_info () const {
         if (! m_texture_thread_info)
             m_texture_thread_info = shadingsys().texturesys()->get_perthread_info ();
@@ -1710,12 +2109,38 @@ public:
 
     void incr_layers_executed () { ++m_stat_layers_executed; }
 
+    /// Called by "profile_layers" instrumented code as it enters a layer
+    /// or op, and as it exits, with the slot to which to add its self
+    /// time (which excludes any other layers run from within it).
+    void profile_enter ();
+    void profile_exit (int slot, bool layer);
+
+    /// Merge the profile times accumulated by this context into the
+    /// shading system's totals.
+    void merge_profile ();
+
+    /// Called by "pgo_samples" instrumented code to bump one of the
+    /// counters (see PGOProfile) of the group being run.
+    void pgo_count (int counter) { ++m_pgo_counts[counter]; }
+
+    /// Merge the shades and counts this context has sampled into the
+    /// profile they belong to, and return its new total of shades.
+    long long merge_pgo ();
+
+    /// Count a shade of an instrumented group, having its profile-guided
+    /// copy built once enough have been sampled.
+    void pgo_sample (ShaderGroup &group);
+
     void incr_get_userdata_calls () { ++m_stat_get_userdata_calls; }
 
     // Clear the stats we record per-execution in this context (unlocked)
     void clear_runtime_stats () {
         m_stat_get_userdata_calls = 0;
         m_stat_layers_executed = 0;
+        m_stat_attrib_cache_hits = 0;
+        m_stat_attrib_cache_misses = 0;
+        m_stat_matrix_cache_hits = 0;
+        m_stat_matrix_cache_misses = 0;
     }
 
     // Transfer the per-execution stats from this context to the shading
@@ -1723,6 +2148,10 @@ public:
     void record_runtime_stats () {
         shadingsys().m_stat_get_userdata_calls += m_stat_get_userdata_calls;
         shadingsys().m_stat_layers_executed += m_stat_layers_executed;
+        shadingsys().m_stat_attrib_cache_hits += m_stat_attrib_cache_hits;
+        shadingsys().m_stat_attrib_cache_misses += m_stat_attrib_cache_misses;
+        shadingsys().m_stat_matrix_cache_hits += m_stat_matrix_cache_hits;
+        shadingsys().m_stat_matrix_cache_misses += m_stat_matrix_cache_misses;
     }
 
     bool allow_warnings() {
@@ -1738,6 +2167,10 @@ public:
 
     // Record an error (or warning, printf, etc.)
     void record_error (ErrorHandler::ErrCode code, const std::string &text) const;
+    // Record a message formatted printf-style, directly into the message
+    // buffer, without allocating any memory.
+    void record_vformat (ErrorHandler::ErrCode code, const char *format,
+                         va_list args) const;
     // Process all the recorded errors, warnings, printfs
     void process_errors () const;
 
@@ -1763,20 +2196,33 @@ public:
 
 private:
 
-    void free_dict_resources ();
-
     ShadingSystemImpl &m_shadingsys;    ///< Backpointer to shadingsys
     RendererServices *m_renderer;       ///< Ptr to renderer services
     PerThreadInfo *m_threadinfo;        ///< Ptr to our thread's info
     mutable TextureSystem::Perthread *m_texture_thread_info; ///< Ptr to texture thread info
     ShaderGroup *m_group;               ///< Ptr to shader group
+    ShaderGroupRef m_group_pin;         ///< Owns m_group if it's a copy
     std::vector<char> m_heap;           ///< Heap memory
-    typedef std::unordered_map<ustring, std::unique_ptr<regex>, ustringHash> RegexMap;
-    RegexMap m_regex_map;               ///< Compiled regex's
+    typedef std::unordered_map<ustring, const CompiledRegex *, ustringHash> RegexMap;
+    RegexMap m_regex_map;               ///< Regex's this context has used
     MessageList m_messages;             ///< Message blackboard
     int m_max_warnings;                 ///< To avoid processing too many warnings
     int m_stat_get_userdata_calls;      ///< Number of calls to get_userdata
     int m_stat_layers_executed;         ///< Number of layers executed
+    // For "profile_layers": the (start, nested layer ticks) of each layer
+    // or op being timed, and the per-slot totals not yet merged.
+    std::vector<std::pair<long long,long long>> m_profile_stack;
+    std::vector<long long> m_profile_ticks;
+    std::vector<long long> m_profile_calls;
+    // For "pgo_samples": the profile of the instrumented group last run,
+    // and the shades and counts collected for it but not yet merged.
+    std::shared_ptr<PGOProfile> m_pgo;
+    std::vector<long long> m_pgo_counts;
+    int m_pgo_shades = 0;
+    int m_stat_attrib_cache_hits;       ///< getattribute answered by cache
+    int m_stat_attrib_cache_misses;     ///< getattribute passed to renderer
+    int m_stat_matrix_cache_hits;       ///< get_matrix answered by cache
+    int m_stat_matrix_cache_misses;     ///< get_matrix passed to renderer
     long long m_ticks;                  ///< Time executing the shader
 
     TextureOpt m_textureopt;            ///< texture call options
@@ -1784,10 +2230,14 @@ private:
     RendererServices::TraceOpt m_traceopt; ///< trace call options
 
     SimplePool<20 * 1024> m_closure_pool;
+    std::vector<const ClosureColor *> m_closure_results; ///< Ci per point
+    ShaderGlobals *m_closure_globals = NULL;   ///< Where Ci will end up
+    bool m_in_batch = false;           ///< Running execute_batch?
+    bool m_renderer_texture_batch;     ///< Renderer wants texture_batch?
+    bool m_deferred = false;           ///< Last execution awaits async JIT?
+    mutable std::vector<FlatClosure> m_flat_closures;  ///< Scratch list
     SimplePool<64 * 1024> m_scratch_pool;
 
-    Dictionary *m_dictionary;
-
     // Struct for holding a record of getattributes we've tried and
     // failed, to speed up subsequent getattributes calls.
     struct GetAttribQuery {
@@ -1801,9 +2251,78 @@ private:
     GetAttribQuery m_failed_attribs[FAILED_ATTRIBS];
     int m_next_failed_attrib;
 
-    // Buffering of error messages and printfs
-    typedef std::pair<ErrorHandler::ErrCode, std::string> ErrorItem;
-    mutable std::vector<ErrorItem> m_buffered_errors;
+    // Cache of successfully retrieved attributes that the renderer said
+    // are constant for the object (see RendererServices::attribute_is_constant).
+    struct AttribCacheKey {
+        void *objdata;    // NULL when looking up a named object
+        ustring obj_name, attr_name;
+        TypeDesc attr_type;
+        int array_lookup, index, derivs;
+        bool operator== (const AttribCacheKey &k) const {
+            return objdata == k.objdata && obj_name == k.obj_name &&
+                   attr_name == k.attr_name && attr_type == k.attr_type &&
+                   array_lookup == k.array_lookup && index == k.index &&
+                   derivs == k.derivs;
+        }
+    };
+    struct AttribCacheKeyHash {
+        // Mix each field in turn (as boost::hash_combine does), so that
+        // keys differing only by which field holds a value don't collide.
+        static void combine (size_t &h, size_t v) {
+            h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2);
+        }
+        size_t operator() (const AttribCacheKey &k) const {
+            size_t h = k.attr_name.hash();
+            combine (h, k.obj_name.hash());
+            combine (h, size_t(k.objdata));
+            combine (h, size_t(k.attr_type.basetype));
+            combine (h, size_t(k.attr_type.aggregate));
+            combine (h, size_t(k.attr_type.arraylen));
+            combine (h, size_t(k.array_lookup));
+            combine (h, size_t(k.index));
+            combine (h, size_t(k.derivs));
+            return h;
+        }
+    };
+    static const size_t MAX_CACHED_ATTRIBS = 1024;
+    std::unordered_map<AttribCacheKey, std::vector<char>, AttribCacheKeyHash> m_attrib_cache;
+    int m_attrib_cache_epoch;   ///< ShadingSystem's epoch when filled
+
+    // Matrices fetched from the renderer during the current shade, and
+    // (indexed by 'inverse') the ones it said are constant across shades.
+    struct MatrixCacheEntry {
+        ustring name;
+        TransformationPtr xform;  // sg's, for "shader" and "object"
+        float time;
+        bool inverse, ok;
+        Matrix44 M;
+    };
+    static const int MATRIX_CACHE_SIZE = 8;
+    MatrixCacheEntry m_matrix_cache[MATRIX_CACHE_SIZE];
+    int m_matrix_cache_size;
+    int m_next_matrix_cache;
+    static const size_t MAX_CONSTANT_MATRICES = 256;
+    std::unordered_map<ustring, Matrix44, ustringHash> m_constant_matrices[2];
+
+    // Buffering of error messages and printfs.  Each message is packed
+    // into m_msgbuf as a BufferedMsg header followed by its text, and
+    // the buffer is handed to the ShadingSystem whenever it fills up or
+    // process_errors() is called.  Its memory is reused for the life of
+    // the context, so recording a message doesn't touch the allocator.
+    struct BufferedMsg {
+        ErrorHandler::ErrCode code;
+        size_t length;
+    };
+    static const size_t MSGBUF_SIZE = 64*1024;
+    mutable std::unique_ptr<char[]> m_msgbuf;
+    mutable size_t m_msgbuf_used;
+    mutable std::string m_msg_scratch;  ///< Reused to pass out messages
+
+    // Append a message to the buffer, flushing first if needed.  Return
+    // a pointer to where its text goes, or NULL if it can never fit.
+    char *append_msg (ErrorHandler::ErrCode code, size_t length) const;
+    // Pass one message on to the ShadingSystem.
+    void emit_msg (ErrorHandler::ErrCode code, const std::string &text) const;
 };
 
 
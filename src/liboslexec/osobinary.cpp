@@ -0,0 +1,547 @@
+/*
+Copyright (c) 2009-2019 Sony Pictures Imageworks Inc., et al.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+* Neither the name of Sony Pictures Imageworks nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////
+/// \file
+///
+/// Binary oso: reading it back through the OSOReader callbacks, and
+/// OSOBinaryWriter, which makes it.
+///
+/// Binary oso is laid out as:
+///
+///     BinaryHeader
+///     string table:  for each string, uint32 length, chars, '\0'
+///     records:       for each OSOReader callback, a one-byte record
+///                    code and its arguments (int32, float, or uint32
+///                    string table index), ending with BinEnd
+///
+/// Everything is in the byte order of the machine that wrote it, which
+/// is recorded in the header so that a mismatch is caught rather than
+/// misread.
+///
+/////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+# include <sys/mman.h>
+#endif
+
+#include <OpenImageIO/filesystem.h>
+
+#include "osoreader.h"
+
+
+OSL_NAMESPACE_ENTER
+
+namespace pvt {   // OSL::pvt
+
+
+namespace {
+
+enum BinaryRecord {
+    BinEnd = 0, BinVersion, BinShader, BinSymbol,
+    BinDefaultInt, BinDefaultFloat, BinDefaultString, BinParameterDone,
+    BinHint, BinCodemarker, BinCodeend, BinInstruction,
+    BinInstructionArg, BinInstructionJump, BinInstructionEnd
+};
+
+enum BinaryTypeKind { BinTypeSimple = 0, BinTypeClosure, BinTypeStruct };
+
+static const char binary_magic[8] = { '\177', 'O', 'S', 'O', 'B', 'I', 'N', '\n' };
+static const uint32_t binary_byteorder = 0x01020304;
+static const uint32_t binary_version = 1;
+
+struct BinaryHeader {
+    char magic[8];
+    uint32_t byteorder;     ///< binary_byteorder, as the writer saw it
+    uint32_t version;       ///< Binary oso format version
+    uint32_t nstrings;      ///< Number of strings in the table
+    uint32_t stringbytes;   ///< Size of the string table
+    uint32_t recordbytes;   ///< Size of the records
+};
+
+
+
+// Reads values out of a range of bytes, noting (rather than running
+// off the end) if the data is truncated or otherwise malformed.
+class BinaryCursor {
+public:
+    BinaryCursor (const char *begin, const char *end)
+        : m_pos(begin), m_end(end), m_ok(true) { }
+
+    template<typename T> T get () {
+        T val = T();
+        if (size_t(m_end - m_pos) >= sizeof(T)) {
+            memcpy (&val, m_pos, sizeof(T));
+            m_pos += sizeof(T);
+        } else {
+            m_ok = false;
+        }
+        return val;
+    }
+
+    const char *skip (size_t n) {
+        if (size_t(m_end - m_pos) < n) {
+            m_ok = false;
+            return NULL;
+        }
+        const char *p = m_pos;
+        m_pos += n;
+        return p;
+    }
+
+    void fail () { m_ok = false; }
+    bool ok () const { return m_ok; }
+
+private:
+    const char *m_pos, *m_end;
+    bool m_ok;
+};
+
+}  // anonymous namespace
+
+
+
+bool
+OSOReader::is_binary (string_view buffer)
+{
+    return buffer.size() >= sizeof(binary_magic) &&
+           ! memcmp (buffer.data(), binary_magic, sizeof(binary_magic));
+}
+
+
+
+bool
+OSOReader::parse_binary (string_view buffer, string_view name)
+{
+    BinaryHeader header;
+    if (! is_binary (buffer) || buffer.size() < sizeof(header)) {
+        m_err.error ("%s is not binary oso", name);
+        return false;
+    }
+    memcpy (&header, buffer.data(), sizeof(header));
+    if (header.byteorder != binary_byteorder) {
+        m_err.error ("%s is binary oso written with a different byte order",
+                     name);
+        return false;
+    }
+    if (header.version != binary_version) {
+        m_err.error ("%s is binary oso version %d, expected %d", name,
+                     header.version, binary_version);
+        return false;
+    }
+    const char *strings_begin = buffer.data() + sizeof(header);
+    const char *records_begin = strings_begin + header.stringbytes;
+    if (size_t(header.stringbytes) + size_t(header.recordbytes) >
+            buffer.size() - sizeof(header) ||
+        size_t(header.nstrings) * (sizeof(uint32_t) + 1) > header.stringbytes) {
+        m_err.error ("%s is truncated", name);
+        return false;
+    }
+
+    // Intern the whole string table up front, so each string costs one
+    // ustring lookup no matter how many records refer to it.
+    std::vector<const char *> strings (header.nstrings, "");
+    BinaryCursor s (strings_begin, records_begin);
+    for (auto &str : strings) {
+        uint32_t len = s.get<uint32_t>();
+        const char *chars = s.skip (size_t(len) + 1);
+        if (! chars)
+            break;
+        str = ustring (chars, 0, len).c_str();
+    }
+    if (! s.ok()) {
+        m_err.error ("%s has a corrupt string table", name);
+        return false;
+    }
+
+    BinaryCursor c (records_begin, records_begin + header.recordbytes);
+    auto get_string = [&]() -> const char * {
+        uint32_t i = c.get<uint32_t>();
+        if (i < strings.size())
+            return strings[i];
+        c.fail ();
+        return "";
+    };
+
+    // N.B. Each record's arguments are read into locals first, since the
+    // order in which function arguments are evaluated is unspecified.
+    bool done = false;
+    while (! done && c.ok()) {
+        switch (c.get<uint8_t>()) {
+        case BinEnd :
+            done = true;
+            break;
+        case BinVersion : {
+            const char *specid = get_string();
+            int major = c.get<int32_t>();
+            int minor = c.get<int32_t>();
+            version (specid, major, minor);
+            break;
+        }
+        case BinShader : {
+            const char *shadertype = get_string();
+            const char *shadername = get_string();
+            shader (shadertype, shadername);
+            break;
+        }
+        case BinSymbol : {
+            SymType symtype = (SymType) c.get<int32_t>();
+            int kind = c.get<int32_t>();
+            TypeSpec typespec;
+            if (kind == BinTypeStruct) {
+                typespec = struct_typespec (get_string());
+            } else {
+                int basetype = c.get<int32_t>();
+                int aggregate = c.get<int32_t>();
+                int vecsemantics = c.get<int32_t>();
+                TypeDesc simple ((TypeDesc::BASETYPE)basetype,
+                                 (TypeDesc::AGGREGATE)aggregate,
+                                 (TypeDesc::VECSEMANTICS)vecsemantics);
+                typespec = TypeSpec (simple, kind == BinTypeClosure);
+            }
+            int arraylen = c.get<int32_t>();
+            if (arraylen)
+                typespec.make_array (arraylen);
+            const char *symname = get_string();
+            if (! c.ok())
+                break;
+            if (symtype == SymTypeTemp && stop_parsing_at_temp_symbols())
+                return true;
+            symbol (symtype, typespec, symname);
+            break;
+        }
+        case BinDefaultInt : {
+            int def = c.get<int32_t>();
+            symdefault (def);
+            break;
+        }
+        case BinDefaultFloat : {
+            float def = c.get<float>();
+            symdefault (def);
+            break;
+        }
+        case BinDefaultString :
+            symdefault (get_string());
+            break;
+        case BinParameterDone :
+            parameter_done ();
+            break;
+        case BinHint :
+            hint (get_string());
+            break;
+        case BinCodemarker : {
+            const char *codename = get_string();
+            if (! parse_code_section())
+                return c.ok();
+            codemarker (codename);
+            break;
+        }
+        case BinCodeend :
+            codeend ();
+            break;
+        case BinInstruction : {
+            int label = c.get<int32_t>();
+            const char *opcode = get_string();
+            instruction (label, opcode);
+            break;
+        }
+        case BinInstructionArg :
+            instruction_arg (get_string());
+            break;
+        case BinInstructionJump : {
+            int target = c.get<int32_t>();
+            instruction_jump (target);
+            break;
+        }
+        case BinInstructionEnd :
+            instruction_end ();
+            break;
+        default :
+            c.fail ();
+            break;
+        }
+    }
+    if (! c.ok() || ! done) {
+        m_err.error ("Failed parse of binary oso %s", name);
+        return false;
+    }
+    return true;
+}
+
+
+
+bool
+OSOReader::parse_binary_file (const std::string &filename, bool &ok)
+{
+    FILE *file = OIIO::Filesystem::fopen (filename, "rb");
+    if (! file)
+        return false;
+    char magic[sizeof(binary_magic)];
+    if (fread (magic, 1, sizeof(magic), file) != sizeof(magic) ||
+            ! is_binary (string_view (magic, sizeof(magic)))) {
+        fclose (file);
+        return false;   // Not binary oso, leave it to the text parser
+    }
+
+    size_t size = (size_t) OIIO::Filesystem::file_size (filename);
+#ifndef _WIN32
+    // Binary oso holds no pointers, so we can parse it in place.
+    void *mapped = size ? mmap (NULL, size, PROT_READ, MAP_PRIVATE,
+                                fileno(file), 0)
+                        : MAP_FAILED;
+    if (mapped != MAP_FAILED) {
+        fclose (file);
+        ok = parse_binary (string_view ((const char *)mapped, size), filename);
+        munmap (mapped, size);
+        return true;
+    }
+#endif
+    std::string contents (size, '\0');
+    fseek (file, 0, SEEK_SET);
+    size_t nread = fread (&contents[0], 1, size, file);
+    fclose (file);
+    contents.resize (nread);
+    ok = parse_binary (contents, filename);
+    return true;
+}
+
+
+
+void
+OSOBinaryWriter::put_int (int i)
+{
+    int32_t val = i;
+    m_records.append ((const char *)&val, sizeof(val));
+}
+
+
+
+void
+OSOBinaryWriter::put_float (float f)
+{
+    m_records.append ((const char *)&f, sizeof(f));
+}
+
+
+
+void
+OSOBinaryWriter::put_string (string_view s)
+{
+    ustring us (s);
+    auto found = m_stringmap.find (us);
+    int index;
+    if (found != m_stringmap.end()) {
+        index = found->second;
+    } else {
+        index = (int) m_strings.size();
+        m_strings.push_back (us);
+        m_stringmap[us] = index;
+    }
+    uint32_t val = index;
+    m_records.append ((const char *)&val, sizeof(val));
+}
+
+
+
+bool
+OSOBinaryWriter::convert (const std::string &oso, std::string &binary)
+{
+    m_records.clear ();
+    m_strings.clear ();
+    m_stringmap.clear ();
+    if (! parse_memory (oso))
+        return false;
+    put_code (BinEnd);
+
+    std::string strings;
+    for (ustring s : m_strings) {
+        uint32_t len = (uint32_t) s.length();
+        strings.append ((const char *)&len, sizeof(len));
+        strings.append (s.c_str(), s.length() + 1);
+    }
+
+    BinaryHeader header;
+    memcpy (header.magic, binary_magic, sizeof(binary_magic));
+    header.byteorder = binary_byteorder;
+    header.version = binary_version;
+    header.nstrings = (uint32_t) m_strings.size();
+    header.stringbytes = (uint32_t) strings.size();
+    header.recordbytes = (uint32_t) m_records.size();
+    binary.assign ((const char *)&header, sizeof(header));
+    binary += strings;
+    binary += m_records;
+    return true;
+}
+
+
+
+void
+OSOBinaryWriter::version (const char *specid, int major, int minor)
+{
+    put_code (BinVersion);
+    put_string (specid);
+    put_int (major);
+    put_int (minor);
+}
+
+
+
+void
+OSOBinaryWriter::shader (const char *shadertype, const char *name)
+{
+    put_code (BinShader);
+    put_string (shadertype);
+    put_string (name);
+}
+
+
+
+void
+OSOBinaryWriter::symbol (SymType symtype, TypeSpec typespec, const char *name)
+{
+    put_code (BinSymbol);
+    put_int (symtype);
+    if (typespec.is_structure_based()) {
+        put_int (BinTypeStruct);
+        put_string (typespec.structspec()->name());
+    } else {
+        const TypeDesc &simple (typespec.simpletype());
+        put_int (typespec.is_closure_based() ? BinTypeClosure : BinTypeSimple);
+        put_int (simple.basetype);
+        put_int (simple.aggregate);
+        put_int (simple.vecsemantics);
+    }
+    put_int (typespec.simpletype().arraylen);
+    put_string (name);
+}
+
+
+
+void
+OSOBinaryWriter::symdefault (int def)
+{
+    put_code (BinDefaultInt);
+    put_int (def);
+}
+
+
+
+void
+OSOBinaryWriter::symdefault (float def)
+{
+    put_code (BinDefaultFloat);
+    put_float (def);
+}
+
+
+
+void
+OSOBinaryWriter::symdefault (const char *def)
+{
+    put_code (BinDefaultString);
+    put_string (def);
+}
+
+
+
+void
+OSOBinaryWriter::parameter_done ()
+{
+    put_code (BinParameterDone);
+}
+
+
+
+void
+OSOBinaryWriter::hint (string_view hintstring)
+{
+    put_code (BinHint);
+    put_string (hintstring);
+}
+
+
+
+void
+OSOBinaryWriter::codemarker (const char *name)
+{
+    put_code (BinCodemarker);
+    put_string (name);
+}
+
+
+
+void
+OSOBinaryWriter::codeend ()
+{
+    put_code (BinCodeend);
+}
+
+
+
+void
+OSOBinaryWriter::instruction (int label, const char *opcode)
+{
+    put_code (BinInstruction);
+    put_int (label);
+    put_string (opcode);
+}
+
+
+
+void
+OSOBinaryWriter::instruction_arg (const char *name)
+{
+    put_code (BinInstructionArg);
+    put_string (name);
+}
+
+
+
+void
+OSOBinaryWriter::instruction_jump (int target)
+{
+    put_code (BinInstructionJump);
+    put_int (target);
+}
+
+
+
+void
+OSOBinaryWriter::instruction_end ()
+{
+    put_code (BinInstructionEnd);
+}
+
+
+
+}; // namespace pvt
+OSL_NAMESPACE_EXIT
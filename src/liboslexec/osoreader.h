@@ -28,6 +28,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
 #include "osl_pvt.h"
 
 #include <OpenImageIO/thread.h>
@@ -62,6 +65,21 @@ public:
     /// an unrecoverable error reading.
     virtual bool parse_memory (const std::string &buffer);
 
+    /// Parse binary oso (as made by OSOBinaryWriter) from memory, calling
+    /// the same callbacks as for text oso.  This needs neither the lexer
+    /// nor its lock.  The name is only used in error messages.  Return
+    /// true if it was correctly parsed.  parse_file and parse_memory
+    /// recognize binary oso themselves, so few callers need this.
+    bool parse_binary (string_view buffer, string_view name);
+
+    /// Is the buffer (or at least its beginning) binary oso?
+    static bool is_binary (string_view buffer);
+
+    /// If the named file is binary oso, parse it (setting ok to whether
+    /// that succeeded) and return true.  Return false if it isn't binary
+    /// oso, so the caller should parse it as text.
+    bool parse_binary_file (const std::string &filename, bool &ok);
+
     /// Declare the shader version.
     ///
     virtual void version (const char *specid, int major, int minor) { }
@@ -142,11 +160,59 @@ public:
     static OSOReader *osoreader;
 
 private:
+    /// Return the TypeSpec of the named struct, taking the same lock as
+    /// the (not thread-safe) text parser, which also adds to the struct
+    /// table.
+    static TypeSpec struct_typespec (const char *structname);
+
     ErrorHandler &m_err;
     int m_lineno;
 };
 
 
 
+/// OSOReader that records everything it's handed as binary oso: a header,
+/// a table holding each distinct string once, and a flat stream of
+/// fixed-layout records, one per callback.  Binary oso holds no pointers,
+/// so it can be read straight out of a file or memory map, and reading it
+/// back with parse_binary() skips the text lexing and number parsing
+/// entirely, while presenting exactly what the text oso would have.
+class OSOBinaryWriter : public OSOReader {
+public:
+    OSOBinaryWriter (ErrorHandler *errhandler = NULL)
+        : OSOReader (errhandler) { }
+    virtual ~OSOBinaryWriter () { }
+
+    /// Convert oso (text or binary) to binary oso.  Return true if ok.
+    bool convert (const std::string &oso, std::string &binary);
+
+    virtual void version (const char *specid, int major, int minor);
+    virtual void shader (const char *shadertype, const char *name);
+    virtual void symbol (SymType symtype, TypeSpec typespec, const char *name);
+    virtual void symdefault (int def);
+    virtual void symdefault (float def);
+    virtual void symdefault (const char *def);
+    virtual void parameter_done ();
+    virtual void hint (string_view hintstring);
+    virtual void codemarker (const char *name);
+    virtual void codeend ();
+    virtual void instruction (int label, const char *opcode);
+    virtual void instruction_arg (const char *name);
+    virtual void instruction_jump (int target);
+    virtual void instruction_end ();
+
+private:
+    void put_code (int code) { m_records += char(code); }
+    void put_int (int i);
+    void put_float (float f);
+    void put_string (string_view s);
+
+    std::string m_records;                 ///< The record stream
+    std::vector<ustring> m_strings;        ///< The string table
+    std::unordered_map<ustring,int,ustringHash> m_stringmap;
+};
+
+
+
 }; // namespace pvt
 OSL_NAMESPACE_EXIT
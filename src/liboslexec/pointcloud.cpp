@@ -27,6 +27,20 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cstdarg>
+#include <cstring>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include <OpenImageIO/filesystem.h>
 
 #include "oslexec_pvt.h"
 using namespace OSL;
@@ -34,13 +48,715 @@ using namespace OSL::pvt;
 
 #if USE_PARTIO
 #include <Partio.h>
-#include <unordered_map>
 #endif
 
 
 
 namespace { // anon
 
+static ustring u_position ("position");
+
+
+
+// Helper: number of base values
+inline int
+basevals (TypeDesc t)
+{
+    return t.numelements() * int(t.aggregate);
+}
+
+
+
+bool
+compatible_cloud_type (TypeDesc file_type, TypeDesc osl_element_type)
+{
+    // Matching types (treating all VEC3 aggregates as equivalent)...
+    if (equivalent (file_type, osl_element_type))
+        return true;
+
+    // Consider arrays and aggregates as interchangeable, as long as the
+    // totals are the same.
+    if (file_type.basetype == osl_element_type.basetype &&
+        basevals(file_type) == basevals(osl_element_type))
+        return true;
+
+    // The file may contain an array size that OSL can't exactly
+    // represent, for example the file's type may be float[4], and the
+    // OSL array will be float[] but the element type will be just float
+    // because OSL doesn't permit multi-dimensional arrays.
+    // Just allow it anyway and fill in the OSL array.
+    if (TypeDesc::BASETYPE(file_type.basetype) == osl_element_type)
+        return true;
+
+    return false;
+}
+
+
+
+// Native point clouds.
+//
+// Point clouds whose file names end in ".oslpc" are handled by OSL
+// itself rather than by Partio, so they work in builds without Partio.
+// The file is a small header followed by one uncompressed column per
+// attribute, so a cloud is memory-mapped rather than read, and the
+// attribute data is paged in only as pointcloud_get touches it:
+//
+//     char     magic[8]        "OSLPC001"
+//     uint64   npoints
+//     uint32   nattribs
+//     uint32   reserved (0)
+//     nattribs records of:
+//         char     name[48]    (nul-terminated)
+//         uint8    basetype, aggregate, vecsemantics, reserved
+//         int32    arraylen
+//         uint64   offset      (from start of file, 16-byte aligned)
+//     attribute columns, each npoints * type.size() bytes
+//
+// A float[3] aggregate attribute named "position" is required.  All
+// values are in native (little-endian) byte order.
+
+static const char native_pc_magic[8] = { 'O','S','L','P','C','0','0','1' };
+
+struct NativePCHeader {
+    char magic[8];
+    uint64_t npoints;
+    uint32_t nattribs;
+    uint32_t reserved;
+};
+
+struct NativePCAttribRecord {
+    char name[48];
+    unsigned char basetype, aggregate, vecsemantics, reserved;
+    int32_t arraylen;
+    uint64_t offset;
+};
+
+
+
+inline bool
+is_native_pointcloud (ustring filename)
+{
+    return Strutil::ends_with (filename.string(), ".oslpc");
+}
+
+
+
+// Flattened KD-tree over point positions.
+//
+// The tree is implicit: for any range [begin,end) of tree slots, the
+// median point lives at slot (begin+end)/2, the lower half of the range
+// is its left subtree and the upper half its right subtree, and ranges
+// of LeafSize or fewer points are scanned linearly.  So there are no
+// node pointers at all -- just the positions, reordered into tree order
+// so that a search touches contiguous memory, and the mapping from
+// each tree slot back to the point's index in the file.
+class PointKDTree {
+public:
+    /// Build the tree for the given positions (npoints must be < 2^32).
+    void build (const Vec3 *pos, size_t npoints);
+
+    /// Find the (at most) max_points points closest to center and within
+    /// radius.  Tree slots are returned in slots[] and squared distances
+    /// in dist2[], sorted nearest first if sort is true.  Return the
+    /// number of points found.
+    int search (const Vec3 &center, float radius, int max_points, bool sort,
+                size_t *slots, float *dist2) const;
+
+    size_t size () const { return m_pos.size(); }
+    const Vec3 & position (size_t slot) const { return m_pos[slot]; }
+    size_t index (size_t slot) const { return m_index[slot]; }
+
+private:
+    enum { LeafSize = 8, MaxDepth = 64 };
+
+    void build_range (const Vec3 *pos, size_t begin, size_t end,
+                      int depth, int parallel_depth);
+
+    std::vector<Vec3> m_pos;             ///< Positions, in tree order
+    std::vector<uint32_t> m_index;       ///< File index of each tree slot
+    std::vector<unsigned char> m_axis;   ///< Split axis of median slots
+};
+
+
+
+void
+PointKDTree::build (const Vec3 *pos, size_t npoints)
+{
+    m_index.resize (npoints);
+    m_axis.resize (npoints, 0);
+    for (size_t i = 0;  i < npoints;  ++i)
+        m_index[i] = (uint32_t) i;
+
+    // Split the top levels of the tree across threads.
+    int parallel_depth = 0;
+    for (unsigned int n = std::thread::hardware_concurrency();  n > 1;  n >>= 1)
+        ++parallel_depth;
+    build_range (pos, 0, npoints, 0, parallel_depth);
+
+    m_pos.resize (npoints);
+    for (size_t i = 0;  i < npoints;  ++i)
+        m_pos[i] = pos[m_index[i]];
+}
+
+
+
+void
+PointKDTree::build_range (const Vec3 *pos, size_t begin, size_t end,
+                          int depth, int parallel_depth)
+{
+    if (end - begin <= LeafSize)
+        return;
+
+    // Split along the longest axis of the range's bounds.
+    Vec3 lo = pos[m_index[begin]], hi = lo;
+    for (size_t i = begin+1;  i < end;  ++i) {
+        const Vec3 &p (pos[m_index[i]]);
+        lo.x = std::min (lo.x, p.x);  hi.x = std::max (hi.x, p.x);
+        lo.y = std::min (lo.y, p.y);  hi.y = std::max (hi.y, p.y);
+        lo.z = std::min (lo.z, p.z);  hi.z = std::max (hi.z, p.z);
+    }
+    Vec3 extent = hi - lo;
+    int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0
+             : (extent.y >= extent.z ? 1 : 2);
+
+    size_t mid = (begin + end) / 2;
+    std::nth_element (m_index.begin()+begin, m_index.begin()+mid,
+                      m_index.begin()+end,
+                      [=](uint32_t a, uint32_t b) {
+                          return pos[a][axis] < pos[b][axis];
+                      });
+    m_axis[mid] = (unsigned char) axis;
+
+    if (depth < parallel_depth && end - begin > 65536) {
+        auto left = std::async (std::launch::async, [=]() {
+            build_range (pos, begin, mid, depth+1, parallel_depth);
+        });
+        build_range (pos, mid+1, end, depth+1, parallel_depth);
+        left.get ();
+    } else {
+        build_range (pos, begin, mid, depth+1, parallel_depth);
+        build_range (pos, mid+1, end, depth+1, parallel_depth);
+    }
+}
+
+
+
+// Helpers for maintaining a max-heap (keyed on dist2) in the caller's
+// parallel output arrays, so the k nearest points are gathered without
+// any scratch memory and come out sorted by a simple in-place heapsort.
+inline void
+pc_heap_sift_up (size_t *slots, float *dist2, int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (dist2[parent] >= dist2[i])
+            break;
+        std::swap (dist2[parent], dist2[i]);
+        std::swap (slots[parent], slots[i]);
+        i = parent;
+    }
+}
+
+
+
+inline void
+pc_heap_sift_down (size_t *slots, float *dist2, int i, int n)
+{
+    for (;;) {
+        int largest = i, l = 2*i+1, r = 2*i+2;
+        if (l < n && dist2[l] > dist2[largest])
+            largest = l;
+        if (r < n && dist2[r] > dist2[largest])
+            largest = r;
+        if (largest == i)
+            break;
+        std::swap (dist2[largest], dist2[i]);
+        std::swap (slots[largest], slots[i]);
+        i = largest;
+    }
+}
+
+
+
+int
+PointKDTree::search (const Vec3 &center, float radius, int max_points,
+                     bool sort, size_t *slots, float *dist2) const
+{
+    if (max_points <= 0 || m_pos.empty())
+        return 0;
+    float r2 = radius * radius;
+    int count = 0;
+
+    // Visit a point: add it to the heap if it's closer than the current
+    // search radius, shrinking the radius once the heap is full.
+    auto visit = [&](size_t slot) {
+        float d2 = (m_pos[slot] - center).length2();
+        if (d2 >= r2)
+            return;
+        if (count < max_points) {
+            slots[count] = slot;
+            dist2[count] = d2;
+            pc_heap_sift_up (slots, dist2, count++);
+            if (count == max_points)
+                r2 = dist2[0];
+        } else {
+            slots[0] = slot;
+            dist2[0] = d2;
+            pc_heap_sift_down (slots, dist2, 0, count);
+            r2 = dist2[0];
+        }
+    };
+
+    // Depth-first traversal with an explicit stack.  Each entry records
+    // the squared distance to the splitting plane that separates it from
+    // the center, so subtrees can be culled once the radius shrinks.
+    struct Entry { size_t begin, end; float plane_d2; };
+    Entry stack[2*MaxDepth];
+    int sp = 0;
+    stack[sp++] = { 0, m_pos.size(), 0.0f };
+    while (sp) {
+        Entry e = stack[--sp];
+        if (e.plane_d2 >= r2)
+            continue;
+        if (e.end - e.begin <= LeafSize) {
+            for (size_t i = e.begin;  i < e.end;  ++i)
+                visit (i);
+            continue;
+        }
+        size_t mid = (e.begin + e.end) / 2;
+        int axis = m_axis[mid];
+        visit (mid);
+        float d = center[axis] - m_pos[mid][axis];
+        Entry lower = { e.begin, mid, 0.0f };
+        Entry upper = { mid+1, e.end, 0.0f };
+        // Push the far side first so the near side is searched first.
+        if (d < 0.0f) {
+            upper.plane_d2 = d * d;
+            stack[sp++] = upper;
+            stack[sp++] = lower;
+        } else {
+            lower.plane_d2 = d * d;
+            stack[sp++] = lower;
+            stack[sp++] = upper;
+        }
+    }
+
+    if (sort) {
+        // Heapsort in place: repeatedly move the farthest to the end.
+        for (int n = count-1;  n > 0;  --n) {
+            std::swap (dist2[0], dist2[n]);
+            std::swap (slots[0], slots[n]);
+            pc_heap_sift_down (slots, dist2, 0, n);
+        }
+    }
+    return count;
+}
+
+
+
+class NativePointCloud {
+public:
+    NativePointCloud (ustring filename, bool write);
+    ~NativePointCloud ();
+
+    /// Return the named cloud, loading it (or creating it, for writing)
+    /// if necessary.  Return NULL if it can't be read.
+    static NativePointCloud *get (ustring filename, bool write = false);
+
+    int search (ShaderGlobals *sg, const Vec3 &center, float radius,
+                int max_points, bool sort, size_t *out_indices,
+                float *out_distances, int derivs_offset) const;
+    int get_data (ShaderGlobals *sg, const size_t *indices, int count,
+                  ustring attr_name, TypeDesc attr_type, void *out_data) const;
+    bool write_point (const Vec3 &pos, int nattribs, const ustring *names,
+                      const TypeDesc *types, const void **data);
+
+    bool valid () const { return m_valid; }
+
+    /// For a cloud being written, save the file now rather than when
+    /// it's destroyed, and return whether that succeeded.
+    bool save ();
+
+    /// Call f(pos, nattribs, names, types, data) for each point of a
+    /// cloud being read, in file order, with its attributes other than
+    /// position (as pointcloud_write takes them).
+    template<class F> void each_point (F f) const;
+
+private:
+    struct Attrib {
+        TypeDesc type;              ///< Type of the attribute per point
+        const char *data;           ///< Column of values (when reading)
+        std::vector<char> written;  ///< Accumulated values (when writing)
+        Attrib () : data(NULL) { }
+    };
+    typedef std::unordered_map<ustring, Attrib, ustringHash> AttributeMap;
+
+    bool read ();
+    bool write_file () const;
+
+    ustring m_filename;
+    bool m_write;
+    bool m_valid;
+    size_t m_npoints;
+    AttributeMap m_attributes;
+    PointKDTree m_tree;
+    const char *m_filedata;         ///< Whole file, mapped or read
+    size_t m_filesize;
+    std::vector<char> m_filebuffer; ///< Storage if we couldn't mmap
+    spin_mutex m_mutex;             ///< Serializes writes
+};
+
+
+typedef std::unordered_map<ustring, std::unique_ptr<NativePointCloud>, ustringHash> NativePointCloudMap;
+static NativePointCloudMap native_pointclouds;
+static OIIO::spin_rw_mutex native_pointclouds_mutex;  // Guards the map
+static mutex native_pointclouds_load_mutex;          // Serializes loads
+
+
+
+NativePointCloud *
+NativePointCloud::get (ustring filename, bool write)
+{
+    if (filename.empty())
+        return NULL;
+    auto lookup = [&]() -> NativePointCloud* {
+        OIIO::spin_rw_read_lock lock (native_pointclouds_mutex);
+        NativePointCloudMap::const_iterator found = native_pointclouds.find (filename);
+        return found != native_pointclouds.end() ? found->second.get() : NULL;
+    };
+    // The usual case, a cloud that's already loaded, only needs the
+    // shared lock, so concurrent lookups don't serialize.
+    NativePointCloud *pc = lookup ();
+    if (! pc) {
+        // N.B. a full mutex, not a spin lock, since loading a cloud and
+        // building its tree may take a while. The map itself is only
+        // locked (exclusively) to add the new cloud, so lookups of the
+        // other clouds aren't held up by the load.
+        lock_guard load_lock (native_pointclouds_load_mutex);
+        pc = lookup ();   // Did another thread load it while we waited?
+        if (! pc) {
+            // Remember it even if it fails to read, so that we don't try
+            // again on every lookup.
+            pc = new NativePointCloud (filename, write);
+            OIIO::spin_rw_write_lock lock (native_pointclouds_mutex);
+            native_pointclouds[filename].reset (pc);
+        }
+    }
+    return pc->valid() ? pc : NULL;
+}
+
+
+
+NativePointCloud::NativePointCloud (ustring filename, bool write)
+    : m_filename(filename), m_write(write), m_valid(write), m_npoints(0),
+      m_filedata(NULL), m_filesize(0)
+{
+    if (m_write) {
+        m_attributes[u_position].type = TypeDesc (TypeDesc::FLOAT, TypeDesc::VEC3, TypeDesc::POINT);
+    } else {
+        m_valid = read ();
+    }
+}
+
+
+
+NativePointCloud::~NativePointCloud ()
+{
+    // Save the file if we wrote to it
+    if (m_write && m_npoints)
+        write_file ();
+#ifndef _WIN32
+    if (m_filedata && m_filebuffer.empty())
+        munmap ((void *)m_filedata, m_filesize);
+#endif
+}
+
+
+
+bool
+NativePointCloud::read ()
+{
+#ifndef _WIN32
+    int fd = open (m_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat (fd, &st) == 0 && st.st_size > 0) {
+        void *mapped = mmap (NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            m_filedata = (const char *) mapped;
+            m_filesize = size_t(st.st_size);
+        }
+    }
+    close (fd);
+#endif
+    if (! m_filedata) {
+        // No mmap -- read the whole thing into memory instead
+        FILE *file = OIIO::Filesystem::fopen (m_filename.string(), "rb");
+        if (! file)
+            return false;
+        fseek (file, 0, SEEK_END);
+        long size = ftell (file);
+        fseek (file, 0, SEEK_SET);
+        if (size > 0) {
+            m_filebuffer.resize (size_t(size));
+            if (fread (&m_filebuffer[0], 1, size_t(size), file) == size_t(size)) {
+                m_filedata = &m_filebuffer[0];
+                m_filesize = size_t(size);
+            }
+        }
+        fclose (file);
+        if (! m_filedata)
+            return false;
+    }
+
+    // Validate the header and attribute table
+    if (m_filesize < sizeof(NativePCHeader))
+        return false;
+    const NativePCHeader *header = (const NativePCHeader *) m_filedata;
+    if (memcmp (header->magic, native_pc_magic, sizeof(native_pc_magic)) ||
+        header->npoints >= (uint64_t(1) << 32) ||
+        uint64_t(m_filesize) < sizeof(NativePCHeader) + uint64_t(header->nattribs) * sizeof(NativePCAttribRecord))
+        return false;
+    m_npoints = size_t (header->npoints);
+    const NativePCAttribRecord *rec = (const NativePCAttribRecord *) (header + 1);
+    for (uint32_t i = 0;  i < header->nattribs;  ++i, ++rec) {
+        TypeDesc type (TypeDesc::BASETYPE(rec->basetype),
+                       TypeDesc::AGGREGATE(rec->aggregate),
+                       TypeDesc::VECSEMANTICS(rec->vecsemantics),
+                       rec->arraylen);
+        // Check that the column fits in the file, in 64 bits and without
+        // forming offset + npoints*size, which a corrupt record could
+        // make overflow.
+        uint64_t size = type.size();
+        if (rec->offset % 16 || rec->arraylen < 0 ||
+            rec->offset > uint64_t(m_filesize) ||
+            (size && uint64_t(m_npoints) > (uint64_t(m_filesize) - rec->offset) / size))
+            return false;   // Truncated or corrupt
+        Attrib &a (m_attributes[ustring (rec->name, 0, strnlen (rec->name, sizeof(rec->name)))]);
+        a.type = type;
+        a.data = m_filedata + rec->offset;
+    }
+
+    AttributeMap::const_iterator pos = m_attributes.find (u_position);
+    if (pos == m_attributes.end() ||
+        pos->second.type.basetype != TypeDesc::FLOAT ||
+        basevals (pos->second.type) != 3)
+        return false;
+    m_tree.build ((const Vec3 *) pos->second.data, m_npoints);
+    return true;
+}
+
+
+
+bool
+NativePointCloud::write_file () const
+{
+    FILE *file = OIIO::Filesystem::fopen (m_filename.string(), "wb");
+    if (! file)
+        return false;
+
+    NativePCHeader header;
+    memcpy (header.magic, native_pc_magic, sizeof(native_pc_magic));
+    header.npoints = m_npoints;
+    header.nattribs = (uint32_t) m_attributes.size();
+    header.reserved = 0;
+    bool ok = fwrite (&header, sizeof(header), 1, file) == 1;
+
+    uint64_t offset = sizeof(header) + m_attributes.size() * sizeof(NativePCAttribRecord);
+    for (auto&& a : m_attributes) {
+        offset = (offset + 15) & ~uint64_t(15);
+        NativePCAttribRecord rec;
+        memset (&rec, 0, sizeof(rec));
+        strncpy (rec.name, a.first.c_str(), sizeof(rec.name)-1);
+        rec.basetype = a.second.type.basetype;
+        rec.aggregate = a.second.type.aggregate;
+        rec.vecsemantics = a.second.type.vecsemantics;
+        rec.arraylen = a.second.type.arraylen;
+        rec.offset = offset;
+        ok &= fwrite (&rec, sizeof(rec), 1, file) == 1;
+        offset += a.second.written.size();
+    }
+
+    // N.B. unordered_map iteration order is stable as long as the map
+    // isn't modified, so the columns are in the same order as above.
+    static const char zeros[16] = { 0 };
+    long pos = ftell (file);
+    for (auto&& a : m_attributes) {
+        long pad = ((pos + 15) & ~15L) - pos;
+        ok &= fwrite (zeros, 1, size_t(pad), file) == size_t(pad);
+        ok &= fwrite (a.second.written.data(), 1, a.second.written.size(), file)
+                  == a.second.written.size();
+        pos += pad + long(a.second.written.size());
+    }
+    fclose (file);
+    return ok;
+}
+
+
+
+bool
+NativePointCloud::save ()
+{
+    bool ok = m_write && write_file ();
+    m_write = false;   // Don't write it again when destroyed
+    return ok;
+}
+
+
+
+template<class F> void
+NativePointCloud::each_point (F f) const
+{
+    std::vector<ustring> names;
+    std::vector<TypeDesc> types;
+    std::vector<const char *> columns;
+    const Vec3 *pos = NULL;
+    for (auto&& a : m_attributes) {
+        if (a.first == u_position) {
+            pos = (const Vec3 *) a.second.data;
+        } else {
+            names.push_back (a.first);
+            types.push_back (a.second.type);
+            columns.push_back (a.second.data);
+        }
+    }
+    int nattribs = (int) names.size();
+    std::vector<const void *> data (nattribs);
+    for (size_t p = 0;  p < m_npoints;  ++p) {
+        for (int i = 0;  i < nattribs;  ++i)
+            data[i] = columns[i] + p * types[i].size();
+        f (pos[p], nattribs, names.data(), types.data(), data.data());
+    }
+}
+
+
+
+int
+NativePointCloud::search (ShaderGlobals *sg, const Vec3 &center, float radius,
+                          int max_points, bool sort, size_t *out_indices,
+                          float *out_distances, int derivs_offset) const
+{
+    float *dist2 = out_distances;
+    if (! dist2)  // If not supplied, allocate our own
+        dist2 = (float *)sg->context->alloc_scratch (max_points*sizeof(float), sizeof(float));
+
+    // The results come back as tree slots, already sorted if requested.
+    int count = m_tree.search (center, radius, max_points, sort,
+                               out_indices, dist2);
+
+    if (out_distances) {
+        // Convert the squared distances to straight distances
+        for (int i = 0; i < count; ++i)
+            out_distances[i] = sqrtf(dist2[i]);
+
+        if (derivs_offset) {
+            const Vec3 &dCdx = (&center)[1];
+            const Vec3 &dCdy = (&center)[2];
+            float *d_distance_dx = out_distances + derivs_offset;
+            float *d_distance_dy = out_distances + derivs_offset * 2;
+            for (int i = 0; i < count; ++i) {
+                if (out_distances[i] > 0) {
+                    Vec3 D = center - m_tree.position (out_indices[i]);
+                    d_distance_dx[i] = D.dot(dCdx) / out_distances[i];
+                    d_distance_dy[i] = D.dot(dCdy) / out_distances[i];
+                } else {
+                    // distance is 0, derivs would be infinite which could cause trouble downstream
+                    d_distance_dx[i] = 0;
+                    d_distance_dy[i] = 0;
+                }
+            }
+        }
+    }
+
+    // Translate tree slots into indices of points in the file
+    for (int i = 0; i < count; ++i)
+        out_indices[i] = m_tree.index (out_indices[i]);
+    return count;
+}
+
+
+
+int
+NativePointCloud::get_data (ShaderGlobals *sg, const size_t *indices,
+                            int count, ustring attr_name, TypeDesc attr_type,
+                            void *out_data) const
+{
+    AttributeMap::const_iterator found = m_attributes.find (attr_name);
+    if (m_write || found == m_attributes.end()) {
+        sg->context->error ("Accessing unexisting attribute %s in pointcloud \"%s\"", attr_name, m_filename);
+        return 0;
+    }
+    const Attrib &attr (found->second);
+
+    // Type the OSL shader has provided in destination array:
+    TypeDesc element_type = attr_type.elementtype ();
+    if (! compatible_cloud_type (attr.type, element_type)) {
+        sg->context->error ("Type of attribute \"%s\" : %s not compatible with OSL's %s in \"%s\" pointcloud",
+                            attr_name, attr.type, element_type, m_filename);
+        return 0;
+    }
+
+    // For safety, clamp the count to the most that will fit in the output
+    int maxn = basevals(attr_type) / basevals(attr.type);
+    if (maxn < count) {
+        sg->context->error ("Point cloud attribute \"%s\" : %s with retrieval count %d will not fit in %s",
+                            attr_name, attr.type, count, attr_type);
+        count = maxn;
+    }
+
+    size_t size = attr.type.size();
+    for (int i = 0;  i < count;  ++i) {
+        if (indices[i] >= m_npoints)
+            return 0;
+        memcpy ((char *)out_data + i*size, attr.data + indices[i]*size, size);
+    }
+    return 1;
+}
+
+
+
+bool
+NativePointCloud::write_point (const Vec3 &pos, int nattribs,
+                               const ustring *names, const TypeDesc *types,
+                               const void **data)
+{
+    spin_lock lock (m_mutex);
+    if (! m_write)
+        return false;
+
+    bool ok = true;
+    Attrib &P (m_attributes[u_position]);
+    P.written.insert (P.written.end(), (const char *)&pos, (const char *)(&pos+1));
+    for (int i = 0;  i < nattribs;  ++i) {
+        if (names[i] == u_position)
+            continue;
+        if (types[i].basetype != TypeDesc::FLOAT &&
+              types[i].basetype != TypeDesc::INT) {
+            ok = false;   // Only float- and int-based types are supported
+            continue;
+        }
+        Attrib &a (m_attributes[names[i]]);
+        if (a.type == TypeDesc::UNKNOWN)
+            a.type = types[i];   // first time we've seen this attribute
+        if (a.type != types[i]) {
+            ok = false;
+            continue;
+        }
+        // Zero-fill values for any earlier points that lacked it
+        a.written.resize (m_npoints * a.type.size(), 0);
+        a.written.insert (a.written.end(), (const char *)data[i],
+                          (const char *)data[i] + a.type.size());
+    }
+    ++m_npoints;
+    // Zero-fill any attributes not supplied for this point
+    for (auto&& a : m_attributes)
+        a.second.written.resize (m_npoints * a.second.type.size(), 0);
+    return ok;
+}
+
+
+
 #if USE_PARTIO
 
 class PointCloud {
@@ -75,7 +791,6 @@ typedef std::unordered_map<ustring, std::shared_ptr<PointCloud>, ustringHash> Po
 // See above note about shared_ptr vs unique_ptr.
 static PointCloudMap pointclouds;
 static spin_mutex pointcloudmap_mutex;
-static ustring u_position ("position");
 
 
 // some helper classes to make the sort easy
@@ -163,41 +878,6 @@ PartioType (TypeDesc t)
 
 
 
-// Helper: number of base values
-inline int
-basevals (TypeDesc t)
-{
-    return t.numelements() * int(t.aggregate);
-}
-
-
-
-bool
-compatiblePartioType (TypeDesc partio_type, TypeDesc osl_element_type)
-{
-    // Matching types (treating all VEC3 aggregates as equivalent)...
-    if (equivalent (partio_type, osl_element_type))
-        return true;
-
-    // Consider arrays and aggregates as interchangeable, as long as the
-    // totals are the same.
-    if (partio_type.basetype == osl_element_type.basetype &&
-        basevals(partio_type) == basevals(osl_element_type))
-        return true;
-
-    // The Partio file may contain an array size that OSL can't exactly
-    // represent, for example the partio type may be float[4], and the
-    // OSL array will be float[] but the element type will be just float
-    // because OSL doesn't permit multi-dimensional arrays.
-    // Just allow it anyway and fill in the OSL array.
-    if (TypeDesc::BASETYPE(partio_type.basetype) == osl_element_type)
-        return true;
-
-    return false;
-}
-
-
-
 TypeDesc
 TypeDescOfPartioType (const Partio::ParticleAttribute *ptype)
 {
@@ -237,6 +917,15 @@ RendererServices::pointcloud_search (ShaderGlobals *sg,
                                      size_t *out_indices,
                                      float *out_distances, int derivs_offset)
 {
+    if (is_native_pointcloud (filename)) {
+        NativePointCloud *pc = NativePointCloud::get (filename);
+        if (pc == NULL) { // The file failed to load
+            sg->context->error ("pointcloud_search: could not open \"%s\"", filename.c_str());
+            return 0;
+        }
+        return pc->search (sg, center, radius, max_points, sort,
+                           out_indices, out_distances, derivs_offset);
+    }
 #if USE_PARTIO
     if (filename.empty())
         return 0;
@@ -340,10 +1029,19 @@ RendererServices::pointcloud_get (ShaderGlobals *sg,
                                   ustring attr_name, TypeDesc attr_type,
                                   void *out_data)
 {
-#if USE_PARTIO
     if (! count)
         return 1;  // always succeed if not asking for any data
 
+    if (is_native_pointcloud (filename)) {
+        NativePointCloud *pc = NativePointCloud::get (filename);
+        if (pc == NULL) { // The file failed to load
+            sg->context->error ("pointcloud_get: could not open \"%s\"", filename);
+            return 0;
+        }
+        return pc->get_data (sg, indices, count, attr_name, attr_type, out_data);
+    }
+#if USE_PARTIO
+
     PointCloud *pc = PointCloud::get(filename);
     if (pc == NULL) { // The file failed to load
         sg->context->error ("pointcloud_get: could not open \"%s\"", filename);
@@ -369,7 +1067,7 @@ RendererServices::pointcloud_get (ShaderGlobals *sg,
     TypeDesc element_type = attr_type.elementtype ();
 
     // Finally check for some equivalent types like float3 and vector
-    if (!compatiblePartioType(partio_type, element_type)) {
+    if (!compatible_cloud_type(partio_type, element_type)) {
         sg->context->error ("Type of attribute \"%s\" : %s not compatible with OSL's %s in \"%s\" pointcloud",
                             attr_name, partio_type, element_type, filename);
         return 0;
@@ -407,6 +1105,12 @@ RendererServices::pointcloud_write (ShaderGlobals *sg,
                                     const TypeDesc *types,
                                     const void **data)
 {
+    if (is_native_pointcloud (filename)) {
+        NativePointCloud *pc = NativePointCloud::get (filename, true /* create file to write */);
+        if (pc == NULL)
+            return false;
+        return pc->write_point (pos, nattribs, names, types, data);
+    }
 #if USE_PARTIO
     if (filename.empty())
         return false;
@@ -476,6 +1180,85 @@ RendererServices::pointcloud_write (ShaderGlobals *sg,
 
 
 
+OSL_NAMESPACE_ENTER
+
+bool
+convert_pointcloud (string_view infile, string_view outfile,
+                    std::string &errmessage)
+{
+    ustring outname (outfile);
+    if (! is_native_pointcloud (outname)) {
+        errmessage = Strutil::sprintf ("\"%s\" does not end in .oslpc", outfile);
+        return false;
+    }
+    NativePointCloud out (outname, true);
+    bool ok = true;
+    auto write = [&](const Vec3 &pos, int nattribs, const ustring *names,
+                     const TypeDesc *types, const void **data) {
+        ok &= out.write_point (pos, nattribs, names, types, data);
+    };
+
+    ustring inname (infile);
+    if (is_native_pointcloud (inname)) {
+        NativePointCloud in (inname, false);
+        if (! in.valid()) {
+            errmessage = Strutil::sprintf ("could not read \"%s\"", infile);
+            return false;
+        }
+        in.each_point (write);
+    } else {
+#if USE_PARTIO
+        Partio::ParticlesDataMutable *cloud = Partio::read (inname.c_str());
+        if (! cloud) {
+            errmessage = Strutil::sprintf ("could not read \"%s\"", infile);
+            return false;
+        }
+        Partio::ParticleAttribute position;
+        if (! cloud->attributeInfo ("position", position)) {
+            cloud->release ();
+            errmessage = Strutil::sprintf ("\"%s\" has no position", infile);
+            return false;
+        }
+        std::vector<Partio::ParticleAttribute> attrs;
+        std::vector<ustring> names;
+        std::vector<TypeDesc> types;
+        for (int i = 0, e = cloud->numAttributes();  i < e;  ++i) {
+            Partio::ParticleAttribute a;
+            cloud->attributeInfo (i, a);
+            if (a.name == "position" || a.type == Partio::INDEXEDSTR)
+                continue;   // Strings can't be stored natively
+            attrs.push_back (a);
+            names.emplace_back (a.name);
+            types.push_back (TypeDescOfPartioType (&a));
+        }
+        std::vector<const void *> data (attrs.size());
+        for (int p = 0, n = cloud->numParticles();  p < n;  ++p) {
+            for (size_t i = 0;  i < attrs.size();  ++i)
+                data[i] = attrs[i].type == Partio::INT
+                              ? (const void *) cloud->data<int>(attrs[i], p)
+                              : (const void *) cloud->data<float>(attrs[i], p);
+            write (*(const Vec3 *) cloud->data<float>(position, p),
+                   (int) attrs.size(), names.data(), types.data(), data.data());
+        }
+        cloud->release ();
+#else
+        errmessage = Strutil::sprintf ("\"%s\" is not an .oslpc file, and OSL was built without Partio", infile);
+        return false;
+#endif
+    }
+    if (! ok)
+        errmessage = Strutil::sprintf ("some attributes of \"%s\" could not be converted", infile);
+    if (! out.save ()) {
+        errmessage = Strutil::sprintf ("could not write \"%s\"", outfile);
+        return false;
+    }
+    return ok;
+}
+
+OSL_NAMESPACE_EXIT
+
+
+
 OSL_SHADEOP int
 osl_pointcloud_search (ShaderGlobals *sg, const char *filename, void *center, float radius,
                        int max_points, int sort, void *out_indices, void *out_distances, int derivs_offset,
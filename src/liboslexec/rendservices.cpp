@@ -155,7 +155,7 @@ RendererServices::texture (ustring filename, TextureHandle *texture_handle,
                            float *result, float *dresultds, float *dresultdt,
                            ustring *errormessage)
 {
-    ShadingContext *context = sg->context;
+    ShadingContext *context = sg ? sg->context : NULL;
     if (! texture_thread_info)
         texture_thread_info = context->texture_thread_info();
     bool status;
@@ -184,6 +184,44 @@ RendererServices::texture (ustring filename, TextureHandle *texture_handle,
 
 
 
+bool
+RendererServices::texture_batch (ustring filename, TextureHandle *texture_handle,
+                                 TexturePerthread *texture_thread_info,
+                                 TextureOpt &options, ShaderGlobals *sg,
+                                 int npoints, const bool *mask,
+                                 const float *s, const float *t,
+                                 const float *dsdx, const float *dtdx,
+                                 const float *dsdy, const float *dtdy,
+                                 int nchannels, float *result,
+                                 float *dresultds, float *dresultdt,
+                                 ustring *errormessage)
+{
+    ShadingContext *context = sg ? sg->context : NULL;
+    if (! texture_thread_info)
+        texture_thread_info = get_texture_perthread (context);
+    // Resolve the file just once for the whole batch.
+    if (! texture_handle)
+        texture_handle = texturesys()->get_texture_handle (filename,
+                                                         texture_thread_info);
+    // Each point goes through the virtual texture(), so a renderer that
+    // only overrides that still sees every lookup; it also handles (or
+    // passes back) any errors.
+    bool status = true;
+    for (int i = 0;  i < npoints;  ++i) {
+        if (mask && ! mask[i])
+            continue;
+        size_t r = size_t(i) * nchannels;
+        status &= texture (filename, texture_handle, texture_thread_info,
+                           options, sg, s[i], t[i], dsdx[i], dtdx[i],
+                           dsdy[i], dtdy[i], nchannels, result + r,
+                           dresultds ? dresultds + r : NULL,
+                           dresultdt ? dresultdt + r : NULL, errormessage);
+    }
+    return status;
+}
+
+
+
 bool
 RendererServices::texture3d (ustring filename, TextureHandle *texture_handle,
                              TexturePerthread *texture_thread_info,
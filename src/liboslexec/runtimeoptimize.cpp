@@ -864,6 +864,8 @@ RuntimeOptimizer::simplify_params ()
             continue;  // Skip non-params
         if (! s->lockgeom())
             continue;  // Don't mess with params that can change with the geom
+        if (s->interactive())
+            continue;  // ...or that the app may change with ReParameter
         if (s->typespec().is_structure() || s->typespec().is_closure_based())
             continue;  // We don't mess with struct placeholders or closures
 
@@ -904,6 +906,7 @@ RuntimeOptimizer::simplify_params ()
                     if ((src->symtype() == SymTypeGlobal ||
                          src->symtype() == SymTypeConst ||
                          (src->symtype() == SymTypeParam && src->lockgeom() &&
+                          ! src->interactive() &&
                           (src->valuesource() == Symbol::DefaultVal ||
                            src->valuesource() == Symbol::InstanceVal)))
                         && !src->everwritten()
@@ -937,7 +940,7 @@ RuntimeOptimizer::simplify_params ()
                     // examining.
                     ShaderInstance *uplayer = group()[c.srclayer];
                     Symbol *srcsym = uplayer->symbol(c.src.param);
-                    if (!srcsym->lockgeom())
+                    if (!srcsym->lockgeom() || srcsym->interactive())
                         continue; // Not if it can be overridden by geometry
 
                     // Is the source symbol known to be a global, from
@@ -2123,6 +2126,7 @@ RuntimeOptimizer::optimize_ops (int beginop, int endop,
             for (int i = inst()->firstparam();  i < inst()->lastparam();  ++i) {
                 Symbol *s (inst()->symbol(i));
                 if (s->symtype() == SymTypeOutputParam && s->lockgeom() &&
+                      ! s->interactive() &&
                       (s->valuesource() == Symbol::DefaultVal ||
                        s->valuesource() == Symbol::InstanceVal) &&
                       ! s->has_init_ops() &&
@@ -3279,6 +3283,11 @@ RuntimeOptimizer::run ()
             if (m_unknown_textures_needed)
                 shadingcontext()->info ("    Also may construct texture names on the fly.");
         }
+        if (m_dictionaries_needed.size()) {
+            shadingcontext()->info ("Group needs dictionaries:");
+            for (auto&& f : m_dictionaries_needed)
+                shadingcontext()->info ("    %s", f.size() > 60 ? "(inline xml)" : f.c_str());
+        }
         if (m_userdata_needed.size()) {
             shadingcontext()->info ("Group potentially needs userdata:");
             for (auto&& f : m_userdata_needed)
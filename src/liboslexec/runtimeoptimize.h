@@ -448,6 +448,7 @@ private:
     std::set<ustring> m_textures_needed;
     std::set<ustring> m_closures_needed;
     std::set<ustring> m_globals_needed;
+    std::set<ustring> m_dictionaries_needed; ///< Recorded by dict_find folds
     int m_globals_read = 0;
     int m_globals_write = 0;
     std::set<AttributeNeeded> m_attributes_needed;
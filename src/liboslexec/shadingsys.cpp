@@ -32,6 +32,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fstream>
 #include <cstdlib>
 #include <mutex>
+#include <future>
+#include <algorithm>
 
 #include "oslexec_pvt.h"
 #include <OSL/genclosure.h>
@@ -296,6 +298,24 @@ ShadingSystem::execute_init (ShadingContext &ctx, ShaderGroup &group,
 
 
 
+bool
+ShadingSystem::execution_deferred (const ShadingContext &ctx) const
+{
+    return ctx.deferred ();
+}
+
+
+
+bool
+ShadingSystem::execute_batch (ShadingContext &ctx, ShaderGroup &group,
+                              int npoints, ShaderGlobals *globals,
+                              const bool *mask)
+{
+    return ctx.execute_batch (group, npoints, globals, mask);
+}
+
+
+
 bool
 ShadingSystem::execute_layer (ShadingContext &ctx, ShaderGlobals &globals,
                               int layernumber)
@@ -343,6 +363,22 @@ ShadingSystem::find_layer (const ShaderGroup &group, ustring layername) const
 
 
 
+void
+ShadingSystem::invalidate_attribute_cache ()
+{
+    m_impl->invalidate_attribute_cache ();
+}
+
+
+
+void
+ShadingSystem::invalidate_dictionaries ()
+{
+    m_impl->invalidate_dictionaries ();
+}
+
+
+
 const void*
 ShadingSystem::get_symbol (const ShadingContext &ctx, ustring layername,
                            ustring symbolname, TypeDesc &type) const
@@ -417,6 +453,24 @@ ShadingSystem::symbol_address (const ShadingContext &ctx,
 
 
 
+int
+ShadingSystem::flat_closures (const ShadingContext &ctx,
+                              const FlatClosure* &closures, int point) const
+{
+    return ctx.flat_closures (point, closures);
+}
+
+
+
+const ClosureColor*
+ShadingSystem::closure_tree (ShadingContext &ctx, const FlatClosure *closures,
+                             int n) const
+{
+    return ctx.closure_tree (closures, n);
+}
+
+
+
 std::string
 ShadingSystem::getstats (int level) const
 {
@@ -729,7 +783,7 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_greedyjit(false), m_countlayerexecs(false),
       m_relaxed_param_typecheck(false),
       m_max_warnings_per_thread(100),
-      m_profile(0),
+      m_profile(0), m_profile_layers(0),
       m_optimize(2),
       m_opt_simplify_param(true), m_opt_constant_fold(true),
       m_opt_stale_assign(true), m_opt_elide_useless_ops(true),
@@ -737,15 +791,17 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_opt_peephole(true), m_opt_coalesce_temps(true),
       m_opt_assign(true), m_opt_mix(true),
       m_opt_merge_instances(1), m_opt_merge_instances_with_userdata(true),
-      m_opt_fold_getattribute(true),
+      m_opt_fold_getattribute(true), m_opt_fold_dict(true),
+      m_opt_fold_ocio_matrix(false),
       m_opt_middleman(true), m_opt_texture_handle(true),
-      m_opt_seed_bblock_aliases(true),
+      m_opt_seed_bblock_aliases(true), m_opt_groupdata(true),
       m_optimize_nondebug(false),
       m_opt_passes(10),
       m_llvm_optimize(0),
       m_debug(0), m_llvm_debug(0),
       m_llvm_debug_layers(0), m_llvm_debug_ops(0),
       m_llvm_output_bitcode(0),
+      m_llvm_debugging_symbols(0), m_llvm_profiling_events(0),
       m_commonspace_synonym("world"),
       m_max_local_mem_KB(2048),
       m_compile_report(false),
@@ -755,6 +811,7 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_force_derivs(false),
       m_allow_shader_replacement(false),
       m_exec_repeat(1),
+      m_async_jit(0), m_interactive_respecialize(500), m_pgo_samples(0),
       m_opt_warnings(0),
       m_gpu_opt_error(0),
       m_colorspace("Rec709"),
@@ -762,8 +819,9 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
       m_stat_total_llvm_time(0),
       m_stat_llvm_setup_time(0), m_stat_llvm_irgen_time(0),
       m_stat_llvm_opt_time(0), m_stat_llvm_jit_time(0),
-      m_stat_inst_merge_time(0),
-      m_stat_max_llvm_local_mem(0)
+      m_stat_inst_merge_time(0), m_stat_compile_all_time(0),
+      m_stat_max_llvm_local_mem(0), m_stat_groupdata_bytes(0),
+      m_stat_max_groupdata_bytes(0), m_stat_groupdata_bytes_saved(0)
 {
     m_stat_shaders_loaded = 0;
     m_stat_shaders_requested = 0;
@@ -786,12 +844,24 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_stat_global_connections = 0;
     m_stat_tex_calls_codegened = 0;
     m_stat_tex_calls_as_handles = 0;
+    m_stat_jit_cache_hits = 0;
+    m_stat_jit_cache_misses = 0;
+    m_stat_jit_cache_bytes_read = 0;
+    m_stat_async_jit_groups = 0;
+    m_stat_async_jit_deferrals = 0;
+    m_stat_respecializations = 0;
+    m_stat_pgo_rejits = 0;
     m_stat_master_load_time = 0;
     m_stat_optimization_time = 0;
     m_stat_getattribute_time = 0;
     m_stat_getattribute_fail_time = 0;
     m_stat_getattribute_calls = 0;
     m_stat_get_userdata_calls = 0;
+    m_stat_attrib_cache_hits = 0;
+    m_attrib_cache_epoch = 0;
+    m_stat_attrib_cache_misses = 0;
+    m_stat_matrix_cache_hits = 0;
+    m_stat_matrix_cache_misses = 0;
     m_stat_noise_calls = 0;
     m_stat_pointcloud_searches = 0;
     m_stat_pointcloud_searches_total_results = 0;
@@ -805,6 +875,8 @@ ShadingSystemImpl::ShadingSystemImpl (RendererServices *renderer,
     m_groups_to_compile_count = 0;
     m_threads_currently_compiling = 0;
 
+    init_dict_resources ();
+
     // If client didn't supply an error handler, just use the default
     // one that echoes to the terminal.
     if (! m_err) {
@@ -881,6 +953,7 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
 #define OP(name,ll,fold,simp,flag) OP2(name,name,ll,fold,simp,flag)
 #define TEX OpDescriptor::Tex
 #define SIDE OpDescriptor::SideEffects
+#define PROF OpDescriptor::Profiled
 
     // name          llvmgen              folder         simple     flags
     OP (aassign,     aassign,             aassign,       false,     0);
@@ -903,9 +976,9 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (break,       loopmod_op,          none,          false,     0);
     OP (calculatenormal, calculatenormal, none,          true,      0);
     OP (ceil,        generic,             ceil,          true,      0);
-    OP (cellnoise,   noise,               noise,         true,      0);
+    OP (cellnoise,   noise,               noise,         true,      PROF);
     OP (clamp,       clamp,               clamp,         true,      0);
-    OP (closure,     closure,             none,          true,      0);
+    OP (closure,     closure,             none,          true,      PROF);
     OP (color,       construct_color,     triple,        true,      0);
     OP (compassign,  compassign,          compassign,    false,     0);
     OP (compl,       unary_op,            compl,         true,      0);
@@ -917,9 +990,9 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (cross,       generic,             none,          true,      0);
     OP (degrees,     generic,             degrees,       true,      0);
     OP (determinant, generic,             none,          true,      0);
-    OP (dict_find,   dict_find,           none,          false,     0);
-    OP (dict_next,   dict_next,           none,          false,     0);
-    OP (dict_value,  dict_value,          none,          false,     0);
+    OP (dict_find,   dict_find,           dict_find,     false,     PROF);
+    OP (dict_next,   dict_next,           dict_next,     false,     PROF);
+    OP (dict_value,  dict_value,          dict_value,    false,     PROF);
     OP (distance,    generic,             none,          true,      0);
     OP (div,         div,                 div,           true,      0);
     OP (dot,         generic,             dot,           true,      0);
@@ -929,7 +1002,7 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (dowhile,     loop_op,             none,          false,     0);
     OP (end,         end,                 none,          false,     0);
     OP (endswith,    generic,             endswith,      true,      0);
-    OP (environment, environment,         none,          true,      TEX);
+    OP (environment, environment,         none,          true,      TEX|PROF);
     OP (eq,          compare_op,          eq,            true,      0);
     OP (erf,         generic,             erf,           true,      0);
     OP (erfc,        generic,             erfc,          true,      0);
@@ -947,14 +1020,14 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (fprintf,     printf,              none,          false,     SIDE);
     OP (functioncall, functioncall,       functioncall,  false,     0);
     OP (ge,          compare_op,          ge,            true,      0);
-    OP (getattribute, getattribute,       getattribute,  false,     0);
+    OP (getattribute, getattribute,       getattribute,  false,     PROF);
     OP (getchar,      generic,            getchar,       true,      0);
     OP (getmatrix,   getmatrix,           getmatrix,     false,     0);
     OP (getmessage,  getmessage,          getmessage,    false,     0);
-    OP (gettextureinfo, gettextureinfo,   gettextureinfo,false,     TEX);
+    OP (gettextureinfo, gettextureinfo,   gettextureinfo,false,     TEX|PROF);
     OP (gt,          compare_op,          gt,            true,      0);
     OP (hash,        generic,             hash,          true,      0);
-    OP (hashnoise,   noise,               noise,         true,      0);
+    OP (hashnoise,   noise,               noise,         true,      PROF);
     OP (if,          if,                  if,            false,     0);
     OP (inversesqrt, generic,             inversesqrt,   true,      0);
     OP (isconnected, generic,             none,          true,      0);
@@ -980,20 +1053,20 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (mul,         mul,                 mul,           true,      0);
     OP (neg,         neg,                 neg,           true,      0);
     OP (neq,         compare_op,          neq,           true,      0);
-    OP (noise,       noise,               noise,         true,      0);
+    OP (noise,       noise,               noise,         true,      PROF);
     OP (nop,         nop,                 none,          true,      0);
     OP (normal,      construct_triple,    triple,        true,      0);
     OP (normalize,   generic,             normalize,     true,      0);
     OP (or,          andor,               or,            true,      0);
-    OP (pnoise,      noise,               noise,         true,      0);
+    OP (pnoise,      noise,               noise,         true,      PROF);
     OP (point,       construct_triple,    triple,        true,      0);
     OP (pointcloud_search, pointcloud_search, pointcloud_search,
-                                                         false,     TEX);
-    OP (pointcloud_get, pointcloud_get,   pointcloud_get,false,     TEX);
+                                                         false,     TEX|PROF);
+    OP (pointcloud_get, pointcloud_get,   pointcloud_get,false,     TEX|PROF);
     OP (pointcloud_write, pointcloud_write, none,        false,     SIDE);
     OP (pow,         generic,             pow,           true,      0);
     OP (printf,      printf,              none,          false,     SIDE);
-    OP (psnoise,     noise,               noise,         true,      0);
+    OP (psnoise,     noise,               noise,         true,      PROF);
     OP (radians,     generic,             radians,       true,      0);
     OP (raytype,     raytype,             raytype,       true,      0);
     OP (regex_match, regex,               none,          false,     0);
@@ -1009,7 +1082,7 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (sincos,      sincos,              sincos,        false,     0);
     OP (sinh,        generic,             none,          true,      0);
     OP (smoothstep,  generic,             none,          true,      0);
-    OP (snoise,      noise,               noise,         true,      0);
+    OP (snoise,      noise,               noise,         true,      PROF);
     OP (spline,      spline,              none,          true,      0);
     OP (splineinverse, spline,            none,          true,      0);
     OP (split,       split,               split,         false,     0);
@@ -1026,9 +1099,9 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
     OP (surfacearea, get_simple_SG_field, none,          true,      0);
     OP (tan,         generic,             none,          true,      0);
     OP (tanh,        generic,             none,          true,      0);
-    OP (texture,     texture,             texture,       true,      TEX);
-    OP (texture3d,   texture3d,           none,          true,      TEX);
-    OP (trace,       trace,               none,          false,     SIDE);
+    OP (texture,     texture,             texture,       true,      TEX|PROF);
+    OP (texture3d,   texture3d,           none,          true,      TEX|PROF);
+    OP (trace,       trace,               none,          false,     SIDE|PROF);
     OP (transform,   transform,           transform,     true,      0);
     OP (transformc,  transformc,          transformc,    true,      0);
     OP (transformn,  transform,           transform,     true,      0);
@@ -1044,6 +1117,7 @@ shading_system_setup_op_descriptors (ShadingSystemImpl::OpDescriptorMap& op_desc
 #undef OP
 #undef TEX
 #undef SIDE
+#undef PROF
 }
 
 
@@ -1101,7 +1175,11 @@ ShadingSystemImpl::query_closure(const char **name, int *id,
 
 ShadingSystemImpl::~ShadingSystemImpl ()
 {
+    // Finish any background compiles before tearing anything down.
+    m_async_jit_pool.reset ();
+
     printstats ();
+    free_dict_resources ();
     // N.B. just let m_texsys go -- if we asked for one to be created,
     // we asked for a shared one.
 
@@ -1149,6 +1227,7 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("debug_uninit", int, m_debug_uninit);
     ATTR_SET ("lockgeom", int, m_lockgeom_default);
     ATTR_SET ("profile", int, m_profile);
+    ATTR_SET ("profile_layers", int, m_profile_layers);
     ATTR_SET ("optimize", int, m_optimize);
     ATTR_SET ("opt_simplify_param", int, m_opt_simplify_param);
     ATTR_SET ("opt_constant_fold", int, m_opt_constant_fold);
@@ -1162,9 +1241,12 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("opt_merge_instances", int, m_opt_merge_instances);
     ATTR_SET ("opt_merge_instances_with_userdata", int, m_opt_merge_instances_with_userdata);
     ATTR_SET ("opt_fold_getattribute", int, m_opt_fold_getattribute);
+    ATTR_SET ("opt_fold_dict", int, m_opt_fold_dict);
+    ATTR_SET ("opt_fold_ocio_matrix", int, m_opt_fold_ocio_matrix);
     ATTR_SET ("opt_middleman", int, m_opt_middleman);
     ATTR_SET ("opt_texture_handle", int, m_opt_texture_handle);
     ATTR_SET ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
+    ATTR_SET ("opt_groupdata", int, m_opt_groupdata);
     ATTR_SET ("opt_passes", int, m_opt_passes);
     ATTR_SET ("optimize_nondebug", int, m_optimize_nondebug);
     ATTR_SET ("llvm_optimize", int, m_llvm_optimize);
@@ -1172,6 +1254,8 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("llvm_debug_layers", int, m_llvm_debug_layers);
     ATTR_SET ("llvm_debug_ops", int, m_llvm_debug_ops);
     ATTR_SET ("llvm_output_bitcode", int, m_llvm_output_bitcode);
+    ATTR_SET ("llvm_debugging_symbols", int, m_llvm_debugging_symbols);
+    ATTR_SET ("llvm_profiling_events", int, m_llvm_profiling_events);
     ATTR_SET ("strict_messages", int, m_strict_messages);
     ATTR_SET ("range_checking", int, m_range_checking);
     ATTR_SET ("unknown_coordsys_error", int, m_unknown_coordsys_error);
@@ -1188,6 +1272,9 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET ("force_derivs", int, m_force_derivs);
     ATTR_SET ("allow_shader_replacement", int, m_allow_shader_replacement);
     ATTR_SET ("exec_repeat", int, m_exec_repeat);
+    ATTR_SET ("async_jit", int, m_async_jit);
+    ATTR_SET ("interactive_respecialize", int, m_interactive_respecialize);
+    ATTR_SET ("pgo_samples", int, m_pgo_samples);
     ATTR_SET ("opt_warnings", int, m_opt_warnings);
     ATTR_SET ("gpu_opt_error", int, m_gpu_opt_error);
     ATTR_SET_STRING ("commonspace", m_commonspace_synonym);
@@ -1197,6 +1284,7 @@ ShadingSystemImpl::attribute (string_view name, TypeDesc type,
     ATTR_SET_STRING ("only_groupname", m_only_groupname);
     ATTR_SET_STRING ("archive_groupname", m_archive_groupname);
     ATTR_SET_STRING ("archive_filename", m_archive_filename);
+    ATTR_SET_STRING ("llvm_jit_cache", m_llvm_jit_cache);
 
     // cases for special handling
     if (name == "searchpath:shader" && type == TypeDesc::STRING) {
@@ -1284,6 +1372,7 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("debug_uninit", int, m_debug_uninit);
     ATTR_DECODE ("lockgeom", int, m_lockgeom_default);
     ATTR_DECODE ("profile", int, m_profile);
+    ATTR_DECODE ("profile_layers", int, m_profile_layers);
     ATTR_DECODE ("optimize", int, m_optimize);
     ATTR_DECODE ("opt_simplify_param", int, m_opt_simplify_param);
     ATTR_DECODE ("opt_constant_fold", int, m_opt_constant_fold);
@@ -1297,9 +1386,12 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("opt_merge_instances", int, m_opt_merge_instances);
     ATTR_DECODE ("opt_merge_instances_with_userdata", int, m_opt_merge_instances_with_userdata);
     ATTR_DECODE ("opt_fold_getattribute", int, m_opt_fold_getattribute);
+    ATTR_DECODE ("opt_fold_dict", int, m_opt_fold_dict);
+    ATTR_DECODE ("opt_fold_ocio_matrix", int, m_opt_fold_ocio_matrix);
     ATTR_DECODE ("opt_middleman", int, m_opt_middleman);
     ATTR_DECODE ("opt_texture_handle", int, m_opt_texture_handle);
     ATTR_DECODE ("opt_seed_bblock_aliases", int, m_opt_seed_bblock_aliases);
+    ATTR_DECODE ("opt_groupdata", int, m_opt_groupdata);
     ATTR_DECODE ("opt_passes", int, m_opt_passes);
     ATTR_DECODE ("optimize_nondebug", int, m_optimize_nondebug);
     ATTR_DECODE ("llvm_optimize", int, m_llvm_optimize);
@@ -1308,6 +1400,8 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("llvm_debug_layers", int, m_llvm_debug_layers);
     ATTR_DECODE ("llvm_debug_ops", int, m_llvm_debug_ops);
     ATTR_DECODE ("llvm_output_bitcode", int, m_llvm_output_bitcode);
+    ATTR_DECODE ("llvm_debugging_symbols", int, m_llvm_debugging_symbols);
+    ATTR_DECODE ("llvm_profiling_events", int, m_llvm_profiling_events);
     ATTR_DECODE ("strict_messages", int, m_strict_messages);
     ATTR_DECODE ("error_repeats", int, m_error_repeats);
     ATTR_DECODE ("range_checking", int, m_range_checking);
@@ -1325,6 +1419,7 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE_STRING ("only_groupname", m_only_groupname);
     ATTR_DECODE_STRING ("archive_groupname", m_archive_groupname);
     ATTR_DECODE_STRING ("archive_filename", m_archive_filename);
+    ATTR_DECODE_STRING ("llvm_jit_cache", m_llvm_jit_cache);
     ATTR_DECODE ("max_local_mem_KB", int, m_max_local_mem_KB);
     ATTR_DECODE ("compile_report", int, m_compile_report);
     ATTR_DECODE ("buffer_printf", int, m_buffer_printf);
@@ -1333,6 +1428,9 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("force_derivs", int, m_force_derivs);
     ATTR_DECODE ("allow_shader_replacement", int, m_allow_shader_replacement);
     ATTR_DECODE ("exec_repeat", int, m_exec_repeat);
+    ATTR_DECODE ("async_jit", int, m_async_jit);
+    ATTR_DECODE ("interactive_respecialize", int, m_interactive_respecialize);
+    ATTR_DECODE ("pgo_samples", int, m_pgo_samples);
     ATTR_DECODE ("opt_warnings", int, m_opt_warnings);
     ATTR_DECODE ("gpu_opt_error", int, m_gpu_opt_error);
 
@@ -1356,6 +1454,9 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("stat:global_connections", int, m_stat_global_connections);
     ATTR_DECODE ("stat:tex_calls_codegened", int, m_stat_tex_calls_codegened);
     ATTR_DECODE ("stat:tex_calls_as_handles", int, m_stat_tex_calls_as_handles);
+    ATTR_DECODE ("stat:groupdata_bytes", long long, m_stat_groupdata_bytes);
+    ATTR_DECODE ("stat:max_groupdata_bytes", int, m_stat_max_groupdata_bytes);
+    ATTR_DECODE ("stat:groupdata_bytes_saved", long long, m_stat_groupdata_bytes_saved);
     ATTR_DECODE ("stat:master_load_time", float, m_stat_master_load_time);
     ATTR_DECODE ("stat:optimization_time", float, m_stat_optimization_time);
     ATTR_DECODE ("stat:opt_locking_time", float, m_stat_opt_locking_time);
@@ -1366,8 +1467,20 @@ ShadingSystemImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("stat:llvm_opt_time", float, m_stat_llvm_opt_time);
     ATTR_DECODE ("stat:llvm_jit_time", float, m_stat_llvm_jit_time);
     ATTR_DECODE ("stat:inst_merge_time", float, m_stat_inst_merge_time);
+    ATTR_DECODE ("stat:compile_all_time", float, m_stat_compile_all_time);
+    ATTR_DECODE ("stat:jit_cache_hits", int, m_stat_jit_cache_hits);
+    ATTR_DECODE ("stat:jit_cache_misses", int, m_stat_jit_cache_misses);
+    ATTR_DECODE ("stat:jit_cache_bytes_read", long long, m_stat_jit_cache_bytes_read);
+    ATTR_DECODE ("stat:async_jit_groups", int, m_stat_async_jit_groups);
+    ATTR_DECODE ("stat:async_jit_deferrals", long long, m_stat_async_jit_deferrals);
+    ATTR_DECODE ("stat:respecializations", int, m_stat_respecializations);
+    ATTR_DECODE ("stat:pgo_rejits", int, m_stat_pgo_rejits);
     ATTR_DECODE ("stat:getattribute_calls", long long, m_stat_getattribute_calls);
     ATTR_DECODE ("stat:get_userdata_calls", long long, m_stat_get_userdata_calls);
+    ATTR_DECODE ("stat:attrib_cache_hits", long long, m_stat_attrib_cache_hits);
+    ATTR_DECODE ("stat:attrib_cache_misses", long long, m_stat_attrib_cache_misses);
+    ATTR_DECODE ("stat:matrix_cache_hits", long long, m_stat_matrix_cache_hits);
+    ATTR_DECODE ("stat:matrix_cache_misses", long long, m_stat_matrix_cache_misses);
     ATTR_DECODE ("stat:noise_calls", long long, m_stat_noise_calls);
     ATTR_DECODE ("stat:pointcloud_searches", long long, m_stat_pointcloud_searches);
     ATTR_DECODE ("stat:pointcloud_gets", long long, m_stat_pointcloud_gets);
@@ -1430,10 +1543,22 @@ ShadingSystemImpl::attribute (ShaderGroup *group, string_view name,
             group->mark_entry_layer (ustring(((const char **)val)[i]));
         return true;
     }
+    if (name == "interactive_params" && type.basetype == TypeDesc::STRING) {
+        if (group->optimized())
+            return false;   // Too late to keep them live
+        group->m_interactive_params.clear ();
+        for (size_t i = 0;  i < type.numelements();  ++i)
+            group->m_interactive_params.emplace_back(((const char **)val)[i]);
+        return true;
+    }
     if (name == "exec_repeat" && type == TypeDesc::TypeInt) {
         group->m_exec_repeat = *(const int *)val;
         return true;
     }
+    if (name == "flat_closures" && type == TypeDesc::TypeInt) {
+        group->m_flat_closures = *(const int *)val;
+        return true;
+    }
     if (name == "groupname" && type == TypeDesc::TypeString) {
         group->name (ustring(((const char **)val)[0]));
         return true;
@@ -1480,6 +1605,18 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
         *(int *)val = group->raytype_queries();
         return true;
     }
+    if (name == "num_interactive_params" && type.basetype == TypeDesc::INT) {
+        *(int *)val = (int) group->m_interactive_params.size();
+        return true;
+    }
+    if (name == "interactive_params" && type.basetype == TypeDesc::STRING) {
+        size_t n = std::min (type.numelements(), group->m_interactive_params.size());
+        for (size_t i = 0;  i < n;  ++i)
+            ((ustring *)val)[i] = group->m_interactive_params[i];
+        for (size_t i = n;  i < type.numelements();  ++i)
+            ((ustring *)val)[i] = ustring();
+        return true;
+    }
     if (name == "num_entry_layers" && type.basetype == TypeDesc::INT) {
         int n = 0;
         for (int i = 0;  i < group->nlayers();  ++i)
@@ -1531,6 +1668,21 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
         *(int *)val = group->m_exec_repeat;
         return true;
     }
+    if (name == "flat_closures" && type == TypeDesc::TypeInt) {
+        *(int *)val = group->m_flat_closures;
+        return true;
+    }
+    if (name == "optimized" && type == TypeDesc::TypeInt) {
+        // N.B. Unlike the attributes below, this does not force the
+        // group to be optimized.
+        *(int *)val = group->optimized();
+        return true;
+    }
+    if (name == "llvm_groupdata_size" && type == TypeDesc::TypeInt) {
+        // Also doesn't force optimization: it's 0 until the group is JITed
+        *(int *)val = (int) group->llvm_groupdata_size();
+        return true;
+    }
     if (name == "ptx_compiled_version" && type.basetype == TypeDesc::PTR) {
         bool exists = !group->m_llvm_ptx_compiled_version.empty();
         *(std::string *)val = exists ? group->m_llvm_ptx_compiled_version : "";
@@ -1561,6 +1713,16 @@ ShadingSystemImpl::getattribute (ShaderGroup *group, string_view name,
         return true;
     }
 
+    if (name == "num_dictionaries_needed" && type == TypeDesc::TypeInt) {
+        *(int *)val = (int)group->m_dictionaries_needed.size();
+        return true;
+    }
+    if (name == "dictionaries_needed" && type.basetype == TypeDesc::PTR) {
+        size_t n = group->m_dictionaries_needed.size();
+        *(ustring **)val = n ? &group->m_dictionaries_needed[0] : NULL;
+        return true;
+    }
+
     if (name == "num_closures_needed" && type == TypeDesc::TypeInt) {
         *(int *)val = (int)group->m_closures_needed.size();
         return true;
@@ -1739,6 +1901,70 @@ struct group_time_compare { // So looking forward to C++11 lambdas!
 
 
 
+int
+ShadingSystemImpl::profile_slot (ustring group, ustring layer, ustring op,
+                                 ustring sourcefile, int sourceline)
+{
+    lock_guard lock (m_profile_mutex);
+    ProfileSlotKey key (group, layer, op, sourcefile, sourceline);
+    auto found = m_profile_slot_index.find (key);
+    if (found != m_profile_slot_index.end())
+        return found->second;
+    int slot = int(m_profile_slots.size());
+    m_profile_slots.emplace_back (group, layer, op, sourcefile, sourceline);
+    m_profile_slot_index[key] = slot;
+    return slot;
+}
+
+
+
+void
+ShadingSystemImpl::print_layer_profile (std::ostream &out) const
+{
+    // Times still held by contexts that haven't been released yet
+    // aren't included.
+    const int nshow = 20;
+    std::vector<ProfileSlot> layers, ops;
+    long long total = 0;
+    {
+        lock_guard lock (m_profile_mutex);
+        for (auto&& s : m_profile_slots) {
+            if (! s.calls)
+                continue;
+            (s.op.empty() ? layers : ops).push_back (s);
+            total += s.ticks;
+        }
+    }
+    if (! total)
+        return;
+    auto by_time = [](const ProfileSlot &a, const ProfileSlot &b) {
+        return a.ticks > b.ticks;
+    };
+    std::sort (layers.begin(), layers.end(), by_time);
+    std::sort (ops.begin(), ops.end(), by_time);
+    out << "  Layer profile (self time, sum of all threads):\n";
+    for (int i = 0, e = std::min ((int)layers.size(), nshow);  i < e;  ++i) {
+        const ProfileSlot &s (layers[i]);
+        out << Strutil::sprintf ("    %s %5.1f%%  %s / %s  (%lld calls)\n",
+                  Strutil::timeintervalformat (OIIO::Timer::seconds(s.ticks), 2),
+                  100.0 * s.ticks / total,
+                  s.group.size() ? s.group.c_str() : "<unnamed group>",
+                  s.layer, s.calls);
+    }
+    if (ops.size())
+        out << "  Most expensive ops:\n";
+    for (int i = 0, e = std::min ((int)ops.size(), nshow);  i < e;  ++i) {
+        const ProfileSlot &s (ops[i]);
+        out << Strutil::sprintf ("    %s %5.1f%%  %s at %s:%d in %s / %s  (%lld calls)\n",
+                  Strutil::timeintervalformat (OIIO::Timer::seconds(s.ticks), 2),
+                  100.0 * s.ticks / total, s.op, s.sourcefile, s.sourceline,
+                  s.group.size() ? s.group.c_str() : "<unnamed group>",
+                  s.layer, s.calls);
+    }
+}
+
+
+
 std::string
 ShadingSystemImpl::getstats (int level) const
 {
@@ -1762,7 +1988,10 @@ ShadingSystemImpl::getstats (int level) const
     INTOPT (llvm_optimize);
     INTOPT (debug);
     INTOPT (profile);
+    INTOPT (profile_layers);
     INTOPT (llvm_debug);
+    INTOPT (llvm_debugging_symbols);
+    INTOPT (llvm_profiling_events);
     BOOLOPT (llvm_debug_layers);
     BOOLOPT (llvm_debug_ops);
     BOOLOPT (llvm_output_bitcode);
@@ -1792,21 +2021,28 @@ ShadingSystemImpl::getstats (int level) const
     INTOPT  (opt_merge_instances);
     BOOLOPT (opt_merge_instances_with_userdata);
     BOOLOPT (opt_fold_getattribute);
+    BOOLOPT (opt_fold_dict);
+    BOOLOPT (opt_fold_ocio_matrix);
     BOOLOPT (opt_middleman);
     BOOLOPT (opt_texture_handle);
     BOOLOPT (opt_seed_bblock_aliases);
+    BOOLOPT (opt_groupdata);
     INTOPT  (opt_passes);
     INTOPT (no_noise);
     INTOPT (no_pointcloud);
     INTOPT (force_derivs);
     INTOPT (allow_shader_replacement);
     INTOPT (exec_repeat);
+    INTOPT (async_jit);
+    INTOPT (interactive_respecialize);
+    INTOPT (pgo_samples);
     INTOPT (opt_warnings);
     INTOPT (gpu_opt_error);
     STROPT (debug_groupname);
     STROPT (debug_layername);
     STROPT (archive_groupname);
     STROPT (archive_filename);
+    STROPT (llvm_jit_cache);
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -1893,6 +2129,39 @@ ShadingSystemImpl::getstats (int level) const
         out << "    LLVM JIT:                  "
             << Strutil::timeintervalformat (m_stat_llvm_jit_time, 2) << "\n";
     }
+    if (m_stat_compile_thread_idle.size()) {
+        size_t nthreads = m_stat_compile_thread_idle.size();
+        double total = 0.0, maxidle = 0.0;
+        for (auto t : m_stat_compile_thread_idle) {
+            total += t;
+            maxidle = std::max (maxidle, t);
+        }
+        out << "  Parallel group compile: " << nthreads << " threads, "
+            << Strutil::timeintervalformat (m_stat_compile_all_time, 2) << " wall\n";
+        out << "    thread idle time: avg "
+            << Strutil::timeintervalformat (total/nthreads, 2) << ", max "
+            << Strutil::timeintervalformat (maxidle, 2) << "\n";
+        if (nthreads <= 16) {
+            out << "     ";
+            for (auto t : m_stat_compile_thread_idle)
+                out << ' ' << Strutil::timeintervalformat (t, 2);
+            out << "\n";
+        }
+    }
+    if (m_async_jit) {
+        out << "  Background JIT: " << m_stat_async_jit_groups << " groups, "
+            << m_stat_async_jit_deferrals << " executions deferred\n";
+    }
+    if (m_stat_respecializations)
+        out << "  Interactive groups respecialized: "
+            << m_stat_respecializations << "\n";
+    if (m_stat_pgo_rejits)
+        out << "  Profile-guided re-JITs: " << m_stat_pgo_rejits << "\n";
+    if (m_llvm_jit_cache.size()) {
+        out << "  JIT cache: " << m_stat_jit_cache_hits << " hits, "
+            << m_stat_jit_cache_misses << " misses, "
+            << Strutil::memformat (m_stat_jit_cache_bytes_read) << " read\n";
+    }
 
     out << "  Texture calls compiled: "
         << (int)m_stat_tex_calls_codegened
@@ -1900,6 +2169,16 @@ ShadingSystemImpl::getstats (int level) const
     out << "  Regex's compiled: " << m_stat_regexes << "\n";
     out << "  Largest generated function local memory size: "
         << m_stat_max_llvm_local_mem/1024 << " KB\n";
+    if (m_stat_groups_compiled > 0) {
+        out << "  Group data per context: "
+            << Strutil::memformat (m_stat_groupdata_bytes / m_stat_groups_compiled)
+            << " avg, " << Strutil::memformat (m_stat_max_groupdata_bytes)
+            << " max";
+        if (m_stat_groupdata_bytes_saved)
+            out << " (layout saved "
+                << Strutil::memformat (m_stat_groupdata_bytes_saved) << ")";
+        out << "\n";
+    }
     if (m_stat_getattribute_calls) {
         out << "  getattribute calls: " << m_stat_getattribute_calls << " ("
             << Strutil::timeintervalformat (m_stat_getattribute_time, 2) << ")\n";
@@ -1907,6 +2186,20 @@ ShadingSystemImpl::getstats (int level) const
             << Strutil::timeintervalformat (m_stat_getattribute_fail_time, 2) << ")\n";
     }
     out << "  Number of get_userdata calls: " << m_stat_get_userdata_calls << "\n";
+    if (m_stat_attrib_cache_hits || m_stat_attrib_cache_misses) {
+        long long total = m_stat_attrib_cache_hits + m_stat_attrib_cache_misses;
+        out << Strutil::sprintf ("  getattribute cache: %lld hits, %lld misses (%.1f%% hit)\n",
+                                 (long long)m_stat_attrib_cache_hits,
+                                 (long long)m_stat_attrib_cache_misses,
+                                 (100.0 * m_stat_attrib_cache_hits) / std::max (total, 1LL));
+    }
+    if (m_stat_matrix_cache_hits || m_stat_matrix_cache_misses) {
+        long long total = m_stat_matrix_cache_hits + m_stat_matrix_cache_misses;
+        out << Strutil::sprintf ("  get_matrix cache: %lld hits, %lld misses (%.1f%% hit)\n",
+                                 (long long)m_stat_matrix_cache_hits,
+                                 (long long)m_stat_matrix_cache_misses,
+                                 (100.0 * m_stat_matrix_cache_hits) / std::max (total, 1LL));
+    }
     if (profile() > 1)
         out << "  Number of noise calls: " << m_stat_noise_calls << "\n";
     if (m_stat_pointcloud_searches || m_stat_pointcloud_writes) {
@@ -1971,6 +2264,8 @@ ShadingSystemImpl::getstats (int level) const
         }
 
     }
+    if (m_profile_layers)
+        print_layer_profile (out);
 
     return out.str();
 }
@@ -2019,6 +2314,7 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname)
 {
     ShaderGroupRef group (new ShaderGroup(groupname));
     group->m_exec_repeat = m_exec_repeat;
+    group->m_self = group;
     {
         // Record the group in the SS's census of all extant groups
         spin_lock lock (m_all_shader_groups_mutex);
@@ -2290,6 +2586,17 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname,
                                      string_view groupspec)
 {
     ShaderGroupRef g = ShaderGroupBegin (groupname);
+    if (! parse_group_spec (*g, usage, groupspec))
+        return ShaderGroupRef();
+    return g;
+}
+
+
+
+bool
+ShadingSystemImpl::parse_group_spec (ShaderGroup &group, string_view usage,
+                                     string_view groupspec)
+{
     bool err = false;
     std::string errdesc;
     string_view errstatement;
@@ -2311,7 +2618,7 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname,
             string_view shadername = Strutil::parse_identifier (p);
             Strutil::skip_whitespace (p);
             string_view layername = Strutil::parse_until (p, " \t\r\n,;");
-            bool ok = Shader (usage, shadername, layername);
+            bool ok = Shader (group, usage, shadername, layername);
             if (!ok) {
                 errstatement = pstart;
                 err = true;
@@ -2331,7 +2638,7 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname,
             string_view lay2 = Strutil::parse_until (p, " \t\r\n.");
             Strutil::parse_char (p, '.');
             string_view param2 = Strutil::parse_until (p, " \t\r\n,;");
-            bool ok = ConnectShaders (lay1, param1, lay2, param2);
+            bool ok = ConnectShaders (group, lay1, param1, lay2, param2);
             if (!ok) {
                 errstatement = pstart;
                 err = true;
@@ -2514,11 +2821,11 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname,
 
         bool ok = true;
         if (type.basetype == TypeDesc::INT) {
-            ok = Parameter (paramname, type, &intvals[0], lockgeom);
+            ok = Parameter (group, paramname, type, &intvals[0], lockgeom);
         } else if (type.basetype == TypeDesc::FLOAT) {
-            ok = Parameter (paramname, type, &floatvals[0], lockgeom);
+            ok = Parameter (group, paramname, type, &floatvals[0], lockgeom);
         } else if (type.basetype == TypeDesc::STRING) {
-            ok = Parameter (paramname, type, &stringvals[0], lockgeom);
+            ok = Parameter (group, paramname, type, &stringvals[0], lockgeom);
         }
         if (!ok) {
             errstatement = pstart;
@@ -2544,7 +2851,7 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname,
         std::string msg = Strutil::format (
                 "ShaderGroupBegin: error parsing group description: %s\n"
                 "        group: %s",
-                errdesc, g->name());
+                errdesc, group.name());
         if (errstatement.empty()) {
             size_t offset = p.data() - groupspec.data();
             size_t begin_stmt = std::min (groupspec.find_last_of (';', offset),
@@ -2558,10 +2865,10 @@ ShadingSystemImpl::ShaderGroupBegin (string_view groupname,
         error ("%s", msg);
         if (debug())
             info ("Broken group was:\n---%s\n---\n", groupspec);
-        return ShaderGroupRef();
+        return false;
     }
 
-    return g;
+    return true;
 }
 
 
@@ -2595,12 +2902,26 @@ ShadingSystemImpl::ReParameter (ShaderGroup &group, string_view layername_,
         return false;
 
     // Can't change param value if the group has already been optimized,
-    // unless that parameter is marked lockgeom=0.
-    if (group.optimized() && sym->lockgeom())
+    // unless that parameter is marked lockgeom=0 or is interactive.  An
+    // interactive param needs its own instance value to change (rather
+    // than its master's default, which other instances share).
+    if (group.optimized() && sym->lockgeom() &&
+        ! (sym->interactive() && sym->valuesource() == Symbol::InstanceVal))
         return false;
 
     // Do the deed
     memcpy (sym->data(), val, type.size());
+
+    if (sym->interactive()) {
+        // Restart the idle clock, and go back to running the version
+        // that reads the param live.
+        group.m_interactive_edits += 1;
+        group.m_interactive_edit_time = (long long) OIIO::Timer::now();
+        // Contexts still running the copy keep it alive until they're
+        // done with it.
+        spin_lock lock (group.m_specialized_mutex);
+        group.m_specialized.reset ();
+    }
     return true;
 }
 
@@ -2650,6 +2971,9 @@ ShadingSystemImpl::release_context (ShadingContext *ctx)
     if (! ctx)
         return;
     ctx->process_errors ();
+    ctx->merge_profile ();
+    ctx->merge_pgo ();
+    ctx->unpin_group ();
     ctx->thread_info()->context_pool.push (ctx);
 }
 
@@ -2932,6 +3256,13 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
         ctx = get_context(thread_info);
         ctx_allocated = true;
     }
+    // A specialized copy (for interactive params or profile feedback)
+    // has to be rebuilt from the group as the app specified it, not from
+    // what the optimizer is about to leave of it.
+    if ((group.has_interactive_params() || m_pgo_samples > 0) &&
+            ! group.m_respecialized)
+        group.m_original_spec = group.serialize_locked ();
+
     RuntimeOptimizer rop (*this, group, ctx);
     rop.run ();
     rop.police_failed_optimizations();
@@ -2945,6 +3276,8 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
         group.m_closures_needed.push_back (f);
     for (auto&& f : rop.m_globals_needed)
         group.m_globals_needed.push_back (f);
+    for (auto&& f : rop.m_dictionaries_needed)
+        group.m_dictionaries_needed.push_back (f);
     group.m_globals_read = rop.m_globals_read;
     group.m_globals_write = rop.m_globals_write;
     size_t num_userdata = rop.m_userdata_needed.size();
@@ -2961,6 +3294,19 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
         group.m_userdata_layers.push_back (n.layer_num);
         group.m_userdata_init_vals.push_back (n.data);
     }
+    // Params in different layers may bind to the same userdata, and they
+    // all share the slot of the first entry with that name and type (see
+    // BackendLLVM::find_userdata_index), so that slot needs derivs if
+    // any of them do.
+    for (size_t i = 1;  i < num_userdata;  ++i) {
+        for (size_t j = 0;  j < i;  ++j) {
+            if (group.m_userdata_names[j] == group.m_userdata_names[i] &&
+                equivalent (group.m_userdata_types[j], group.m_userdata_types[i])) {
+                group.m_userdata_derivs[j] |= group.m_userdata_derivs[i];
+                break;
+            }
+        }
+    }
     group.m_unknown_attributes_needed = rop.m_unknown_attributes_needed;
     for (auto&& f : rop.m_attributes_needed) {
         group.m_attributes_needed.push_back (f.name);
@@ -2977,6 +3323,10 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
         destroy_thread_info(thread_info);
     }
 
+    // Make sure all the JITed function pointers are visible to other
+    // threads before they can see the group marked as optimized (which
+    // they may be polling without a lock, see "async_jit").
+    std::atomic_thread_fence (std::memory_order_release);
     group.m_optimized = true;
     spin_lock stat_lock (m_stat_mutex);
     m_stat_optimization_time += timer();
@@ -2989,6 +3339,10 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
     m_stat_llvm_jit_time += lljitter.m_stat_llvm_jit_time;
     m_stat_max_llvm_local_mem = std::max (m_stat_max_llvm_local_mem,
                                           lljitter.m_llvm_local_mem);
+    m_stat_groupdata_bytes += group.llvm_groupdata_size();
+    m_stat_max_groupdata_bytes = std::max (m_stat_max_groupdata_bytes,
+                                           (int)group.llvm_groupdata_size());
+    m_stat_groupdata_bytes_saved += lljitter.m_groupdata_bytes_saved;
     m_stat_groups_compiled += 1;
     m_stat_instances_compiled += group.nlayers();
     m_groups_to_compile_count -= 1;
@@ -2996,55 +3350,258 @@ ShadingSystemImpl::optimize_group (ShaderGroup &group, ShadingContext *ctx)
 
 
 
-static void optimize_all_groups_wrapper (ShadingSystemImpl *ss, int mythread, int totalthreads)
+void
+ShadingSystemImpl::optimize_group_async (ShaderGroup &group)
+{
+    m_stat_async_jit_deferrals += 1;
+    if (group.m_async_jit_queued.exchange (1))
+        return;   // Already queued (or done) -- nothing more to do
+
+    // Hold a reference to the group so that it can't be destroyed while
+    // it waits in the queue.
+    ShaderGroupRef groupref = find_group_ref (group);
+    ASSERT (groupref && "group not known to the ShadingSystem");
+
+    async_jit_pool()->push ([this,groupref](int /*id*/){
+        optimize_group (*groupref, nullptr);
+        m_stat_async_jit_groups += 1;
+    });
+}
+
+
+
+ShaderGroupRef
+ShadingSystemImpl::find_group_ref (ShaderGroup &group)
 {
-    ss->optimize_all_groups (1, mythread, totalthreads);
+    // N.B. the group remembers its own ref, rather than us searching
+    // m_all_shader_groups, since this is called as groups are executed.
+    return group.m_self.lock();
+}
+
+
+
+OIIO::thread_pool *
+ShadingSystemImpl::async_jit_pool ()
+{
+    spin_lock lock (m_async_jit_mutex);
+    if (! m_async_jit_pool)
+        m_async_jit_pool.reset (new OIIO::thread_pool (std::max (m_async_jit, 1)));
+    return m_async_jit_pool.get();
+}
+
+
+
+ShaderGroupRef
+ShadingSystemImpl::specialized_group (ShaderGroup &group)
+{
+    {
+        spin_lock lock (group.m_specialized_mutex);
+        if (group.m_specialized)
+            return group.m_specialized;
+    }
+    if (group.has_interactive_params() && m_interactive_respecialize > 0 &&
+            ! group.m_respecializing) {
+        OIIO::Timer::ticks_t edit = group.m_interactive_edit_time;
+        double idle = OIIO::Timer::seconds (OIIO::Timer::now() - edit);
+        if (idle * 1000.0 >= m_interactive_respecialize)
+            respecialize_group_async (group);
+    }
+    return ShaderGroupRef();
 }
 
 
 
 void
-ShadingSystemImpl::optimize_all_groups (int nthreads, int mythread, int totalthreads)
+ShadingSystemImpl::respecialize_group_async (ShaderGroup &group)
 {
-    // Spawn a bunch of threads to do this in parallel -- just call this
-    // routine again (with threads=1) for each thread.
-    if (nthreads < 1)  // threads <= 0 means use all hardware available
-        nthreads = std::min ((int)std::thread::hardware_concurrency(),
-                             (int)m_groups_to_compile_count);
-    if (nthreads > 1) {
-        if (m_threads_currently_compiling)
-            return;   // never mind, somebody else spawned the JIT threads
-        OIIO::thread_group threads;
-        m_threads_currently_compiling += nthreads;
-        for (int t = 0;  t < nthreads;  ++t)
-            threads.add_thread (new std::thread (optimize_all_groups_wrapper, this, t, nthreads));
-        threads.join_all ();
-        m_threads_currently_compiling -= nthreads;
+    if (group.m_respecializing.exchange (1))
+        return;   // Already underway
+    ShaderGroupRef groupref = find_group_ref (group);
+    if (! groupref) {
+        group.m_respecializing = 0;
         return;
     }
 
-    // And here's the single thread case
-    size_t ngroups = 0;
+    auto rebuild = [this,groupref](int /*id*/){
+        ShaderGroup &group (*groupref);
+        int edits = group.m_interactive_edits;
+
+        // Rebuild the group from the description it had before it was
+        // optimized, then give the interactive params their current
+        // values as plain instance values, so the optimizer folds them
+        // like any other.
+        // N.B. This deliberately doesn't use ShaderGroupBegin, since it
+        // must not disturb the app's "current" group.
+        ShaderGroupRef copy (new ShaderGroup (group.name()));
+        bool ok = group.m_original_spec.size() &&
+                  parse_group_spec (*copy, group.m_group_use,
+                                    group.m_original_spec) &&
+                  copy->nlayers() == group.nlayers();
+        if (ok) {
+            for (int i = 0, e = group.nlayers();  i < e;  ++i) {
+                const ShaderInstance *src = group[i];
+                ShaderInstance *dst = (*copy)[i];
+                for (int p = src->firstparam();  p < src->lastparam();  ++p) {
+                    const Symbol *sym = src->symbol (p);
+                    if (! sym->interactive() ||
+                            sym->valuesource() != Symbol::InstanceVal)
+                        continue;
+                    int dp = dst->findparam (sym->name());
+                    if (dp >= 0)
+                        memcpy (dst->param_storage (dp), src->param_storage (p),
+                                sym->typespec().simpletype().size());
+                }
+            }
+            copy->m_exec_repeat = group.m_exec_repeat;
+            copy->m_flat_closures = group.m_flat_closures;
+            copy->m_raytypes_on = group.m_raytypes_on;
+            copy->m_raytypes_off = group.m_raytypes_off;
+            copy->m_renderer_outputs = group.m_renderer_outputs;
+            copy->m_respecialized = true;
+            copy->m_pgo_feedback = group.m_pgo;
+            ok = ShaderGroupEnd (*copy);
+        }
+        if (ok) {
+            for (int i = 0, e = group.nlayers();  i < e;  ++i)
+                if (group[i]->entry_layer())
+                    copy->mark_entry_layer (i);
+            ++m_groups_to_compile_count;   // optimize_group decrements it
+            optimize_group (*copy, nullptr);
+            ok = copy->optimized();
+        }
+        if (ok) {
+            // Let ShaderSymbol handles found on the original group keep
+            // working while the copy runs in its place. A symbol the copy
+            // optimized away maps to NULL.
+            for (int i = 0, e = group.nlayers();  i < e;  ++i) {
+                const ShaderInstance *src = group[i];
+                const ShaderInstance *dst = (*copy)[i];
+                for (int s = 0, n = src->symbols().size();  s < n;  ++s) {
+                    const Symbol *sym = src->symbol (s);
+                    int ds = dst->findsymbol (sym->name());
+                    copy->m_symbol_map[sym] = ds >= 0 ? dst->symbol (ds) : NULL;
+                }
+            }
+        }
+        bool published = false;
+        {
+            // Publish it, unless it was edited again in the meantime.
+            spin_lock lock (group.m_specialized_mutex);
+            if (ok && edits == group.m_interactive_edits) {
+                // The copy this replaces is freed when the last context
+                // running it is done with it.
+                group.m_specialized = copy;
+                published = true;
+                if (group.has_interactive_params())
+                    m_stat_respecializations += 1;
+            }
+        }
+        // Build from the profile only once, even if that failed, rather
+        // than trying again with every shade.
+        if (group.m_pgo && ! group.m_pgo->done.exchange (1) && published)
+            m_stat_pgo_rejits += 1;
+        group.m_respecializing = 0;
+    };
+
+    // Without async_jit threads, a profile-guided rebuild is done right
+    // away, like the group's first JIT was. Interactive respecialization
+    // is always in the background, to keep edits responsive.
+    if (m_async_jit <= 0 && ! group.has_interactive_params())
+        rebuild (0);
+    else
+        async_jit_pool()->push (rebuild);
+}
+
+
+
+// Estimate the relative expense of optimizing and JITing a group: the
+// total number of ops in all its layers is a decent proxy.
+static long long
+group_compile_cost (const ShaderGroup &group)
+{
+    long long cost = 0;
+    for (int i = 0, n = group.nlayers();  i < n;  ++i) {
+        const ShaderInstance *inst = group[i];
+        cost += 1 + (inst->master() ? inst->master()->num_ops() : 0);
+    }
+    return cost;
+}
+
+
+
+void
+ShadingSystemImpl::optimize_all_groups (int nthreads)
+{
+    // Only one thread at a time gets to compile everything; any others
+    // calling this in the meantime don't need to wait for it.
+    std::unique_lock<mutex> pool_lock (m_compile_pool_mutex, std::try_to_lock);
+    if (! pool_lock.owns_lock())
+        return;
+
+    // Gather the groups still needing compilation, and sort them from
+    // most to least expensive. Then each thread just keeps claiming the
+    // next unclaimed group, so the big ones start first and are never
+    // left running alone at the end while the other threads sit idle.
+    typedef std::pair<long long,ShaderGroupRef> CostGroup;
+    std::vector<CostGroup> todo;
     {
         spin_lock lock (m_all_shader_groups_mutex);
-        ngroups = m_all_shader_groups.size();
-    }
-    PerThreadInfo* threadinfo = create_thread_info();
-    ShadingContext* ctx = get_context(threadinfo);
-    for (size_t i = 0;  i < ngroups;  ++i) {
-        // Assign to threads based on mod of totalthreads
-        if ((i % totalthreads) == (unsigned)mythread) {
-            ShaderGroupRef group;
-            {
-                spin_lock lock (m_all_shader_groups_mutex);
-                group = m_all_shader_groups[i].lock();
-            }
-            if (group && group->m_complete)
-                optimize_group (*group, ctx);
+        for (auto&& g : m_all_shader_groups) {
+            ShaderGroupRef group = g.lock();
+            if (group && group->m_complete && ! group->optimized())
+                todo.emplace_back (group_compile_cost (*group), group);
         }
     }
-    release_context(ctx);
-    destroy_thread_info(threadinfo);
+    if (todo.empty())
+        return;
+    std::stable_sort (todo.begin(), todo.end(),
+                      [](const CostGroup &a, const CostGroup &b) {
+                          return a.first > b.first;
+                      });
+
+    if (nthreads < 1)  // threads <= 0 means use all hardware available
+        nthreads = (int) std::thread::hardware_concurrency();
+    nthreads = Imath::clamp (nthreads, 1, (int)todo.size());
+
+    OIIO::Timer walltimer;
+    std::atomic<size_t> next (0);
+    std::vector<double> busy (nthreads, 0.0);
+    auto worker = [&](int t) {
+        PerThreadInfo* threadinfo = create_thread_info();
+        ShadingContext* ctx = get_context(threadinfo);
+        for (size_t i = next++;  i < todo.size();  i = next++) {
+            OIIO::Timer timer;
+            optimize_group (*todo[i].second, ctx);
+            busy[t] += timer();
+        }
+        release_context(ctx);
+        destroy_thread_info(threadinfo);
+    };
+
+    m_threads_currently_compiling += nthreads;
+    // The calling thread is worker 0, the rest come from a pool that we
+    // keep around for subsequent calls.
+    std::vector<std::future<void>> helpers;
+    if (nthreads > 1) {
+        if (! m_compile_pool)
+            m_compile_pool.reset (new OIIO::thread_pool (nthreads-1));
+        else if (m_compile_pool->size() < nthreads-1)
+            m_compile_pool->resize (nthreads-1);
+        for (int t = 1;  t < nthreads;  ++t)
+            helpers.push_back (m_compile_pool->push ([&,t](int /*id*/){ worker(t); }));
+    }
+    worker (0);
+    for (auto&& h : helpers)
+        h.wait ();
+    m_threads_currently_compiling -= nthreads;
+
+    double wall = walltimer();
+    spin_lock stat_lock (m_stat_mutex);
+    m_stat_compile_all_time += wall;
+    if ((int)m_stat_compile_thread_idle.size() < nthreads)
+        m_stat_compile_thread_idle.resize (nthreads, 0.0);
+    for (int t = 0;  t < nthreads;  ++t)
+        m_stat_compile_thread_idle[t] += std::max (wall - busy[t], 0.0);
 }
 
 
@@ -3173,16 +3730,34 @@ ShadingSystemImpl::merge_instances (ShaderGroup &group, bool post_opt)
 
 #if OIIO_HAS_COLORPROCESSOR
 
-OIIO::ColorProcessorHandle
+const OIIO::ColorProcessor *
 OCIOColorSystem::load_transform (StringParam fromspace, StringParam tospace)
 {
-    if (fromspace != m_last_colorproc_fromspace ||
-        tospace != m_last_colorproc_tospace) {
-        m_last_colorproc = m_colorconfig.createColorProcessor (fromspace, tospace);
-        m_last_colorproc_fromspace = fromspace;
-        m_last_colorproc_tospace = tospace;
-    }
-    return m_last_colorproc;
+    // Fast path: it's already in the table
+    if (const TransformTable *table = m_transforms.load (std::memory_order_acquire)) {
+        for (auto&& t : *table)
+            if (t.fromspace == fromspace && t.tospace == tospace)
+                return t.processor.get();
+    }
+
+    lock_guard lock (m_transforms_mutex);
+    // Somebody else may have added it while we waited for the lock
+    const TransformTable *table = m_transforms.load (std::memory_order_relaxed);
+    if (table) {
+        for (auto&& t : *table)
+            if (t.fromspace == fromspace && t.tospace == tospace)
+                return t.processor.get();
+    }
+    std::unique_ptr<TransformTable> newtable (table ? new TransformTable (*table)
+                                                    : new TransformTable);
+    Transform t;
+    t.fromspace = fromspace;
+    t.tospace = tospace;
+    t.processor = m_colorconfig.createColorProcessor (fromspace, tospace);
+    newtable->push_back (t);
+    m_transforms.store (newtable.get(), std::memory_order_release);
+    m_tables.push_back (std::move (newtable));
+    return t.processor.get();
 }
 
 #endif
@@ -3193,11 +3768,7 @@ template <> bool
 ShadingSystemImpl::ocio_transform (StringParam fromspace, StringParam tospace,
                                    const Color3& C, Color3& Cout) {
 #if OIIO_HAS_COLORPROCESSOR
-    OIIO::ColorProcessorHandle cp;
-    {
-        lock_guard lock (m_mutex);
-        cp = m_ocio_system.load_transform(fromspace, tospace);
-    }
+    const OIIO::ColorProcessor *cp = m_ocio_system.load_transform (fromspace, tospace);
     if (cp) {
         Cout = C;
         cp->apply ((float *)&Cout);
@@ -3213,12 +3784,7 @@ template <> bool
 ShadingSystemImpl::ocio_transform (StringParam fromspace, StringParam tospace,
                                    const Dual2<Color3>& C, Dual2<Color3>& Cout) {
 #if OIIO_HAS_COLORPROCESSOR
-    OIIO::ColorProcessorHandle cp;
-    {
-        lock_guard lock (m_mutex);
-        cp = m_ocio_system.load_transform(fromspace, tospace);
-    }
-
+    const OIIO::ColorProcessor *cp = m_ocio_system.load_transform (fromspace, tospace);
     if (cp) {
         // Use finite differencing to approximate the derivative. Make 3
         // color values to convert.
@@ -3236,6 +3802,53 @@ ShadingSystemImpl::ocio_transform (StringParam fromspace, StringParam tospace,
 
 
 
+bool
+ShadingSystemImpl::ocio_transform_matrix (StringParam fromspace,
+                                          StringParam tospace, Matrix44 &M)
+{
+#if OIIO_HAS_COLORPROCESSOR
+    const OIIO::ColorProcessor *cp = m_ocio_system.load_transform (fromspace, tospace);
+    if (! cp)
+        return false;
+    // Run the basis vectors through to get the matrix rows, then check a
+    // spread of other colors (including ones outside [0,1], to catch
+    // clamping, and small ones, to catch curves) against it.
+    const int nprobes = 6;
+    Color3 C[3+nprobes] = {
+        Color3 (1.0f, 0.0f, 0.0f), Color3 (0.0f, 1.0f, 0.0f),
+        Color3 (0.0f, 0.0f, 1.0f),
+        Color3 (0.0f, 0.0f, 0.0f), Color3 (0.18f, 0.18f, 0.18f),
+        Color3 (0.9f, 0.5f, 0.1f), Color3 (0.02f, 0.6f, 0.3f),
+        Color3 (4.0f, 2.5f, 7.0f), Color3 (-0.25f, 0.5f, 1.5f)
+    };
+    Color3 Cout[3+nprobes];
+    std::copy (C, C+3+nprobes, Cout);
+    cp->apply ((float *)Cout, 3+nprobes, 1, 3, sizeof(float), sizeof(Color3), 0);
+    for (int i = 0; i < 3+nprobes; ++i)
+        if (! OIIO::isfinite(Cout[i].x) || ! OIIO::isfinite(Cout[i].y) ||
+            ! OIIO::isfinite(Cout[i].z))
+            return false;
+    M = Matrix44 (Cout[0].x, Cout[0].y, Cout[0].z, 0.0f,
+                  Cout[1].x, Cout[1].y, Cout[1].z, 0.0f,
+                  Cout[2].x, Cout[2].y, Cout[2].z, 0.0f,
+                  0.0f,      0.0f,      0.0f,      1.0f);
+    for (int i = 3; i < 3+nprobes; ++i) {
+        Color3 expected;
+        M.multDirMatrix (C[i], expected);
+        Color3 diff = Cout[i] - expected;
+        float tol = 1.0e-4f * std::max (1.0f, std::max (fabsf(expected.x),
+                        std::max (fabsf(expected.y), fabsf(expected.z))));
+        if (fabsf(diff.x) > tol || fabsf(diff.y) > tol || fabsf(diff.z) > tol)
+            return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
 bool
 ShadingSystemImpl::archive_shadergroup (ShaderGroup& group, string_view filename)
 {
@@ -0,0 +1,449 @@
+/*
+Copyright (c) 2019 Sony Pictures Imageworks Inc., et al.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+* Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+* Neither the name of Sony Pictures Imageworks nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// oslbench -- run a corpus of shader groups and report shading
+// throughput, compile time and memory, as JSON, so that OSL builds can
+// be compared against each other.
+//
+// The corpus is a text file of entries like:
+//
+//     # comment
+//     bench noise
+//         shader bench_noise layer1 ;
+//
+// Each "bench <name>" line starts a new entry, and the lines that follow
+// it (up to the next "bench") are a group specification in the same
+// serialized syntax accepted by ShadingSystem::ShaderGroupBegin.
+
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <OpenImageIO/argparse.h>
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/strutil.h>
+#include <OpenImageIO/sysutil.h>
+#include <OpenImageIO/thread.h>
+#include <OpenImageIO/timer.h>
+
+#include <OSL/oslexec.h>
+#include "../testshade/simplerend.h"
+
+using namespace OSL;
+
+
+static std::string corpusfile = "corpus.txt";
+static std::string shaderpath;
+static std::string texturepath;
+static std::string outputfile;
+static std::string extraoptions;
+static std::vector<std::string> onlybench;
+static int xres = 256, yres = 256;
+static int iters = 3;
+static int max_threads = 0;
+static bool verbose = false;
+
+
+
+// Error handler that remembers the errors, so that a benchmark that
+// fails to build can report why in the JSON rather than only on stdout.
+class BenchErrorHandler : public OIIO::ErrorHandler
+{
+public:
+    virtual void operator()(int errcode, const std::string& msg) {
+        if (verbose)
+            OIIO::ErrorHandler::operator() (errcode, msg);
+        if (errcode & (EH_ERROR | EH_SEVERE)) {
+            OIIO::lock_guard lock (m_mutex);
+            if (m_errors.size())
+                m_errors += "\n";
+            m_errors += msg;
+        }
+    }
+    std::string errors () {
+        OIIO::lock_guard lock (m_mutex);
+        std::string e;
+        std::swap (e, m_errors);
+        return e;
+    }
+private:
+    OIIO::mutex m_mutex;
+    std::string m_errors;
+};
+
+
+
+struct BenchEntry {
+    std::string name;
+    std::string groupspec;
+};
+
+
+
+struct ScalingResult {
+    int threads;
+    double seconds;           // best of the iterations
+};
+
+
+
+static void
+getargs (int argc, const char *argv[])
+{
+    static bool help = false;
+    OIIO::ArgParse ap;
+    ap.options ("Usage:  oslbench [options]",
+                "--help", &help, "Print help message",
+                "-v", &verbose, "Verbose messages",
+                "--corpus %s", &corpusfile, "Benchmark corpus file (default: corpus.txt)",
+                "--path %s", &shaderpath, "Specify oso search path",
+                "--texturepath %s", &texturepath, "Specify texture search path",
+                "--only %L", &onlybench, "Only run the named benchmark (may be repeated)",
+                "-g %d %d", &xres, &yres, "Shade a W x H grid of points (default: 256 256)",
+                "--iters %d", &iters, "Timed iterations per thread count, the best is kept (default: 3)",
+                "-t %d", &max_threads, "Scale up to N threads (default: auto-detect)",
+                "--options %s", &extraoptions, "Set extra OSL options",
+                "-o %s", &outputfile, "Write the JSON results to a file (default: stdout)",
+                NULL);
+    if (ap.parse(argc, argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help) {
+        std::cout << "oslbench -- Open Shading Language shading benchmarks\n"
+                     OSL_COPYRIGHT_STRING "\n";
+        ap.usage ();
+        exit (EXIT_SUCCESS);
+    }
+    xres = std::max (xres, 1);
+    yres = std::max (yres, 1);
+    iters = std::max (iters, 1);
+    if (max_threads < 1)
+        max_threads = OIIO::Sysutil::hardware_concurrency();
+}
+
+
+
+static bool
+read_corpus (const std::string &filename, std::vector<BenchEntry> &corpus)
+{
+    std::ifstream in (filename);
+    if (! in) {
+        std::cerr << "oslbench: could not open corpus \"" << filename << "\"\n";
+        return false;
+    }
+    std::string line;
+    while (std::getline (in, line)) {
+        string_view s = OIIO::Strutil::strip (line);
+        if (s.empty() || s[0] == '#')
+            continue;
+        if (OIIO::Strutil::parse_prefix (s, "bench")) {
+            corpus.emplace_back ();
+            corpus.back().name = OIIO::Strutil::strip (s).str();
+        } else if (corpus.size()) {
+            corpus.back().groupspec += line;
+            corpus.back().groupspec += "\n";
+        }
+    }
+    return true;
+}
+
+
+
+// Set up the ShaderGlobals for point (x,y) of a grid covering u,v in [0,1],
+// like testshade does with --center.
+static void
+setup_shaderglobals (ShaderGlobals &sg, int raytype, int x, int y)
+{
+    static Matrix44 Mident (1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1);
+    memset ((char *)&sg, 0, sizeof(ShaderGlobals));
+    sg.renderstate = &sg;
+    sg.shader2common = OSL::TransformationPtr (&Mident);
+    sg.object2common = OSL::TransformationPtr (&Mident);
+    sg.raytype = raytype;
+    sg.u = (float)(x+0.5f) / xres;
+    sg.v = (float)(y+0.5f) / yres;
+    sg.dudx = 1.0f / xres;
+    sg.dvdy = 1.0f / yres;
+    sg.P = Vec3 (sg.u, sg.v, 1.0f);
+    sg.dPdx = Vec3 (sg.dudx, sg.dudy, 0.0f);
+    sg.dPdy = Vec3 (sg.dvdx, sg.dvdy, 0.0f);
+    sg.dPdu = Vec3 (1.0f, 0.0f, 0.0f);
+    sg.dPdv = Vec3 (0.0f, 1.0f, 0.0f);
+    sg.N    = Vec3 (0, 0, 1);
+    sg.Ng   = Vec3 (0, 0, 1);
+    sg.surfacearea = 1;
+}
+
+
+
+// Shade every nthreads-th row of the grid, starting at row 'first'.
+static void
+shade_rows (ShadingSystem *shadingsys, ShaderGroup *group,
+            int first, int nthreads)
+{
+    PerThreadInfo *thread_info = shadingsys->create_thread_info();
+    ShadingContext *ctx = shadingsys->get_context (thread_info);
+    ShaderGlobals sg;
+    int raytype = shadingsys->raytype_bit (ustring ("camera"));
+    for (int y = first;  y < yres;  y += nthreads) {
+        for (int x = 0;  x < xres;  ++x) {
+            setup_shaderglobals (sg, raytype, x, y);
+            shadingsys->execute (*ctx, *group, sg);
+        }
+    }
+    shadingsys->release_context (ctx);
+    shadingsys->destroy_thread_info (thread_info);
+}
+
+
+
+// Shade the whole grid once using nthreads threads, return the wall time.
+static double
+shade_grid (ShadingSystem *shadingsys, ShaderGroup *group, int nthreads)
+{
+    OIIO::Timer timer;
+    if (nthreads == 1) {
+        shade_rows (shadingsys, group, 0, 1);
+    } else {
+        std::vector<std::thread> threads;
+        for (int t = 0;  t < nthreads;  ++t)
+            threads.emplace_back (shade_rows, shadingsys, group, t, nthreads);
+        for (auto &t : threads)
+            t.join ();
+    }
+    return timer();
+}
+
+
+
+static std::string
+json_string (string_view s)
+{
+    std::string r = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            r += '\\';
+            r += c;
+        } else if (c == '\n') {
+            r += "\\n";
+        } else if ((unsigned char)c < 0x20) {
+            r += OIIO::Strutil::sprintf ("\\u%04x", (int)c);
+        } else {
+            r += c;
+        }
+    }
+    r += "\"";
+    return r;
+}
+
+
+
+static float
+statf (ShadingSystem *shadingsys, const char *name)
+{
+    float f = 0.0f;
+    shadingsys->getattribute (name, TypeDesc::FLOAT, &f);
+    return f;
+}
+
+
+
+// Run one corpus entry in its own ShadingSystem, so that the compile
+// statistics and memory figures belong to this entry alone. Append its
+// JSON record to 'out'.
+static void
+run_bench (const BenchEntry &bench, std::ostream &out)
+{
+    BenchErrorHandler errhandler;
+    SimpleRenderer rend;
+    std::unique_ptr<ShadingSystem> shadingsys (
+        new ShadingSystem (&rend, nullptr, &errhandler));
+    rend.init_shadingsys (shadingsys.get());
+    register_closures (shadingsys.get());
+    shadingsys->attribute ("lockgeom", 1);
+    if (shaderpath.size())
+        shadingsys->attribute ("searchpath:shader", shaderpath);
+    if (texturepath.size())
+        shadingsys->texturesys()->attribute ("searchpath", texturepath);
+    if (extraoptions.size())
+        shadingsys->attribute ("options", extraoptions);
+
+    out << "    {\n      \"name\": " << json_string (bench.name) << ",\n";
+
+    OIIO::Timer timer;
+    ShaderGroupRef group = shadingsys->ShaderGroupBegin (bench.name, "surface",
+                                                         bench.groupspec);
+    if (group)
+        shadingsys->ShaderGroupEnd ();
+    std::string err = errhandler.errors();
+    if (! group || err.size()) {
+        // Typically a shader that wasn't built (e.g. no MaterialX)
+        std::cerr << "oslbench: skipping " << bench.name << "\n";
+        out << "      \"status\": \"skipped\",\n"
+            << "      \"error\": " << json_string (err) << "\n    }";
+        return;
+    }
+
+    // Compile up front, so that the timed runs only measure execution.
+    {
+        PerThreadInfo *thread_info = shadingsys->create_thread_info();
+        ShadingContext *ctx = shadingsys->get_context (thread_info);
+        shadingsys->optimize_group (group.get(), ctx);
+        shadingsys->release_context (ctx);
+        shadingsys->destroy_thread_info (thread_info);
+    }
+    double compile_time = timer.lap();
+    err = errhandler.errors();
+    if (err.size()) {
+        std::cerr << "oslbench: " << bench.name << " failed to compile\n";
+        out << "      \"status\": \"failed\",\n"
+            << "      \"error\": " << json_string (err) << "\n    }";
+        return;
+    }
+
+    // One untimed pass warms the texture cache and any lazy state.
+    shade_grid (shadingsys.get(), group.get(), 1);
+
+    std::vector<ScalingResult> scaling;
+    for (int nthreads = 1;  ;  nthreads *= 2) {
+        nthreads = std::min (nthreads, max_threads);
+        double best = 0.0;
+        for (int i = 0;  i < iters;  ++i) {
+            double t = shade_grid (shadingsys.get(), group.get(), nthreads);
+            best = i ? std::min (best, t) : t;
+        }
+        scaling.push_back ({ nthreads, best });
+        if (verbose)
+            std::cerr << "  " << bench.name << " threads=" << nthreads
+                      << " " << best << "s\n";
+        if (nthreads == max_threads)
+            break;
+    }
+
+    int groupdata_size = 0;
+    shadingsys->getattribute (group.get(), "llvm_groupdata_size",
+                              groupdata_size);
+    long long ss_memory = 0;
+    shadingsys->getattribute ("stat:memory_current", TypeDesc::INT64,
+                              &ss_memory);
+    int nlayers = 0;
+    shadingsys->getattribute (group.get(), "num_layers", nlayers);
+
+    out << "      \"status\": \"ok\",\n";
+    out << "      \"layers\": " << nlayers << ",\n";
+    out << "      \"compile\": {\n";
+    out << "        \"total\": " << compile_time << ",\n";
+    out << "        \"master_load\": " << statf (shadingsys.get(), "stat:master_load_time") << ",\n";
+    out << "        \"optimization\": " << statf (shadingsys.get(), "stat:optimization_time") << ",\n";
+    out << "        \"llvm_total\": " << statf (shadingsys.get(), "stat:total_llvm_time") << ",\n";
+    out << "        \"llvm_setup\": " << statf (shadingsys.get(), "stat:llvm_setup_time") << ",\n";
+    out << "        \"llvm_irgen\": " << statf (shadingsys.get(), "stat:llvm_irgen_time") << ",\n";
+    out << "        \"llvm_opt\": " << statf (shadingsys.get(), "stat:llvm_opt_time") << ",\n";
+    out << "        \"llvm_jit\": " << statf (shadingsys.get(), "stat:llvm_jit_time") << "\n";
+    out << "      },\n";
+    out << "      \"memory\": {\n";
+    out << "        \"context_groupdata_bytes\": " << groupdata_size << ",\n";
+    out << "        \"shadingsys_bytes\": " << ss_memory << "\n";
+    out << "      },\n";
+    out << "      \"scaling\": [\n";
+    double npoints = double(xres) * double(yres);
+    double single = npoints / std::max (scaling[0].seconds, 1.0e-9);
+    for (size_t i = 0;  i < scaling.size();  ++i) {
+        const ScalingResult &r (scaling[i]);
+        double rate = npoints / std::max (r.seconds, 1.0e-9);
+        out << "        { \"threads\": " << r.threads
+            << ", \"seconds\": " << r.seconds
+            << ", \"shades_per_sec\": " << rate
+            << ", \"shades_per_sec_per_thread\": " << rate / r.threads
+            << ", \"efficiency\": " << rate / (single * r.threads)
+            << " }" << (i+1 < scaling.size() ? ",\n" : "\n");
+    }
+    out << "      ]\n    }";
+
+    group.reset ();   // Must release this before destroying shadingsys
+}
+
+
+
+int
+main (int argc, const char *argv[])
+{
+#ifdef OIIO_HAS_STACKTRACE
+    OIIO::Sysutil::setup_crash_stacktrace("stdout");
+#endif
+    getargs (argc, argv);
+
+    std::vector<BenchEntry> corpus;
+    if (! read_corpus (corpusfile, corpus))
+        return EXIT_FAILURE;
+
+    std::ostringstream out;
+    out.imbue (std::locale::classic());  // Be sure we use . for decimal
+    out << "{\n";
+    out << "  \"osl_version\": " << json_string (OSL_LIBRARY_VERSION_STRING) << ",\n";
+    out << "  \"hardware_threads\": " << OIIO::Sysutil::hardware_concurrency() << ",\n";
+    out << "  \"max_threads\": " << max_threads << ",\n";
+    out << "  \"resolution\": [ " << xres << ", " << yres << " ],\n";
+    out << "  \"iters\": " << iters << ",\n";
+    out << "  \"benchmarks\": [\n";
+    bool first = true;
+    for (auto &bench : corpus) {
+        if (onlybench.size() && std::find (onlybench.begin(), onlybench.end(),
+                                           bench.name) == onlybench.end())
+            continue;
+        if (! first)
+            out << ",\n";
+        first = false;
+        if (verbose)
+            std::cerr << "oslbench: running " << bench.name << "\n";
+        run_bench (bench, out);
+    }
+    out << "\n  ]\n}\n";
+
+    if (outputfile.size()) {
+        std::ofstream file (outputfile);
+        file << out.str();
+        if (! file) {
+            std::cerr << "oslbench: could not write \"" << outputfile << "\"\n";
+            return EXIT_FAILURE;
+        }
+    } else {
+        std::cout << out.str();
+    }
+    return EXIT_SUCCESS;
+}
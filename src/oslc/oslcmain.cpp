@@ -62,6 +62,8 @@ usage ()
         "\t-d             Debug mode\n"
         "\t-E             Only preprocess the input and output to stdout\n"
         "\t-Werror        Treat all warnings as errors\n"
+        "\t-binary        Write binary oso (faster to load); given a .oso\n"
+        "\t                 file, convert it to binary oso in place (or to -o)\n"
         "\t-buffer        (debugging) Force compile from buffer\n"
         ;
 }
@@ -147,7 +149,8 @@ main (int argc, const char *argv[])
                  ! strcmp (argv[a], "-E") ||
                  ! strcmp (argv[a], "-O") || ! strcmp (argv[a], "-O0") ||
                  ! strcmp (argv[a], "-O1") || ! strcmp (argv[a], "-O2") ||
-                 ! strcmp (argv[a], "-Werror")
+                 ! strcmp (argv[a], "-Werror") ||
+                 ! strcmp (argv[a], "-binary")
                  ) {
             // Valid command-line argument
             args.emplace_back(argv[a]);
@@ -190,7 +193,8 @@ main (int argc, const char *argv[])
                                           shader_path);
         if (ok) {
             std::ofstream file;
-            OIIO::Filesystem::open (file, compiler.output_filename());
+            OIIO::Filesystem::open (file, compiler.output_filename(),
+                                    std::ios::out | std::ios::binary);
             if (file.good()) {
                 file << osobuffer;
                 file.close ();
@@ -352,6 +352,17 @@ SimpleRenderer::get_inverse_matrix (ShaderGlobals *sg, Matrix44 &result,
 
 
 
+bool
+SimpleRenderer::matrix_is_constant (ShaderGlobals *sg, ustring name)
+{
+    // Without motion blur, the camera spaces and named transforms are
+    // the same for every shade.
+    return name == u_camera || name == u_screen || name == u_NDC ||
+           name == u_raster || m_named_xforms.count (name);
+}
+
+
+
 void
 SimpleRenderer::name_transform (const char *name, const OSL::Matrix44 &xform)
 {
@@ -400,6 +411,16 @@ SimpleRenderer::get_attribute (ShaderGlobals *sg, bool derivatives, ustring obje
 
 
 
+bool
+SimpleRenderer::attribute_is_constant (ShaderGlobals *sg, ustring object,
+                                       ustring name)
+{
+    // The camera (and version) don't change over the course of a render.
+    return m_attr_getters.find (name) != m_attr_getters.end();
+}
+
+
+
 bool
 SimpleRenderer::get_userdata (bool derivatives, ustring name, TypeDesc type,
                               ShaderGlobals *sg, void *val)
@@ -66,6 +66,7 @@ public:
                              ustring from);
     virtual bool get_inverse_matrix (ShaderGlobals *sg, Matrix44 &result,
                                      ustring to, float time);
+    virtual bool matrix_is_constant (ShaderGlobals *sg, ustring name);
 
     void name_transform (const char *name, const Transformation &xform);
 
@@ -74,6 +75,8 @@ public:
                                       int index, void *val );
     virtual bool get_attribute (ShaderGlobals *sg, bool derivatives, ustring object,
                                 TypeDesc type, ustring name, void *val);
+    virtual bool attribute_is_constant (ShaderGlobals *sg, ustring object,
+                                        ustring name);
     virtual bool get_userdata (bool derivatives, ustring name, TypeDesc type, 
                                ShaderGlobals *sg, void *val);
 
@@ -27,13 +27,22 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
@@ -45,6 +54,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OpenImageIO/timer.h>
 
 #include <OSL/oslexec.h>
+#include <OSL/oslclosure.h>
 #include <OSL/oslcomp.h>
 #include <OSL/oslquery.h>
 #include "optixgridrender.h"
@@ -83,6 +93,9 @@ static bool inbuffer = false;
 static bool use_shade_image = false;
 static bool userdata_isconnected = false;
 static bool print_outputs = false;
+static bool flatclosures = false;
+static bool invalidate_attribs = false;
+static bool batch = false;
 static bool use_optix = OIIO::Strutil::stoi(OIIO::Sysutil::getenv("TESTSHADE_OPTIX"));
 static int xres = 1, yres = 1;
 static int num_threads = 0;
@@ -95,6 +108,9 @@ static ParamValueList reparams;
 static std::string reparam_layer;
 static ErrorHandler errhandler;
 static int iters = 1;
+static bool throughput = false;
+static int bucketx = 32, buckety = 32;
+static bool pin_threads = false;
 static std::string raytype = "camera";
 static bool raytype_opt = false;
 static std::string extraoptions;
@@ -103,6 +119,7 @@ static OSL::Matrix44 Mshad;  // "shader" space to "common" space matrix
 static OSL::Matrix44 Mobj;   // "object" space to "common" space matrix
 static ShaderGroupRef shadergroup;
 static std::string archivegroup;
+static std::string convertcloud_in, convertcloud_out;
 static int exprcount = 0;
 static bool shadingsys_options_set = false;
 static float uscale = 1, vscale = 1;
@@ -483,6 +500,9 @@ getargs (int argc, const char *argv[])
                         "uint8, half, float",
                 "-od %s", &dataformatname, "", // old name
                 "--print", &print_outputs, "Print values of all -o outputs to console instead of saving images",
+                "--flatclosures", &flatclosures, "With --print, also print Ci as a flat closure list",
+                "--invalidate_attribs", &invalidate_attribs, "Invalidate the cached constant attributes after each row",
+                "--batch", &batch, "Shade each row with execute_batch (outputs other than --flatclosures are skipped)",
                 "--groupname %s", &groupname, "Set shader group name",
                 "--layer %@ %s", stash_shader_arg, NULL, "Set next layer name",
                 "--param %@ %s %s", stash_shader_arg, NULL, NULL,
@@ -498,9 +518,14 @@ getargs (int argc, const char *argv[])
                         "Specify a full group command",
                 "--archivegroup %s", &archivegroup,
                         "Archive the group to a given filename",
+                "--convertcloud %s %s", &convertcloud_in, &convertcloud_out,
+                        "Convert a point cloud to the native .oslpc format, and exit",
                 "--raytype %s", &raytype, "Set the raytype",
                 "--raytype_opt", &raytype_opt, "Specify ray type mask for optimization",
                 "--iters %d", &iters, "Number of iterations",
+                "--throughput", &throughput, "Benchmark mode: persistent per-thread contexts, time --iters passes after a warmup pass",
+                "--bucket %d %d", &bucketx, &buckety, "Bucket size for --throughput (default: 32 32)",
+                "--pin", &pin_threads, "Pin --throughput worker threads to cores",
                 "-O0", &O0, "Do no runtime shader optimization",
                 "-O1", &O1, "Do a little runtime shader optimization",
                 "-O2", &O2, "Do lots of runtime shader optimization",
@@ -718,7 +743,11 @@ setup_output_images (SimpleRenderer *rend, ShadingSystem *shadingsys,
     int raytype_bit = shadingsys->raytype_bit (ustring (raytype));
     if (raytype_opt)
         shadingsys->optimize_group (shadergroup.get(), raytype_bit, ~raytype_bit, ctx);
-    shadingsys->execute (*ctx, *shadergroup, sg, false);
+    // With async_jit, wait for the background compile rather than shade
+    // (or look up symbols) before it's done.
+    while (! shadingsys->execute (*ctx, *shadergroup, sg, false) &&
+           shadingsys->execution_deferred (*ctx))
+        std::this_thread::yield ();
 
     if (entryoutputs.size()) {
         std::cout << "Entry outputs:";
@@ -797,12 +826,13 @@ setup_output_images (SimpleRenderer *rend, ShadingSystem *shadingsys,
 // in the direction of the camera for that pixel.
 static void
 save_outputs (SimpleRenderer *rend, ShadingSystem *shadingsys,
-              ShadingContext *ctx, int x, int y)
+              ShadingContext *ctx, int x, int y, int point=0)
 {
     if (print_outputs)
         printf ("Pixel (%d, %d):\n", x, y);
-    // For each output requested on the command line...
-    for (size_t i = 0, e = rend->noutputs();  i < e;  ++i) {
+    // For each output requested on the command line (which, after a
+    // batch, would only hold the last point's values)...
+    for (size_t i = 0, e = batch ? 0 : rend->noutputs();  i < e;  ++i) {
         // Skip if we couldn't open the image or didn't match a known output
         OIIO::ImageBuf* outputimg = rend->outputbuf(i);
         if (! outputimg)
@@ -842,6 +872,15 @@ save_outputs (SimpleRenderer *rend, ShadingSystem *shadingsys,
         }
         // N.B. Drop any outputs that aren't float- or int-based
     }
+    if (print_outputs && flatclosures) {
+        const FlatClosure *closures;
+        int n = shadingsys->flat_closures (*ctx, closures, point);
+        printf ("  Ci : %d components\n", n);
+        for (int i = 0; i < n; ++i)
+            printf ("    id %d weight %g %g %g\n", closures[i].id,
+                    closures[i].weight[0], closures[i].weight[1],
+                    closures[i].weight[2]);
+    }
 }
 
 
@@ -948,6 +987,48 @@ test_group_attributes (ShaderGroup *group)
 
 
 
+// Run the group for one point, shading the grid point (x,y).
+static void
+shade_point (ShaderGroup *shadergroup, ShadingContext *ctx,
+             ShaderGlobals &shaderglobals, int x, int y)
+{
+    // In a real renderer, this is where you would figure out what object
+    // point is visible in this pixel (or this sample, for antialiasing).
+    // Once determined, you'd set up a ShaderGlobals that contained the
+    // vital information about that point, such as its location, the
+    // normal there, the u and v coordinates on the surface, the
+    // transformation of that object, and so on.
+    //
+    // This test app is not a real renderer, so we just set it up rigged
+    // to look like we're rendering a single quadrilateral that exactly
+    // fills the viewport, and that setup is done in the following
+    // function call:
+    setup_shaderglobals (shaderglobals, shadingsys, x, y);
+
+    // Actually run the shader for this point
+    if (entrylayer_index.empty()) {
+        // Sole entry point for whole group, default behavior
+        while (! shadingsys->execute (*ctx, *shadergroup, shaderglobals) &&
+               shadingsys->execution_deferred (*ctx))
+            std::this_thread::yield ();   // Wait for async_jit
+    } else {
+        // Explicit list of entries to call in order
+        while (! shadingsys->execute_init (*ctx, *shadergroup, shaderglobals) &&
+               shadingsys->execution_deferred (*ctx))
+            std::this_thread::yield ();   // Wait for async_jit
+        if (entrylayer_symbols.size()) {
+            for (size_t i = 0, e = entrylayer_symbols.size(); i < e; ++i)
+                shadingsys->execute_layer (*ctx, shaderglobals, entrylayer_symbols[i]);
+        } else {
+            for (size_t i = 0, e = entrylayer_index.size(); i < e; ++i)
+                shadingsys->execute_layer (*ctx, shaderglobals, entrylayer_index[i]);
+        }
+        shadingsys->execute_cleanup (*ctx);
+    }
+}
+
+
+
 void
 shade_region (SimpleRenderer *rend, ShaderGroup *shadergroup,
               OIIO::ROI roi, bool save)
@@ -964,40 +1045,28 @@ shade_region (SimpleRenderer *rend, ShaderGroup *shadergroup,
     // Set up shader globals and a little test grid of points to shade.
     ShaderGlobals shaderglobals;
 
+    if (batch) {
+        // Shade each row of the region as one batch
+        std::vector<ShaderGlobals> row (roi.width());
+        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+            for (int x = roi.xbegin;  x < roi.xend;  ++x)
+                setup_shaderglobals (row[x-roi.xbegin], shadingsys, x, y);
+            while (! shadingsys->execute_batch (*ctx, *shadergroup, roi.width(), &row[0]) &&
+                   shadingsys->execution_deferred (*ctx))
+                std::this_thread::yield ();   // Wait for async_jit
+            if (save)
+                for (int x = roi.xbegin;  x < roi.xend;  ++x)
+                    save_outputs (rend, shadingsys, ctx, x, y, x-roi.xbegin);
+        }
+        shadingsys->release_context (ctx);
+        shadingsys->destroy_thread_info(thread_info);
+        return;
+    }
+
     // Loop over all pixels in the image (in x and y)...
     for (int y = roi.ybegin;  y < roi.yend;  ++y) {
         for (int x = roi.xbegin;  x < roi.xend;  ++x) {
-            // In a real renderer, this is where you would figure
-            // out what object point is visible in this pixel (or
-            // this sample, for antialiasing).  Once determined,
-            // you'd set up a ShaderGlobals that contained the vital
-            // information about that point, such as its location,
-            // the normal there, the u and v coordinates on the
-            // surface, the transformation of that object, and so
-            // on.  
-            //
-            // This test app is not a real renderer, so we just
-            // set it up rigged to look like we're rendering a single
-            // quadrilateral that exactly fills the viewport, and that
-            // setup is done in the following function call:
-            setup_shaderglobals (shaderglobals, shadingsys, x, y);
-
-            // Actually run the shader for this point
-            if (entrylayer_index.empty()) {
-                // Sole entry point for whole group, default behavior
-                shadingsys->execute (*ctx, *shadergroup, shaderglobals);
-            } else {
-                // Explicit list of entries to call in order
-                shadingsys->execute_init (*ctx, *shadergroup, shaderglobals);
-                if (entrylayer_symbols.size()) {
-                    for (size_t i = 0, e = entrylayer_symbols.size(); i < e; ++i)
-                        shadingsys->execute_layer (*ctx, shaderglobals, entrylayer_symbols[i]);
-                } else {
-                    for (size_t i = 0, e = entrylayer_index.size(); i < e; ++i)
-                        shadingsys->execute_layer (*ctx, shaderglobals, entrylayer_index[i]);
-                }
-                shadingsys->execute_cleanup (*ctx);
-            }
+            shade_point (shadergroup, ctx, shaderglobals, x, y);
 
             // Save all the designated outputs.  But only do so if we
             // are on the last iteration requested, so that if we are
@@ -1006,6 +1075,8 @@ shade_region (SimpleRenderer *rend, ShaderGroup *shadergroup,
             if (save)
                 save_outputs (rend, shadingsys, ctx, x, y);
         }
+        if (invalidate_attribs)
+            shadingsys->invalidate_attribute_cache ();
     }
 
     // We're done shading with this context.
@@ -1014,6 +1085,160 @@ shade_region (SimpleRenderer *rend, ShaderGroup *shadergroup,
 }
 
 
+
+// Minimal reusable barrier for the --throughput workers.
+class ThroughputBarrier {
+public:
+    ThroughputBarrier (int count) : m_count(count) { }
+    void wait () {
+        std::unique_lock<std::mutex> lock (m_mutex);
+        int generation = m_generation;
+        if (++m_waiting == m_count) {
+            m_waiting = 0;
+            ++m_generation;
+            m_cond.notify_all ();
+        } else {
+            m_cond.wait (lock, [&](){ return generation != m_generation; });
+        }
+    }
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    int m_count;
+    int m_waiting = 0;
+    int m_generation = 0;
+};
+
+
+
+struct ThroughputThread {
+    long long shades = 0;    // points shaded in the timed passes
+    double busy = 0.0;       // time spent shading in the timed passes
+    int cpu = -1;            // core it was pinned to, or -1
+};
+
+
+
+// Pin the calling thread to a core, returning the core (or -1 if
+// pinning isn't supported here or failed).
+static int
+pin_thread (int index)
+{
+#ifdef __linux__
+    int ncpus = std::max (1, (int)OIIO::Sysutil::hardware_concurrency());
+    int cpu = index % ncpus;
+    cpu_set_t cpus;
+    CPU_ZERO (&cpus);
+    CPU_SET (cpu, &cpus);
+    if (pthread_setaffinity_np (pthread_self(), sizeof(cpus), &cpus) == 0)
+        return cpu;
+#endif
+    return -1;
+}
+
+
+
+// One --throughput worker. Unlike shade_region, it keeps its thread info
+// and context for the whole run, and pulls buckets from a shared counter.
+// Pass 0 is the untimed warmup, and is the one that saves the outputs, so
+// the timed passes measure nothing but shading.
+static void
+throughput_worker (SimpleRenderer *rend, ShaderGroup *shadergroup, int index,
+                   ThroughputBarrier *barrier, std::atomic<int> *nextbucket,
+                   ThroughputThread *stats)
+{
+    if (pin_threads)
+        stats->cpu = pin_thread (index);
+    OSL::PerThreadInfo *thread_info = shadingsys->create_thread_info();
+    ShadingContext *ctx = shadingsys->get_context (thread_info);
+    ShaderGlobals shaderglobals;
+    int nbx = (xres + bucketx - 1) / bucketx;
+    int nbuckets = nbx * ((yres + buckety - 1) / buckety);
+    for (int pass = 0;  pass <= iters;  ++pass) {
+        barrier->wait ();   // start of pass
+        OIIO::Timer timer;
+        long long shades = 0;
+        for (int b = (*nextbucket)++;  b < nbuckets;  b = (*nextbucket)++) {
+            int xbegin = (b % nbx) * bucketx, ybegin = (b / nbx) * buckety;
+            int xend = std::min (xbegin + bucketx, xres);
+            int yend = std::min (ybegin + buckety, yres);
+            for (int y = ybegin;  y < yend;  ++y) {
+                for (int x = xbegin;  x < xend;  ++x) {
+                    shade_point (shadergroup, ctx, shaderglobals, x, y);
+                    if (pass == 0)
+                        save_outputs (rend, shadingsys, ctx, x, y);
+                }
+            }
+            shades += (long long)(xend - xbegin) * (yend - ybegin);
+        }
+        if (pass > 0) {
+            stats->busy += timer();
+            stats->shades += shades;
+        }
+        barrier->wait ();   // end of pass
+    }
+    shadingsys->release_context (ctx);
+    shadingsys->destroy_thread_info (thread_info);
+}
+
+
+
+// --throughput: shade the grid once untimed, then 'iters' timed passes,
+// and report the throughput of the whole and of each thread.
+static void
+shade_throughput (SimpleRenderer *rend, ShaderGroup *shadergroup)
+{
+    bucketx = std::max (bucketx, 1);
+    buckety = std::max (buckety, 1);
+    iters = std::max (iters, 1);
+    ThroughputBarrier barrier (num_threads + 1);
+    std::atomic<int> nextbucket (0);
+    std::vector<ThroughputThread> stats (num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < num_threads;  ++t)
+        threads.emplace_back (throughput_worker, rend, shadergroup, t,
+                              &barrier, &nextbucket, &stats[t]);
+    std::vector<double> passtimes;
+    for (int pass = 0;  pass <= iters;  ++pass) {
+        nextbucket = 0;
+        barrier.wait ();
+        OIIO::Timer timer;
+        barrier.wait ();
+        if (pass > 0)
+            passtimes.push_back (timer());
+    }
+    for (auto &t : threads)
+        t.join ();
+
+    double npoints = double(xres) * double(yres);
+    double best = *std::min_element (passtimes.begin(), passtimes.end());
+    double total = 0.0;
+    for (double t : passtimes)
+        total += t;
+    int heapsize = 0;
+    shadingsys->getattribute (shadergroup, "llvm_groupdata_size", heapsize);
+    std::cout << "\nThroughput: " << xres << "x" << yres << " points, "
+              << num_threads << " threads" << (pin_threads ? " (pinned)" : "")
+              << ", " << bucketx << "x" << buckety << " buckets, "
+              << iters << " timed passes after warmup\n";
+    std::cout << OIIO::Strutil::sprintf ("  Pass time: best %s, mean %s\n",
+                          OIIO::Strutil::timeintervalformat (best, 4),
+                          OIIO::Strutil::timeintervalformat (total / iters, 4));
+    std::cout << OIIO::Strutil::sprintf ("  Shades/sec: %.0f (best pass), %.0f per thread\n",
+                          npoints / best, npoints / best / num_threads);
+    std::cout << OIIO::Strutil::sprintf ("  Context heap size: %d bytes\n", heapsize);
+    for (int t = 0;  t < num_threads;  ++t) {
+        const ThroughputThread &s (stats[t]);
+        std::string cpu = s.cpu >= 0 ? OIIO::Strutil::sprintf (" (cpu %d)", s.cpu) : std::string();
+        std::cout << OIIO::Strutil::sprintf ("  thread %d%s: %lld shades in %s, %.0f shades/sec\n",
+                              t, cpu, s.shades,
+                              OIIO::Strutil::timeintervalformat (s.busy, 4),
+                              s.busy > 0.0 ? s.shades / s.busy : 0.0);
+    }
+}
+
+
+
 static void synchio() {
     // Synch all writes to stdout & stderr now (mostly for Windows)
     std::cout.flush();
@@ -1031,6 +1256,14 @@ test_shade (int argc, const char *argv[])
     // instances are queued up in shader_setup_args for later handling.
     getargs (argc, argv);
 
+    if (convertcloud_in.size()) {
+        std::string err;
+        bool ok = OSL::convert_pointcloud (convertcloud_in, convertcloud_out, err);
+        if (! ok)
+            std::cerr << "testshade: " << err << "\n";
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     SimpleRenderer *rend = nullptr;
 #ifdef OSL_USE_OPTIX
     if (use_optix)
@@ -1154,6 +1387,8 @@ test_shade (int argc, const char *argv[])
 
     // End the group
     shadingsys->ShaderGroupEnd (*shadergroup);
+    if (flatclosures)
+        shadingsys->attribute (shadergroup.get(), "flat_closures", 1);
 
     if (verbose || do_oslquery) {
         std::string pickle;
@@ -1222,7 +1457,12 @@ test_shade (int argc, const char *argv[])
     // Allow a settable number of iterations to "render" the whole image,
     // which is useful for time trials of things that would be too quick
     // to accurately time for a single iteration
-    for (int iter = 0;  iter < iters;  ++iter) {
+    int niters = iters;
+    if (throughput && ! use_optix && ! use_shade_image) {
+        shade_throughput (rend, shadergroup.get());
+        niters = 0;   // it did all the shading
+    }
+    for (int iter = 0;  iter < niters;  ++iter) {
         OIIO::ROI roi (0, xres, 0, yres);
 
         if (use_optix) {
@@ -1233,7 +1473,7 @@ test_shade (int argc, const char *argv[])
                               pixelcenters ? ShadePixelCenters : ShadePixelGrid,
                               roi, num_threads);
         } else {
-            bool save = (iter == (iters-1));   // save on last iteration
+            bool save = (iter == (niters-1));   // save on last iteration
 #if 0
             shade_region (rend, shadergroup.get(), roi, save);
 #else
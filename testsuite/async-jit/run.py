@@ -0,0 +1,9 @@
+#!/usr/bin/env python
+
+# With a background JIT thread, the first shade is deferred until the
+# group is compiled (testshade waits and shades again), and every point
+# must still be shaded exactly once with the compiled group.
+command = testshade("-t 1 -g 2 2 --options async_jit=1 test")
+command += (osl_app("testshade") + "-t 1 -g 2 2 --runstats "
+            + "--options async_jit=1 test | grep -o 'Background JIT: [0-9]* groups'"
+            + redirect + " ;\n")
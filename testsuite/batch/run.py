@@ -0,0 +1,10 @@
+#!/usr/bin/env python
+
+# The same points shaded one at a time and in batches (one per row) must
+# get the same closures. Each point of a batch must also count as a shade
+# of the profile-guided build, so that its re-JIT happens on schedule.
+command = testshade("-t 1 -g 2 2 --print --flatclosures test")
+command += testshade("-t 1 -g 2 2 --print --flatclosures --batch test")
+command += (osl_app("testshade") + "-t 1 -g 2 2 --batch --runstats "
+            + "--options pgo_samples=2 test | grep 'Profile-guided'"
+            + redirect + " ;\n")
@@ -0,0 +1,4 @@
+#!/usr/bin/env python
+
+# Print Ci of each point as the flat list of weighted components
+command = testshade("-t 1 -g 2 1 --print --flatclosures test")
@@ -0,0 +1,14 @@
+#!/usr/bin/env python
+
+# testshade's renderer declares the camera attributes constant, so after
+# the first point they come from the context's cache. Invalidating the
+# cache after each row must send the first point of the next row back to
+# the renderer, and still get the same values.
+def cached_testshade (args) :
+    return (osl_app("testshade") + "-t 1 -g 2 2 --runstats "
+            + "--options opt_fold_getattribute=0 " + args
+            + " 2>&1 | grep -e '^resolution' -e 'getattribute cache:'"
+            + redirect + " ;\n")
+
+command = cached_testshade("test")
+command += cached_testshade("--invalidate_attribs test")
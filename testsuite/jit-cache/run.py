@@ -0,0 +1,17 @@
+#!/usr/bin/env python
+
+import shutil
+
+# Run the same shader in two processes that share a JIT cache. The first
+# compiles the group and saves its machine code; the second must find it
+# there, and get the same results from running it. Only the shader output
+# and the cache line of the stats are kept, the rest varies run to run.
+shutil.rmtree ("jitcache", ignore_errors=True)
+
+def cached_testshade (args) :
+    return (osl_app("testshade") + "--runstats --options llvm_jit_cache=jitcache "
+            + args + " 2>&1 | grep -e '^test:' -e 'JIT cache:'"
+            + " | sed -e 's/ misses,.*/ misses/'" + redirect + " ;\n")
+
+command = cached_testshade("test")
+command += cached_testshade("test")
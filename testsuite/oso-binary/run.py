@@ -0,0 +1,7 @@
+#!/usr/bin/env python
+
+# Convert the compiled shader to binary oso in place, and make sure that
+# both oslinfo and testshade read it back correctly.
+command = oslc("-binary test.oso")
+command += oslinfo("-v test")
+command += testshade("test")
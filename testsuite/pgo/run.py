@@ -0,0 +1,8 @@
+#!/usr/bin/env python
+
+# Profile the first two shades of the group, then rebuild it from the
+# counts (right away, since there are no async_jit threads) and run the
+# rebuilt copy for the rest. Both builds must give the same results.
+command = (osl_app("testshade") + "-t 1 -g 2 2 --runstats --options pgo_samples=2 "
+           + "-layer alayer a -layer blayer b -connect alayer out blayer in"
+           + " | grep -e '^b:' -e 'Profile-guided'" + redirect + " ;\n")
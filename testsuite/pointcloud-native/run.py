@@ -0,0 +1,9 @@
+#!/usr/bin/env python
+
+# Write a 3x3 grid of points to a native cloud, convert (copy) it, then
+# search both from a single point
+command += testshade("-t 1 -g 3 3 wrcloud")
+command += testshade("--convertcloud cloud.oslpc copy.oslpc")
+command += testshade("-g 1 1 --offsetuv 0.1 0.2 rdcloud")
+command += testshade("-g 1 1 --offsetuv 0.1 0.2 -param maxpoints 3 rdcloud")
+command += testshade("-g 1 1 --offsetuv 0.1 0.2 -param filename copy.oslpc rdcloud")
@@ -0,0 +1,10 @@
+#!/usr/bin/env python
+
+# The group is JITed twice, first instrumented for profile-guided
+# optimization and then rebuilt from its counts. The layer profile must
+# still show the layer once, with the calls of both builds (the times
+# vary from run to run, so only the rest of the line is kept).
+command = (osl_app("testshade") + "-t 1 -g 2 2 --runstats "
+           + "--options profile_layers=1,pgo_samples=2 "
+           + "--groupname g --layer l test"
+           + " | grep 'calls)' | sed -e 's/.*%  //'" + redirect + " ;\n")
@@ -0,0 +1,7 @@
+#!/usr/bin/env python
+
+# Two layers bind the same userdata, and only the second needs its
+# derivatives.  They share one slot in the group data, which must have
+# room for the derivatives.
+command = testshade("-layer alayer a -layer blayer b " +
+                    "-connect alayer out blayer in")
@@ -0,0 +1,6 @@
+#!/usr/bin/env python
+
+# The same dictionary lookups with and without constant folding must
+# give the same results, and the same errors.
+command = testshade("-g 1 1 test")
+command += testshade("-g 1 1 --options opt_fold_dict=0 test")